@@ -0,0 +1,162 @@
+#include "CodeLayout.hh"
+#include "Config.hh"
+
+CodeLayout::CodeLayout(int k, int l_f, int l_c) {
+  this->k = k;
+  this->l_f = l_f;
+  this->l_c = l_c;
+  fast_group_of = new int[k];
+  compact_group_of = new int[k];
+  fast_start = new int[l_f + 1];
+  compact_first_fast = new int[l_c + 1];
+
+  fast_start[0] = 0;
+  for(int f = 0; f < l_f; ++f) {
+    fast_start[f + 1] = fast_start[f] + k / l_f + (f < k % l_f ? 1 : 0);
+  }
+  compact_first_fast[0] = 0;
+  for(int c = 0; c < l_c; ++c) {
+    compact_first_fast[c + 1] = compact_first_fast[c] + l_f / l_c + (c < l_f % l_c ? 1 : 0);
+  }
+  for(int c = 0; c < l_c; ++c) {
+    for(int f = compact_first_fast[c]; f < compact_first_fast[c + 1]; ++f) {
+      for(int i = fast_start[f]; i < fast_start[f + 1]; ++i) {
+        fast_group_of[i] = f;
+        compact_group_of[i] = c;
+      }
+    }
+  }
+}
+
+CodeLayout::~CodeLayout() {
+  delete [] fast_group_of;
+  delete [] compact_group_of;
+  delete [] fast_start;
+  delete [] compact_first_fast;
+}
+
+bool CodeLayout::isUniform() {
+  return k % l_f == 0 && l_f % l_c == 0;
+}
+
+int CodeLayout::fastGroupOf(int data_id) {
+  return fast_group_of[data_id];
+}
+
+int CodeLayout::fastGroupStart(int fast_id) {
+  return fast_start[fast_id];
+}
+
+int CodeLayout::fastGroupSize(int fast_id) {
+  return fast_start[fast_id + 1] - fast_start[fast_id];
+}
+
+int CodeLayout::compactGroupOf(int data_id) {
+  return compact_group_of[data_id];
+}
+
+int CodeLayout::compactGroupStart(int compact_id) {
+  return fast_start[compact_first_fast[compact_id]];
+}
+
+int CodeLayout::compactGroupSize(int compact_id) {
+  return fast_start[compact_first_fast[compact_id + 1]] - fast_start[compact_first_fast[compact_id]];
+}
+
+int CodeLayout::compactFirstFast(int compact_id) {
+  return compact_first_fast[compact_id];
+}
+
+int CodeLayout::compactDelta(int compact_id) {
+  return compact_first_fast[compact_id + 1] - compact_first_fast[compact_id];
+}
+
+int CodeLayout::compactGroupOfFast(int fast_id) {
+  return compact_group_of[fast_start[fast_id]];
+}
+
+bool CodeLayout::isHeadFast(int fast_id) {
+  return fast_id == compact_first_fast[compactGroupOfFast(fast_id)];
+}
+
+bool CodeLayout::isLastFast(int fast_id) {
+  return fast_id == compact_first_fast[compactGroupOfFast(fast_id) + 1] - 1;
+}
+
+int CodeLayout::mergedGroupNum() {
+  int num = 0;
+  for(int c = 0; c < l_c; ++c) {
+    if(compactDelta(c) > 1) {
+      num++;
+    }
+  }
+  return num;
+}
+
+int CodeLayout::groupOf(int data_id, bool hot) {
+  return hot ? fastGroupOf(data_id) : compactGroupOf(data_id);
+}
+
+int CodeLayout::groupStart(int group_id, bool hot) {
+  return hot ? fastGroupStart(group_id) : compactGroupStart(group_id);
+}
+
+int CodeLayout::groupSize(int group_id, bool hot) {
+  return hot ? fastGroupSize(group_id) : compactGroupSize(group_id);
+}
+
+  // Opt-S: a compact group occupies delta racks, the core rack keeps its first
+  // fast group and all its fast local parity blocks, the other fast groups are
+  // in a rack each; Opt-R: a fast group and its parity occupy a rack; Flat:
+  // a block per rack. A repair receives one (aggregated) block per other rack.
+double CodeLayout::fastRepairCost(int place_method) {
+  int total = 0;
+  for(int f = 0; f < l_f; ++f) {
+    int cost = 0;
+    if(place_method == OPT_S) {
+      cost = isHeadFast(f) ? 0 : 1;
+    } else if(place_method == FLAT) {
+      cost = fastGroupSize(f);
+    }
+    total += cost * fastGroupSize(f);
+  }
+  return (double)total / k;
+}
+
+double CodeLayout::compactRepairCost(int place_method) {
+  int total = 0;
+  for(int c = 0; c < l_c; ++c) {
+    int cost = compactDelta(c) - 1;
+    if(place_method == FLAT) {
+      cost = compactGroupSize(c);
+    }
+    total += cost * compactGroupSize(c);
+  }
+  return (double)total / k;
+}
+
+int CodeLayout::upcodeCost(int place_method) {
+  if(place_method == OPT_S) {
+    return 0;
+  }
+  return l_f - l_c;
+}
+
+int CodeLayout::downcodeCost(int place_method) {
+  int total = 0;
+  for(int c = 0; c < l_c; ++c) {
+    int delta = compactDelta(c);
+    if(delta == 1) {
+      continue;
+    }
+    if(place_method == OPT_S) {
+      total += delta - 2;
+    } else if(place_method == FLAT) {
+      for(int f = compact_first_fast[c]; f < compact_first_fast[c + 1] - 1; ++f) {
+        total += fastGroupSize(f);
+      }
+      total += delta - 1;
+    }
+  }
+  return total;
+}
@@ -0,0 +1,81 @@
+/*
+ * Layout of the local groups of a stripe, for the fast code (k, l_f, g)
+ * and the compact code (k, l_c, g).
+ *
+ * k needs not be divisible by l_f, nor l_f by l_c. The k data blocks are
+ * split into l_f consecutive fast local groups, as evenly as possible (the
+ * first k % l_f groups have one more block). The l_f fast local groups are
+ * merged into l_c compact local groups, each made of consecutive fast local
+ * groups, again as evenly as possible (the first l_f % l_c compact groups
+ * merge one more fast group). Thus a compact local parity block is always
+ * the XOR sum of the fast local parity blocks it merges, e.g.,
+ *   (14, 4, 2) -> (14, 3, 2): fast groups of 4, 4, 3, 3 data blocks,
+ *   compact groups merge fast groups {0, 1}, {2}, {3}.
+ * A compact group that merges a single fast group (delta = 1) is left
+ * untouched by upcode and downcode.
+ */
+
+#ifndef _CODELAYOUT_H_H_H_
+#define _CODELAYOUT_H_H_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+
+class CodeLayout{
+  private:
+    int k;
+    int l_f;
+    int l_c;
+      // data block id -> fast/ compact local group
+    int* fast_group_of;
+    int* compact_group_of;
+      // first data block of each fast group, l_f + 1 entries
+    int* fast_start;
+      // first fast group of each compact group, l_c + 1 entries
+    int* compact_first_fast;
+
+  public:
+    CodeLayout(int k, int l_f, int l_c);
+    ~CodeLayout();
+
+      // whether all the groups have the same size, i.e., k % l_f == 0 and l_f % l_c == 0
+    bool isUniform(void);
+
+      // fast local groups
+    int fastGroupOf(int data_id);
+    int fastGroupStart(int fast_id);
+    int fastGroupSize(int fast_id);
+
+      // compact local groups
+    int compactGroupOf(int data_id);
+    int compactGroupStart(int compact_id);
+    int compactGroupSize(int compact_id);
+      // the fast groups merged into a compact group
+    int compactFirstFast(int compact_id);
+    int compactDelta(int compact_id);
+      // the compact group that a fast group is merged into
+    int compactGroupOfFast(int fast_id);
+      // whether a fast group is the first/ last one of its compact group
+    bool isHeadFast(int fast_id);
+    bool isLastFast(int fast_id);
+      // number of compact groups with delta > 1, i.e., touched by upcode/ downcode
+    int mergedGroupNum(void);
+
+      // either side, for the code of a hot (fast) or cold (compact) file
+    int groupOf(int data_id, bool hot);
+    int groupStart(int group_id, bool hot);
+    int groupSize(int group_id, bool hot);
+
+      // cross-rack block transfers of the placement (OPT_S, OPT_R or FLAT in
+      // Config.hh), following the commands generated by the coordinator:
+      // average over the k data blocks of a single-block repair, for the fast
+      // and the compact code, and per stripe of an upcode and a downcode
+    double fastRepairCost(int place_method);
+    double compactRepairCost(int place_method);
+    int upcodeCost(int place_method);
+    int downcodeCost(int place_method);
+};
+
+#endif
@@ -23,6 +23,19 @@ Config::Config(string config_file) {
   XMLDocument doc;
   doc.LoadFile(config_file.c_str());
   XMLElement *element;
+  ack_parity_num = -1;
+  replica_num = 2;
+  read_window = 4;
+  recovery_batch = 16;
+  chain_repair = 0;
+  repair_slices = 1;
+  repair_daemon = 0;
+  repair_concurrency = 4;
+  repair_node_mbps = 0;
+  repair_gw_mbps = 0;
+  repair_queue_path = "./repair_queue";
+  partial_cache_blocks = 4;
+  hedge_percentile = 95;
 
   for(element = doc.FirstChildElement("setting")->FirstChildElement("attribute"); element != NULL; element = element->NextSiblingElement("attribute")) {
         XMLElement* ele = element->FirstChildElement("name");
@@ -60,6 +73,45 @@ Config::Config(string config_file) {
         else if (name == "data_path")
           data_path = ele->NextSiblingElement("value")->GetText();
 
+        else if (name == "read_window")
+          read_window = std::stoi(ele->NextSiblingElement("value")->GetText());
+
+        else if (name == "hedge_percentile")
+          hedge_percentile = std::stoi(ele->NextSiblingElement("value")->GetText());
+
+        else if (name == "recovery_batch")
+          recovery_batch = std::stoi(ele->NextSiblingElement("value")->GetText());
+
+        else if (name == "chain_repair")
+          chain_repair = std::stoi(ele->NextSiblingElement("value")->GetText());
+
+        else if (name == "repair_slices")
+          repair_slices = std::stoi(ele->NextSiblingElement("value")->GetText());
+
+        else if (name == "repair_daemon")
+          repair_daemon = std::stoi(ele->NextSiblingElement("value")->GetText());
+
+        else if (name == "repair_concurrency")
+          repair_concurrency = std::stoi(ele->NextSiblingElement("value")->GetText());
+
+        else if (name == "repair_node_mbps")
+          repair_node_mbps = std::stoi(ele->NextSiblingElement("value")->GetText());
+
+        else if (name == "repair_gw_mbps")
+          repair_gw_mbps = std::stoi(ele->NextSiblingElement("value")->GetText());
+
+        else if (name == "repair_queue_path")
+          repair_queue_path = ele->NextSiblingElement("value")->GetText();
+
+        else if (name == "partial_cache_blocks")
+          partial_cache_blocks = std::stoi(ele->NextSiblingElement("value")->GetText());
+
+        else if (name == "replica_num")
+          replica_num = std::stoi(ele->NextSiblingElement("value")->GetText());
+
+        else if (name == "ack_parity_num")
+          ack_parity_num = std::stoi(ele->NextSiblingElement("value")->GetText());
+
         else if (name.substr(0, 5) == "/rack") {
           set<string> dns;
           dns.clear();
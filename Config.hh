@@ -15,6 +15,11 @@ using std::string;
 
 using namespace tinyxml2;
 
+  // placement methods
+#define OPT_S 1
+#define OPT_R 2
+#define FLAT 3
+
 class Config{
   public:
     int k;
@@ -37,6 +42,20 @@ class Config{
 
     string data_path;
 
+    int read_window; // stripes read at once by a streaming read
+    int hedge_percentile; // a block read later than this percentile of the latencies is hedged, 0 for never
+    int replica_num; // replicas of a data block in a replicated upload, 2 or 3
+    int ack_parity_num; // parity blocks written before an upload of a stripe completes, -1 for all
+    int recovery_batch; // stripes planned at once by a node recovery
+    int chain_repair; // 1 to repair a block along a chain of its helpers, 0 for star-shaped plans
+    int repair_slices; // nodes of the target rack that reconstruct the slices of a block, 1 for the target alone
+    int repair_daemon; // 1 to repair the queued stripes in the background, 0 for "rp" only
+    int repair_concurrency; // stripes repaired at once by a round of the repair daemon
+    int repair_node_mbps; // bandwidth of the background repairs at a node, in MB/s, 0 for unlimited
+    int repair_gw_mbps; // bandwidth of the background repairs at the gateway, in MB/s, 0 for unlimited
+    string repair_queue_path; // file that journals the repair queue
+    int partial_cache_blocks; // partial sums of degraded reads cached by an aggregator DN, 0 for none
+
     string normalizeDNIP(string dnIP);
     Config(string config_file);
 }; 
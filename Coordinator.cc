@@ -19,9 +19,99 @@ Coordinator::Coordinator(Metadata* newMeta, Config* config, Socket* cn2dnSocket,
   chunk_size = 1024*1024*conf->chunk_size;
   packet_size = 1024*1024*conf->packet_size;
   place_method = conf->place_method;
+  ec = new ErasureCode(k, g);
+  kernel = getLRCKernel(conf);
+  cout<<"LRC kernel: "<<kernel->name()<<endl;
+  layout = new CodeLayout(k, l_f, l_c);
+  engine = new EncodeEngine(k, l_f, g, kernel, ec, 0);
+  cout<<"encode engine: "<<engine->workerNum()<<" workers"<<endl;
+  planner = new RepairPlanner(meta);
+  plans = new PlanCache();
+  if(!layout->isUniform()) {
+    cout<<"uneven local groups, ("<<k<<", "<<l_f<<", "<<g<<") -> ("<<k<<", "<<l_c<<", "<<g<<")"<<endl;
+  }
+  pending_update_num = 0;
+  ack_parity_num = conf->ack_parity_num;
+  replica_num = conf->replica_num;
+  read_window = conf->read_window > 0 ? conf->read_window : 1;
+  hedge_percentile = (conf->hedge_percentile > 0 && conf->hedge_percentile < 100) ? conf->hedge_percentile : 0;
+  recovery_batch = conf->recovery_batch > 0 ? conf->recovery_batch : 1;
+  chain_repair = (conf->chain_repair != 0);
+  repair_slices = conf->repair_slices;
+  if(repair_slices > chunk_size / packet_size) {
+    repair_slices = chunk_size / packet_size;
+  }
+  if(repair_slices > COUNT_FIELD_MAX) {
+    repair_slices = COUNT_FIELD_MAX;
+  }
+  if(replica_num < 2) {
+    replica_num = 2;
+  } else if(replica_num > 3) {
+    replica_num = 3;
+  }
+  if(g == 0) {
+    replica_num = 2;
+  }
+  expected_ack_num = 0;
+  recv_ack_num = 0;
+  ack_collector_stop = false;
+  ingest_fd = -1;
+  ingest_map = NULL;
+  ingest_len = 0;
+  map<string, string>::const_iterator dnIter;
+  for(dnIter = conf->dn2rack.begin(); dnIter != conf->dn2rack.end(); ++dnIter) {
+    dn_send_locks[dnIter->first] = new mutex();
+  }
+    // an LRC stripe takes any g + 1 failures
+  repairs = new RepairQueue(conf->repair_queue_path, g + 1);
+    // the metadata is not persisted, so the stripes journaled before a restart
+    // are unknown to it; they are dropped, rather than repaired later as the
+    // stripes of new uploads that reuse their names
+  vector<RepairEntry> journaled = repairs->top(repairs->stripeNum());
+  for(size_t i = 0; i < journaled.size(); ++i) {
+    if(meta->getStripe2File(journaled[i].stripe) == "Exception") {
+      cout<<"repair queue: drop stripe "<<journaled[i].stripe<<", unknown to the metadata, "<<journaled[i].missing_IDs.size()<<" blocks not repaired"<<endl;
+      repairs->remove(journaled[i].stripe);
+    }
+  }
+  repair_concurrency = conf->repair_concurrency > 0 ? conf->repair_concurrency : 1;
+  repair_node_mbps = conf->repair_node_mbps > 0 ? conf->repair_node_mbps : 0;
+  repair_gw_mbps = conf->repair_gw_mbps > 0 ? conf->repair_gw_mbps : 0;
+  partial_cache_blocks = conf->partial_cache_blocks;
+  next_partial_id = 1;
+  partial_hit_num = 0;
+  partial_miss_num = 0;
+  fg_waiting = 0;
+  daemon_stop = false;
+  if(conf->repair_daemon != 0) {
+    repair_daemon = thread([=]{this->runRepairDaemon();});
+  }
 }
 
 Coordinator::~Coordinator(){
+  {
+    unique_lock<mutex> lk(io_lock);
+    daemon_stop = true;
+  }
+  daemon_cv.notify_all();
+  if(repair_daemon.joinable()) {
+    repair_daemon.join();
+  }
+  delete repairs;
+  delete engine;
+  delete planner;
+  delete plans;
+  delete ec;
+  delete kernel;
+  delete layout;
+  map<string, mutex*>::const_iterator lockIter;
+  for(lockIter = dn_send_locks.begin(); lockIter != dn_send_locks.end(); ++lockIter) {
+    delete lockIter->second;
+  }
+  map<string, PartialSumCache*>::const_iterator mirrorIter;
+  for(mirrorIter = partial_mirrors.begin(); mirrorIter != partial_mirrors.end(); ++mirrorIter) {
+    delete mirrorIter->second;
+  }
 }
 
   // send command 
@@ -38,9 +128,150 @@ int Coordinator::recvAck(char* ack){
   return ack_length;
 }
 
+  // the acks of the written blocks are "write blk success" or "write blk fail",
+  // followed by the block name
+void Coordinator::startAckCollector() {
+  ack_collector_stop = false;
+  ack_collector = thread([=]{
+    char* ack = new char[1024];
+    int success_len = strlen("write blk success");
+    int fail_len = strlen("write blk fail");
+    while(true) {
+      {
+        unique_lock<mutex> lk(ack_lock);
+        ack_cv.wait(lk, [&]{return ack_collector_stop || recv_ack_num < expected_ack_num;});
+        if(recv_ack_num == expected_ack_num) {
+          break;
+        }
+      }
+      recvAck(ack);
+      unique_lock<mutex> lk(ack_lock);
+      if(strncmp(ack, "write blk success", success_len) == 0) {
+        blk_ack_state[string(ack + success_len)] = 1;
+      } else if(strncmp(ack, "write blk fail", fail_len) == 0) {
+        blk_ack_state[string(ack + fail_len)] = -1;
+      }
+      recv_ack_num++;
+      ack_cv.notify_all();
+    }
+    delete[] ack;
+  });
+}
+
+  // the collector stops once all the expected acks are received
+void Coordinator::stopAckCollector() {
+  {
+    unique_lock<mutex> lk(ack_lock);
+    ack_collector_stop = true;
+  }
+  ack_cv.notify_all();
+  ack_collector.join();
+  blk_ack_state.clear();
+}
+
+void Coordinator::expectAck(string blk_name) {
+  unique_lock<mutex> lk(ack_lock);
+  blk_ack_state[blk_name] = 0;
+  expected_ack_num++;
+  ack_cv.notify_all();
+}
+
+void Coordinator::sendBlock(string blk_name, char* buf, string blk_ip) {
+  unique_lock<mutex> lk(*dn_send_locks[blk_ip]);
+  string cmd = "en" + blk_name;
+  cout<<"~~~upload block "<<blk_name<<", send cmd: "<<cmd<<endl;
+  sendCmd(cmd, blk_ip);
+  if(ingest_map != NULL && buf >= ingest_map && buf < ingest_map + ingest_len) {
+    cn2dnSoc->sendFileData(ingest_fd, buf - ingest_map, chunk_size, packet_size, (char*)blk_ip.c_str(), CN_UP_DATA_PORT);
+  } else {
+    cn2dnSoc->sendData(buf, chunk_size, packet_size, (char*)blk_ip.c_str(), CN_UP_DATA_PORT);
+  }
+}
+
+char* Coordinator::mapOutput(size_t size) {
+  int fd = open("./output", O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) {
+    return NULL;
+  }
+  char* out = NULL;
+  if(ftruncate(fd, size) == 0) {
+    out = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(out == MAP_FAILED) {
+      out = NULL;
+    }
+  }
+  close(fd);
+  return out;
+}
+
+int Coordinator::reapPendingWrites(bool wait_all) {
+  int lost_num = 0;
+  set<string> lost_stripes;
+  set<string> unfinished_stripes;
+  do {
+    unfinished_stripes.clear();
+    vector<PendingWrite> remaining;
+    for(size_t i = 0; i < pending_writes.size(); ++i) {
+      PendingWrite pw = pending_writes[i];
+      int state;
+      {
+        unique_lock<mutex> lk(ack_lock);
+        if(wait_all) {
+          ack_cv.wait(lk, [&]{return blk_ack_state[pw.blk_name] != 0;});
+        }
+        state = blk_ack_state[pw.blk_name];
+      }
+      if(state == 1) {
+        delete[] pw.buf;
+        continue;
+      }
+      if(state == -1 && pw.retry >= UPLOAD_RETRY_NUM) {
+        cout<<"****** give up writing "<<pw.blk_name<<" after "<<pw.retry<<" retries, queued for repair"<<endl;
+        delete[] pw.buf;
+          // an uploaded stripe is in the fast code
+        repairs->push(pw.stripe, pw.blk_id, true, true);
+        lost_stripes.insert(pw.stripe);
+        lost_num++;
+        continue;
+      }
+      if(state == -1) {
+        pw.retry++;
+        cout<<"****** resend "<<pw.blk_name<<" to "<<pw.ip<<", retry "<<pw.retry<<endl;
+        expectAck(pw.blk_name);
+        bg_send_thrds.push_back(thread([=]{this->sendBlock(pw.blk_name, pw.buf, pw.ip);}));
+      }
+      remaining.push_back(pw);
+      unfinished_stripes.insert(pw.stripe);
+    }
+    pending_writes = remaining;
+  } while(wait_all && !pending_writes.empty());
+
+  if(wait_all) {
+    for(size_t i = 0; i < bg_send_thrds.size(); ++i) {
+      bg_send_thrds[i].join();
+    }
+    bg_send_thrds.clear();
+  }
+    // the stripes that lost a parity block stay under-redundant in the metadata
+    // until the repair queue rebuilds it
+  set<string>::iterator stripesIter;
+  for(stripesIter = early_acked_stripes.begin(); stripesIter != early_acked_stripes.end(); ) {
+    if(unfinished_stripes.find(*stripesIter) != unfinished_stripes.end()) {
+      ++stripesIter;
+      continue;
+    }
+    if(lost_stripes.find(*stripesIter) == lost_stripes.end()) {
+      meta->markStripeRedundant(*stripesIter);
+    }
+    early_acked_stripes.erase(stripesIter++);
+  }
+  return lost_num;
+}
+
   // test the performance of upload, download, upcode and downcode
 void Coordinator::testPerformance(string file) {
-  uploadFile(file);
+  uploadFile(file, UPLOAD_CN_PARITY);
+  testEncodeThroughput();
   FILE* fpr = fopen("./results", "a");
   fprintf(fpr, "------ k: %d, l_f: %d, g: %d, l_c: %d\n ", k, l_f, g, l_c);
   double temp_decode_time_f = 0.0;
@@ -87,43 +318,363 @@ void Coordinator::testPerformance(string file) {
   fclose(fpr);
 }
 
-  // send a block when uploading, wait and receive ack
-int Coordinator::CNSendData(int blk_id, string blk_name, char* buf, string blk_ip, char* ack) {
-  string cmd = "en";
-  cmd += blk_name;
-  cout<<"~~~upload block "<<blk_id<<", send cmd: "<<cmd<<endl;
-  sendCmd(cmd, blk_ip);
-  cout<<"~~~then send data!"<<endl;
-  cn2dnSoc->sendData(buf, chunk_size, packet_size, (char*)blk_ip.c_str(), CN_UP_DATA_PORT);
-  int ack_len = recvAck(ack);
-  cout<<"ack length: "<<ack_len<<endl;
-  return ack_len;
+  // send the blocks of a stripe when uploading: one sender per DN, which sends
+  // the DN's blocks one by one (a DN serves a command at a time), the data
+  // blocks right away and the parity blocks when encode_job is done, while the
+  // acks are collected asynchronously; return the number of written blocks
+int Coordinator::CNSendStripe(string stripe_name, string blk_names[], char** buf, map<int, string>& blk_id2IP, int encode_job, int wait_parity_num) {
+  int stripe_len = k + l_f + g;
+  map<string, vector<int>> ip2data;
+  map<string, vector<int>> ip2parity;
+  int parity_num = 0;
+  map<int, string>::const_iterator blk_id2IPIter;
+  for(blk_id2IPIter = blk_id2IP.begin(); blk_id2IPIter != blk_id2IP.end(); ++blk_id2IPIter) {
+    int blk_id = (*blk_id2IPIter).first;
+    if(blk_id >= stripe_len) {
+      continue;
+    }
+    expectAck(blk_names[blk_id]);
+    if(blk_id < k) {
+      ip2data[(*blk_id2IPIter).second].push_back(blk_id);
+    } else {
+      ip2parity[(*blk_id2IPIter).second].push_back(blk_id);
+      parity_num++;
+    }
+  }
+    // the parity blocks left to the background are sent from a copy,
+	// as the bufs are reused by the next stripes
+  bool early_ack = (wait_parity_num < parity_num);
+
+  vector<thread> send_thrds;
+  for(map<string, vector<int>>::const_iterator it = ip2data.begin(); it != ip2data.end(); ++it) {
+    string blk_ip = (*it).first;
+    vector<int> blk_ids = (*it).second;
+    send_thrds.push_back(thread([=]{
+      for(int i = 0; i < (int)blk_ids.size(); ++i) {
+        this->sendBlock(blk_names[blk_ids[i]], buf[blk_ids[i]], blk_ip);
+      }
+    }));
+  }
+
+  engine->wait(encode_job);
+  for(map<string, vector<int>>::const_iterator it = ip2parity.begin(); it != ip2parity.end(); ++it) {
+    string blk_ip = (*it).first;
+    vector<int> blk_ids = (*it).second;
+    vector<string> parity_names;
+    vector<char*> parity_bufs;
+    for(int i = 0; i < (int)blk_ids.size(); ++i) {
+      char* parity_buf = buf[blk_ids[i]];
+      if(early_ack) {
+        parity_buf = new char[chunk_size];
+        memcpy(parity_buf, buf[blk_ids[i]], chunk_size);
+        PendingWrite pw;
+        pw.stripe = stripe_name;
+        pw.blk_name = blk_names[blk_ids[i]];
+        pw.blk_id = blk_ids[i];
+        pw.ip = blk_ip;
+        pw.buf = parity_buf;
+        pw.retry = 0;
+        pending_writes.push_back(pw);
+      }
+      parity_names.push_back(blk_names[blk_ids[i]]);
+      parity_bufs.push_back(parity_buf);
+    }
+    thread parity_thrd = thread([=]{
+      for(int i = 0; i < (int)blk_ids.size(); ++i) {
+        this->sendBlock(parity_names[i], parity_bufs[i], blk_ip);
+      }
+    });
+    if(early_ack) {
+      bg_send_thrds.push_back(move(parity_thrd));
+    } else {
+      send_thrds.push_back(move(parity_thrd));
+    }
+  }
+  for(size_t i = 0; i < send_thrds.size(); ++i) {
+    send_thrds[i].join();
+  }
+
+    // wait for the acks of the data blocks and wait_parity_num parity blocks
+  int succ_num = 0;
+  unique_lock<mutex> lk(ack_lock);
+  ack_cv.wait(lk, [&]{
+    int parity_acked = 0;
+    int parity_written = 0;
+    for(blk_id2IPIter = blk_id2IP.begin(); blk_id2IPIter != blk_id2IP.end(); ++blk_id2IPIter) {
+      int blk_id = (*blk_id2IPIter).first;
+      if(blk_id >= stripe_len) {
+        continue;
+      }
+      int state = blk_ack_state[blk_names[blk_id]];
+      if(blk_id < k && state == 0) {
+        return false;
+      }
+      if(blk_id >= k && state != 0) {
+        parity_acked++;
+        parity_written += (state == 1) ? 1 : 0;
+      }
+    }
+    return parity_written >= wait_parity_num || parity_acked == parity_num;
+  });
+  for(blk_id2IPIter = blk_id2IP.begin(); blk_id2IPIter != blk_id2IP.end(); ++blk_id2IPIter) {
+    if((*blk_id2IPIter).first < stripe_len && blk_ack_state[blk_names[(*blk_id2IPIter).first]] == 1) {
+      succ_num++;
+    }
+  }
+  return succ_num;
+}
+
+  // the blocks of an equation are summed up within each rack and sent to the
+  // node of the parity block, through the gateway for other racks, as a repair
+  // (see generateMultiDecodeCmd). Parity blocks whose nodes are disjoint are
+  // computed at once, and their nodes ack once the blocks are written
+int Coordinator::encodeParitiesOnDN(vector<int>& parity_ids, vector<Equation>& equations, vector<vector<string>>& blk_names, vector<vector<string>>& blk_IPs, string gw_ip, set<string>* written_blks) {
+  char* ack = new char[1024];
+  int succ_num = 0;
+  vector<int> remaining;
+  for(size_t p = 0; p < parity_ids.size(); ++p) {
+    remaining.push_back(p);
+  }
+  while(!remaining.empty()) {
+    set<string> busy_ips;
+    vector<int> wave;
+    vector<int> rest;
+    map<string, string> wave_cmds;
+    string gw_rounds = "";
+    int gw_round_num = 0;
+    for(size_t r = 0; r < remaining.size(); ++r) {
+      int p = remaining[r];
+      char* gw_cmd = new char[400];
+      gw_cmd[0] = '\0';
+      map<string, string> cmds;
+      if(chain_repair) {
+        cmds = generateChainRepairCmds(&blk_names[p][0], &blk_IPs[p][0], parity_ids[p], equations[p], gw_ip);
+      } else {
+        cmds = generateMultiDecodeCmd(&blk_names[p][0], &blk_IPs[p][0], parity_ids[p], equations[p], gw_ip, gw_cmd);
+      }
+      if(cmds.empty()) {
+        cout<<"~~~~~~ no repair plan for block "<<blk_names[p][parity_ids[p]]<<endl;
+        delete[] gw_cmd;
+        continue;
+      }
+      int rounds = (gw_cmd[0] != '\0') ? Socket::parseCount(gw_cmd + 2) : 0;
+      bool disjoint = (gw_round_num + rounds <= COUNT_FIELD_MAX);
+      // the gateway either relays the rounds of a wave or sums up for one task
+      if((rounds > 0 && busy_ips.find(gw_ip) != busy_ips.end()) || (gw_round_num > 0 && cmds.find(gw_ip) != cmds.end())) {
+        disjoint = false;
+      }
+      map<string, string>::const_iterator cmdsIter;
+      for(cmdsIter = cmds.begin(); cmdsIter != cmds.end() && disjoint; ++cmdsIter) {
+        if(busy_ips.find(cmdsIter->first) != busy_ips.end()) {
+          disjoint = false;
+        }
+      }
+      if(!disjoint && !wave.empty()) {
+        rest.push_back(p);
+        delete[] gw_cmd;
+        continue;
+      }
+      for(cmdsIter = cmds.begin(); cmdsIter != cmds.end(); ++cmdsIter) {
+        busy_ips.insert(cmdsIter->first);
+        wave_cmds[cmdsIter->first] = cmdsIter->second;
+      }
+      if(rounds > 0) {
+        // the rounds of the gateway commands are merged into one command
+        gw_round_num += rounds;
+        gw_rounds += string(gw_cmd + 2 + COUNT_FIELD_LEN);
+      }
+      wave.push_back(p);
+      delete[] gw_cmd;
+    }
+
+    map<string, string>::const_iterator cmdsIter;
+    for(cmdsIter = wave_cmds.begin(); cmdsIter != wave_cmds.end(); ++cmdsIter) {
+      sendCmd(cmdsIter->second, cmdsIter->first);
+      cout<<"~~~~~~ send cmd to "<<cmdsIter->first<<" :"<<cmdsIter->second<<endl;
+    }
+    if(gw_round_num > 0) {
+      string gw_cmd_str = "ga" + Socket::countField(gw_round_num) + gw_rounds;
+      cout<<"gw "<<gw_ip<<", encode cmd: "<<gw_cmd_str<<endl;
+      sendCmd(gw_cmd_str, gw_ip);
+    }
+    for(size_t w = 0; w < wave.size(); ++w) {
+      recvAck(ack);
+      if(strncmp(ack, "fi_deco", 7) == 0) {
+        succ_num++;
+        if(written_blks != NULL) {
+          written_blks->insert(string(ack + 7));
+        }
+      }
+    }
+    remaining = rest;
+  }
+  delete[] ack;
+  return succ_num;
+}
+
+  // let the DNs compute the fast local parity blocks of a stripe whose data
+  // blocks are written
+int Coordinator::encodeLocalParitiesOnDN(string blk_names[], map<int, string>& blk_id2IP, string gw_ip) {
+  int stripe_len = k + l_f + g;
+  vector<string> names(blk_names, blk_names + stripe_len);
+  vector<string> IPs(stripe_len);
+  for(int i = 0; i < stripe_len; ++i) {
+    IPs[i] = blk_id2IP[i];
+  }
+  vector<int> parity_ids;
+  vector<Equation> equations;
+  vector<vector<string>> parity_names;
+  vector<vector<string>> parity_IPs;
+  for(int group_id = 0; group_id < l_f; ++group_id) {
+    Equation equation;
+    for(int i = kernel->groupStart(group_id, true); i < kernel->groupStart(group_id, true) + kernel->groupSize(group_id, true); ++i) {
+      equation.push_back(make_pair(i, (unsigned char)1));
+    }
+    parity_ids.push_back(k + group_id);
+    equations.push_back(equation);
+    parity_names.push_back(names);
+    parity_IPs.push_back(IPs);
+  }
+  return encodeParitiesOnDN(parity_ids, equations, parity_names, parity_IPs, gw_ip, NULL);
+}
+
+string Coordinator::replicaName(string blk_name, int replica) {
+  string name = blk_name;
+  name[11] = (replica == 1) ? 'r' : 's';
+  return name;
+}
+
+string Coordinator::replicaIP(int data_id, int replica, map<int, string>& blk_id2IP) {
+  if(replica == 1) {
+    return blk_id2IP[k + layout->fastGroupOf(data_id)];
+  }
+  return blk_id2IP[k + l_f + data_id % g];
+}
+
+  // the blocks are read as by readFile, one "rd" per block; a missing block
+  // fails the check
+bool Coordinator::verifyParities(vector<string>& names, vector<string>& IPs, vector<int>& parity_ids, vector<Equation>& equations) {
+  map<string, char*> bufs;
+  for(int i = 0; i < k; ++i) {
+    bufs[names[i]] = NULL;
+  }
+  for(size_t p = 0; p < parity_ids.size(); ++p) {
+    bufs[names[parity_ids[p]]] = NULL;
+  }
+  map<string, string> blk2IP;
+  for(size_t i = 0; i < names.size(); ++i) {
+    blk2IP[names[i]] = IPs[i];
+  }
+
+  int listener = cn2dnSoc->initListener(CN_READ_DATA_PORT);
+  map<string, char*>::iterator bufsIter;
+  for(bufsIter = bufs.begin(); bufsIter != bufs.end(); ++bufsIter) {
+    sendCmd("rd" + bufsIter->first, blk2IP[bufsIter->first]);
+  }
+  bool verified = true;
+  char tag[DATA_TAG_LEN + 1];
+  for(size_t received = 0; received < bufs.size(); ++received) {
+    int connfd = cn2dnSoc->acceptTagged(listener, tag);
+    string blk = string(tag, DATA_TAG_LEN - 2);
+    if(string(tag + DATA_TAG_LEN - 2) != "ok" || bufs.find(blk) == bufs.end()) {
+      cn2dnSoc->recvTaggedData(connfd, NULL, 0, packet_size);
+      cout<<"~~~~~~ verify: block "<<blk<<" missing"<<endl;
+      verified = false;
+      continue;
+    }
+    bufs[blk] = new char[chunk_size];
+    cn2dnSoc->recvTaggedData(connfd, bufs[blk], chunk_size, packet_size);
+  }
+  cn2dnSoc->closeListener(listener);
+
+  char* sum = new char[chunk_size];
+  for(size_t p = 0; p < parity_ids.size() && verified; ++p) {
+    memset(sum, 0, chunk_size);
+    for(size_t j = 0; j < equations[p].size() && verified; ++j) {
+      char* src = bufs[names[equations[p][j].first]];
+      verified = (src != NULL);
+      if(verified) {
+        ErasureCode::gfMulRegion(equations[p][j].second, src, sum, chunk_size, true);
+      }
+    }
+    char* parity = bufs[names[parity_ids[p]]];
+    if(verified && (parity == NULL || memcmp(sum, parity, chunk_size) != 0)) {
+      cout<<"~~~~~~ verify: parity block "<<names[parity_ids[p]]<<" mismatch"<<endl;
+      verified = false;
+    }
+  }
+  delete[] sum;
+  for(bufsIter = bufs.begin(); bufsIter != bufs.end(); ++bufsIter) {
+    delete[] bufsIter->second;
+  }
+  return verified;
+}
+
+  // the data blocks and their replicas are sent concurrently, the blocks of
+  // the same DN one by one
+int Coordinator::CNSendReplicas(string blk_names[], char** buf, map<int, string>& blk_id2IP) {
+  map<string, vector<pair<string, int>>> ip2blks;
+  for(int blk_id = 0; blk_id < k; ++blk_id) {
+    ip2blks[blk_id2IP[blk_id]].push_back(make_pair(blk_names[blk_id], blk_id));
+    expectAck(blk_names[blk_id]);
+    for(int replica = 1; replica < replica_num; ++replica) {
+      string name = replicaName(blk_names[blk_id], replica);
+      ip2blks[replicaIP(blk_id, replica, blk_id2IP)].push_back(make_pair(name, blk_id));
+      expectAck(name);
+    }
+  }
+  vector<thread> send_thrds;
+  for(map<string, vector<pair<string, int>>>::const_iterator it = ip2blks.begin(); it != ip2blks.end(); ++it) {
+    string blk_ip = (*it).first;
+    vector<pair<string, int>> blks = (*it).second;
+    send_thrds.push_back(thread([=]{
+      for(size_t i = 0; i < blks.size(); ++i) {
+        this->sendBlock(blks[i].first, buf[blks[i].second], blk_ip);
+      }
+    }));
+  }
+  for(size_t i = 0; i < send_thrds.size(); ++i) {
+    send_thrds[i].join();
+  }
+  int succ_num = 0;
+  unique_lock<mutex> lk(ack_lock);
+  for(map<string, vector<pair<string, int>>>::const_iterator it = ip2blks.begin(); it != ip2blks.end(); ++it) {
+    for(size_t i = 0; i < (*it).second.size(); ++i) {
+      string name = (*it).second[i].first;
+      ack_cv.wait(lk, [&]{return blk_ack_state[name] != 0;});
+      if(blk_ack_state[name] == 1) {
+        succ_num++;
+      }
+    }
+  }
+  return succ_num;
 }
 
   // calculate local parity block when uploading
 void Coordinator::calculateLocalParityBlock(int local_blk_id, char** buf) {
-  int* int_buf = (int*)buf[local_blk_id];
   int lp_id = local_blk_id - k;
-  int* dat_buf;
-  int r_f = k / l_f;
-  for(int dat_blk_id = lp_id*r_f; dat_blk_id < lp_id*r_f + r_f; ++dat_blk_id) {
-    dat_buf = (int*)buf[dat_blk_id];
-    for(int num = 0; num < (long long)(chunk_size * sizeof(char) / sizeof(int)); ++num) {
-      int_buf[num] = int_buf[num] ^ dat_buf[num];
-    }
-  }
+  memset(buf[local_blk_id], 0, chunk_size);
+  kernel->xorFanIn(buf + kernel->groupStart(lp_id, true), kernel->groupSize(lp_id, true), buf[local_blk_id], chunk_size);
+}
+
+  // calculate the g global parity blocks when uploading,
+  // buf[k + l_f], ..., buf[k + l_f + g - 1] are overwritten
+void Coordinator::calculateGlobalParityBlocks(char** buf) {
+  ec->encodeGlobalParities(buf, buf + k + l_f, chunk_size);
 }
 
   /* * * * * * * * * * * * * * * * * * * *
    *    kernel routine 1: uploadFile     *
    * * * * * * * * * * * * * * * * * * * */
-void Coordinator::uploadFile(string file){
+void Coordinator::uploadFile(string file, int mode){
+  bool dn_parity = (mode == UPLOAD_DN_PARITY);
+  bool replicated = (mode == UPLOAD_REPLICATED);
   // [1st], file info
-  int file_size = 0;
+  off_t file_size = 0;
   FILE* fp = fopen((char*)file.c_str(), "r");
   if(fp != NULL) {
-    fseek(fp, 0L, SEEK_END);
-    file_size = ftell(fp);
+    fseeko(fp, 0, SEEK_END);
+    file_size = ftello(fp);
     fclose(fp);
   }
   int file_num = meta->getFileNum();
@@ -137,7 +688,7 @@ void Coordinator::uploadFile(string file){
     // variables for stripes
   set<string> stripes;
   stripes.clear();
-  int temp_stripe_num = file_size / (k * chunk_size);
+  int temp_stripe_num = file_size / ((off_t)k * chunk_size);
     // we assume special-format files, such as "FI0000", "FI0001", whose names are composed of six chars.
 	// we then add four numbers to represent a stripe, such as "0000", "0001".
 	// we next add two numbers to represent a block, such as "00", "01".
@@ -160,26 +711,79 @@ void Coordinator::uploadFile(string file){
   int ten;
   int one;
 
-    // we new a stripe-length (i.e., k + l_f) of bufs 
-	// to store the data and local parity blocks.
-  char** buf = new char*[k + l_f];
-  for(int i = 0; i < k + l_f; ++i) {
-    buf[i] = new char[chunk_size];
-  }
-    // open file
-  FILE* fp2 = fopen((char*)file.c_str(), "r");
-  if(fp2 == NULL) {
+    // the file is mapped, rather than read into bufs: the data blocks of a
+	// stripe point into the mapping, are encoded from the page cache, and
+	// are sent from the file by sendfile. We new two stripe-length (i.e.,
+	// k + l_f + g) sets of bufs, whose local and global parity blocks are
+	// allocated: the next stripe is encoded in one set, while the current
+	// stripe is sent from the other.
+  int stripe_len = k + l_f + g;
+  ingest_fd = open((char*)file.c_str(), O_RDONLY);
+  if(ingest_fd < 0 || file_size == 0) {
     cout<<"WARNING: file not exist, cannot proceed..."<<endl;
+    if(ingest_fd >= 0) {
+      close(ingest_fd);
+      ingest_fd = -1;
+    }
     return;
   }
-    // when we send the buf of blocks to k + l_f different storage nodes, 
-	// the coordinator will wait and receive an ack from each of the k + l_f nodes.
-  int ack_size = 1024;
-  char** acks = new char*[k + l_f];
-  for(int i = 0; i < k + l_f; ++i) {
-    acks[i] = new char[ack_size];
+  ingest_len = (size_t)file_size;
+  ingest_map = (char*)mmap(NULL, ingest_len, PROT_READ, MAP_PRIVATE, ingest_fd, 0);
+  if(ingest_map == MAP_FAILED) {
+    cout<<"WARNING: cannot map the file, cannot proceed..."<<endl;
+    close(ingest_fd);
+    ingest_fd = -1;
+    ingest_map = NULL;
+    return;
+  }
+  madvise(ingest_map, ingest_len, MADV_SEQUENTIAL);
+  char*** buf_sets = new char**[2];
+  for(int s = 0; s < 2; ++s) {
+    buf_sets[s] = new char*[stripe_len];
+    for(int i = k; i < stripe_len; ++i) {
+      buf_sets[s][i] = new char[chunk_size];
+    }
+  }
+    // when we send the buf of blocks to k + l_f + g different storage nodes, 
+	// the coordinator will receive an ack from each of the k + l_f + g nodes,
+	// and completes the stripe once the data blocks and wait_parity_num parity
+	// blocks are written (early ack). The DNs compute the local parity blocks
+	// only once all the blocks sent by the CN are written. A replicated stripe
+	// completes once the data blocks and their replicas are written
+  int parity_num = replicated ? 0 : (dn_parity ? g : l_f + g);
+  int wait_parity_num = parity_num;
+  if(!dn_parity && ack_parity_num >= 0 && ack_parity_num < parity_num) {
+    wait_parity_num = ack_parity_num;
+  }
+  startAckCollector();
+  double write_time = 0.0;
+  string blk_names[stripe_len];
+    // encoding time of the parity blocks, from submitting a stripe to the
+	// encode engine to the end of its encoding
+  double encode_time = 0.0;
+  struct timeval upload_start, upload_end;
+  gettimeofday(&upload_start, NULL);
+    // blocks sent by the CN, i.e., its egress
+  int sent_blk_num = 0;
+  string gw_ip = meta->getGW();
+
+    // point a set of bufs at the k data blocks of a stripe in the mapping, and
+	// submit the stripe to the encode engine, encode_jobs[s] is the job of set s
+  int* encode_jobs = new int[2];
+  auto mapStripe = [=](int stripe_id) {
+    char** set_buf = buf_sets[stripe_id % 2];
+    size_t stripe_offset = (size_t)stripe_id * k * chunk_size;
+    madvise(ingest_map + stripe_offset, (size_t)k * chunk_size, MADV_WILLNEED);
+    for(int blk_id = 0; blk_id < k; ++blk_id) {
+      set_buf[blk_id] = ingest_map + stripe_offset + (size_t)blk_id * chunk_size;
+    }
+    if(!replicated) {
+      encode_jobs[stripe_id % 2] = engine->submit(set_buf, chunk_size);
+    }
+  };
+  if(temp_stripe_num > 0) {
+    mapStripe(0);
   }
-  int* ack_lens = new int[k + l_f];
 
   // [2nd], stripe info
   int all_stripe_succ_tag = 1;
@@ -206,156 +810,875 @@ void Coordinator::uploadFile(string file){
 
       // we select locations for the n buf of blocks.
     map<int, string> blk_id2IP = decide_location();
-    map<int, string>::const_iterator blk_id2IPIter;
-    int temp_blk_id;
-    string temp_blk_IP;
+
+      // encode the next stripe ahead, while this one is sent
+    char** buf = buf_sets[i % 2];
+    int encode_job = encode_jobs[i % 2];
+    if(i + 1 < temp_stripe_num) {
+      mapStripe(i + 1);
+    }
 
     // [3rd], block info
     blocks.clear();
-    int all_block_succ_tag = 1;
-    for(int blk_id = 0; blk_id < k + l_f; ++blk_id) {
+    for(int blk_id = 0; blk_id < stripe_len; ++blk_id) {
       ten = blk_id / 10;
       one = blk_id - ten * 10;
       blk_name[12] = '0' + ten;
       blk_name[13] = '0' + one;
       blk_name[14] = '\0';
+      blk_names[blk_id] = string(blk_name);
       blocks.insert(pair<unsigned int, string>(blk_id, string(blk_name)));
         // !!! update stripe metadata
       meta->updateBlkStripes(string(blk_name), string(stripe_name));
-      
-	    // fill each block
-      if(blk_id < k) {
-          // data blocks
-        fread(buf[blk_id], 1, chunk_size, fp2);
-      } else {
-          // local parity blocks
-        calculateLocalParityBlock(blk_id, buf);
-      }
-        // send each block
-      for(blk_id2IPIter = blk_id2IP.begin(); blk_id2IPIter != blk_id2IP.end(); ++blk_id2IPIter) {
-        temp_blk_id = (*blk_id2IPIter).first;
-        temp_blk_IP = (*blk_id2IPIter).second;
-        if(temp_blk_id == blk_id && blk_id < k + l_f) {
-          ack_lens[blk_id] = CNSendData(temp_blk_id, string(blk_name), buf[blk_id], temp_blk_IP, acks[blk_id]);
-          if(strcmp(acks[blk_id], "write blk success") != 0) {
-            cout<<"write block "<<blk_id<<" fail!"<<endl;
-            all_block_succ_tag = -1;
-          }
-            // !!! update stripe metadata
-          meta->updateBlkIPs((string)blk_name, temp_blk_IP);
-          break;
-        }
-      }
     } // end of block info
-    if(all_block_succ_tag == -1) {
+
+      // send all the blocks of the stripe at once, the parity blocks
+	  // as soon as the encode engine finishes the stripe. With dn_parity, the
+	  // local parity blocks are not sent, but computed by the DNs afterwards
+    map<int, string> send_id2IP = blk_id2IP;
+    if(dn_parity) {
+      for(int blk_id = k; blk_id < k + l_f; ++blk_id) {
+        send_id2IP.erase(blk_id);
+      }
+    }
+    struct timeval write_start, write_end;
+    gettimeofday(&write_start, NULL);
+    int succ_num = 0;
+    if(replicated) {
+      succ_num = CNSendReplicas(blk_names, buf, blk_id2IP);
+      sent_blk_num += k * replica_num;
+    } else {
+      succ_num = CNSendStripe(string(stripe_name), blk_names, buf, send_id2IP, encode_job, wait_parity_num);
+      encode_time += engine->wait(encode_job);
+      engine->release(encode_job);
+      sent_blk_num += send_id2IP.size();
+    }
+    if(dn_parity) {
+      succ_num += encodeLocalParitiesOnDN(blk_names, blk_id2IP, gw_ip);
+    }
+    gettimeofday(&write_end, NULL);
+    write_time += write_end.tv_sec-write_start.tv_sec+(write_end.tv_usec-write_start.tv_usec)*1.0/1000000;
+    if(replicated) {
+      if(succ_num < k * replica_num) {
+        cout<<"write stripe "<<stripe_name<<" fail, "<<(k * replica_num - succ_num)<<" replicas not written!"<<endl;
+        all_stripe_succ_tag = -1;
+      }
+    } else if(succ_num < k + wait_parity_num) {
+      cout<<"write stripe "<<stripe_name<<" fail, "<<(stripe_len - succ_num)<<" blocks not written!"<<endl;
       all_stripe_succ_tag = -1;
+    } else if(succ_num < stripe_len) {
+        // !!! update stripe metadata, the stripe is acked early
+      meta->markStripeUnderRedundant(string(stripe_name));
+      early_acked_stripes.insert(string(stripe_name));
     }
+    reapPendingWrites(false);
       // !!! update stripe metadata
     meta->updateStripeBlks(string(stripe_name), blocks);
 
   } // end of stripe info
+  gettimeofday(&upload_end, NULL);
+    // complete the parity blocks written in the background
+  int lost_num = reapPendingWrites(true);
+  stopAckCollector();
+  if(lost_num > 0) {
+    cout<<"****** "<<lost_num<<" parity blocks not written, "<<meta->getUnderRedundantStripes().size()<<" stripes under-redundant"<<endl;
+  }
 
   if(all_stripe_succ_tag == 1) {
     cout<<"****** Finish uplode !"<<endl;
   } else {
     cout<<"****** Upload fail !"<<endl;
+  }
+  if(temp_stripe_num > 0) {
+      // encode throughput, in terms of the data bytes that are encoded
+    double encoded_mb = (double)temp_stripe_num * k * chunk_size / (1024 * 1024);
+    if(!replicated) {
+      fprintf(stderr, "****** parity encode (%d workers): %.2lf s, %.2lf MB/s\n", engine->workerNum(), encode_time, encode_time > 0 ? encoded_mb / encode_time : 0.0);
+    }
+    double upload_time = upload_end.tv_sec-upload_start.tv_sec+(upload_end.tv_usec-upload_start.tv_usec)*1.0/1000000;
+    fprintf(stderr, "****** upload: %.2lf s, %.2lf MB/s\n", upload_time, upload_time > 0 ? encoded_mb / upload_time : 0.0);
+    if(replicated) {
+      fprintf(stderr, "****** stripe write latency: %.3lf s on average, acked at %d data blocks x %d replicas\n", write_time / temp_stripe_num, k, replica_num);
+    } else {
+      fprintf(stderr, "****** stripe write latency: %.3lf s on average, acked at %d data + %d parity blocks\n", write_time / temp_stripe_num, k, wait_parity_num);
+    }
+    fprintf(stderr, "****** CN sent %d blocks, %.2lf x of the data, local parity blocks computed by the %s\n", sent_blk_num, (double)sent_blk_num / (temp_stripe_num * k), replicated ? "DNs later" : (dn_parity ? "DNs" : "CN"));
   }
     // !!! update file metadata
   meta->updateFileStripes(file, stripes);
   meta->updateFileHots(file);
+  meta->updateFileReplicated(file, replicated);
   
   delete stripe_name;
   delete blk_name;
-  for(int i = 0; i < k + l_f; ++i) {
-    delete buf[i];
-  }
-  delete buf;
-  if(fp2 != NULL) {
-    fclose(fp2);
-  }
-  for(int i = 0; i < k + l_f; ++i){
-    delete acks[i];
+  for(int s = 0; s < 2; ++s) {
+    for(int i = k; i < stripe_len; ++i) {
+      delete[] buf_sets[s][i];
+    }
+    delete[] buf_sets[s];
   }
-  delete acks;
-  delete ack_lens;
+  delete[] buf_sets;
+  delete[] encode_jobs;
+  munmap(ingest_map, ingest_len);
+  close(ingest_fd);
+  ingest_map = NULL;
+  ingest_fd = -1;
+  ingest_len = 0;
 }
 
-  // decide the stripe's blocks' locations
-  // main function for cluster-aware placement
-map<int, string> Coordinator::decide_location() {
-  map<int, string> blk_id2IP;
-
-  set<string> racks = meta->getRacks();
-  int rack_num = racks.size();
-  string temp_racks[rack_num];
-  int* dn_num_each_rack = new int[rack_num];
-  set<string> dns;
-  dns.clear();
-  set<string>::const_iterator racksIter;
-  int idx = 0;
-  for(racksIter = racks.begin(); racksIter != racks.end(); ++racksIter) {
-    temp_racks[idx] = *racksIter;
-    dns = meta->getRack2DN(temp_racks[idx]);
-    dn_num_each_rack[idx] = dns.size();
-    idx++;
+  // read a file into ./output: the data blocks of read_window stripes are
+  // requested at once, without checking them first, and are placed by their
+  // tags as they arrive, i.e., received straight into ./output (mapped) at
+  // their final offsets. A DN is asked for its blocks in stripe order, and the
+  // window slides as soon as its first stripe is complete.
+  // A missing data block is read degraded: the partial sums of its helpers
+  // are streamed to the CN and summed up in its place, and the block is queued
+  // for a durable repair (repairQueuedBlocks) instead of being written back.
+  // A block that is late, i.e., not arrived within the hedge_percentile-th
+  // percentile of the block latencies seen so far, is rebuilt the same way
+  // (hedged), avoiding the other late blocks of its stripe, and the first of
+  // the block and its rebuild is taken
+double Coordinator::readFile(string file) {
+  set<string> stripes = meta->getFile2Stripes(file);
+  int stripe_num = stripes.size();
+  if(stripe_num == 0) {
+    cout<<"file [ "<<file<<" ] not exist"<<endl;
+    return 0.0;
   }
+  size_t stripe_size = (size_t)k * chunk_size;
+  char* out = mapOutput(stripe_num * stripe_size);
+  if(out == NULL) {
+    cout<<"open file error!"<<endl;
+    return 0.0;
+  }
+  // a missing block is rebuilt from the parity blocks, patched first
+  set<string> unflushed = flushBeforeRebuild(stripes);
+  int window = (read_window < stripe_num) ? read_window : stripe_num;
+  bool hot_tag = meta->isFileHot(file);
+  int stripe_len = hot_tag ? k + l_f + g : k + l_c + g;
 
-  int delta = l_f / l_c;
-  int r_f = k / l_f;
-  int r_c = k / l_c;
-
-  // sort the racks according to the number of dns in each rack
-  for(int i = 0; i < rack_num - 1; ++i) {
-    for(int j = rack_num - 1; j > i; --j) {
-      if(dn_num_each_rack[j] > dn_num_each_rack[j-1]) {
-        int temp = dn_num_each_rack[j];
-        dn_num_each_rack[j] = dn_num_each_rack[j-1];
-        dn_num_each_rack[j-1] = temp;
-        string str = temp_racks[j];
-        temp_racks[j] = temp_racks[j - 1];
-        temp_racks[j - 1] = str;
+    // block -> (stripe index, data block id), and the requests of each DN
+  map<string, pair<int, int>> blk2slot;
+  map<string, vector<pair<int, string>>> ip2reqs;
+  vector<string> stripe_names;
+  vector<vector<string>> stripe_blks(stripe_num, vector<string>(stripe_len));
+  vector<vector<string>> stripe_IPs(stripe_num, vector<string>(stripe_len));
+  int stripe_idx = 0;
+  set<string>::const_iterator stripesIter;
+  for(stripesIter = stripes.begin(); stripesIter != stripes.end(); ++stripesIter, ++stripe_idx) {
+    stripe_names.push_back(*stripesIter);
+    set<pair<unsigned int, string>> tmpBlocks = meta->getStripe2Blocks(*stripesIter);
+    set<pair<unsigned int, string>>::const_iterator tmpBlocksIter;
+    for(tmpBlocksIter = tmpBlocks.begin(); tmpBlocksIter != tmpBlocks.end(); ++tmpBlocksIter) {
+      int blk_id = (*tmpBlocksIter).first;
+      string blk = (*tmpBlocksIter).second;
+      stripe_blks[stripe_idx][blk_id] = blk;
+      stripe_IPs[stripe_idx][blk_id] = meta->getBlock2IP(blk);
+      if(blk_id >= k) {
+        continue;
       }
+      blk2slot[blk] = make_pair(stripe_idx, blk_id);
+      ip2reqs[stripe_IPs[stripe_idx][blk_id]].push_back(make_pair(stripe_idx, blk));
     }
   }
 
-  if(place_method == OPT_S) {
-    for(int i = 0; i < l_c; ++i) {
-      string core_rack = temp_racks[i];
-      dns = meta->getRack2DN(core_rack);
-      int dn_num = dns.size();
-      string temp_dns[dn_num];
-      int index = 0;
-      set<string>::const_iterator dnsIter;
-      for(dnsIter = dns.begin(); dnsIter != dns.end(); ++dnsIter) {
-        temp_dns[index++] = *dnsIter;
+  vector<int> recv_num(stripe_num, 0);
+  vector<int> missing_num(stripe_num, 0);
+  mutex read_lock;
+  condition_variable read_cv;
+  int next_write = 0;
+  int claimed = 0;
+  int total = stripe_num * k;
+
+    // a block is waited, being received, or done (received or rebuilt)
+  enum {BLK_WAITING, BLK_RECEIVING, BLK_DONE};
+  map<string, int> blk_state;
+    // issue time of the requests, and the requests not answered yet
+  map<string, double> issue_time;
+  set<string> outstanding;
+    // latencies of the blocks sent by the DNs, and of the blocks taken by the read
+  vector<double> dn_latencies;
+  map<string, vector<double>> ip2latencies;
+  vector<double> blk_latencies;
+    // rebuilds in progress, i.e., the sum so far and the partial sums still to come
+  map<string, char*> rebuild_bufs;
+  map<string, int> pending_partials;
+  set<string> missing_blks;
+  set<string> hedged_blks;
+  int hedge_win_num = 0;
+  vector<thread> degrade_thrds;
+    // the partial sums read from the caches of their aggregators
+  map<long, PartialFallback> fallbacks;
+  long hit_base = partial_hit_num;
+  long miss_base = partial_miss_num;
+
+  struct timeval read_start, read_end;
+  gettimeofday(&read_start, NULL);
+  auto elapsed = [&]() -> double {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec-read_start.tv_sec+(now.tv_usec-read_start.tv_usec)*1.0/1000000;
+  };
+    // start rebuilding a block without the blocks in avoid, with read_lock held
+  auto startRebuild = [&](string blk, set<int> avoid) -> bool {
+    pair<int, int> slot = blk2slot[blk];
+    if(unflushed.find(stripe_names[slot.first]) != unflushed.end()) {
+      return false;
+    }
+    vector<int> erased;
+    erased.push_back(slot.second);
+    for(set<int>::const_iterator it = avoid.begin(); it != avoid.end(); ++it) {
+      if(*it != slot.second) {
+        erased.push_back(*it);
       }
-      index = 0;
-      for(int blk_id = i*r_c; blk_id < i*r_c + r_f; ++blk_id) {
-        if(dn_num == 1) {
-          blk_id2IP.insert(pair<int, string>(blk_id, temp_dns[0]));
-        } else {
-          blk_id2IP.insert(pair<int, string>(blk_id, temp_dns[index++]));
-        }
+    }
+    int* group_of = new int[k];
+    for(int i = 0; i < k; ++i) {
+      group_of[i] = layout->groupOf(i, hot_tag);
+    }
+    vector<Equation> equations;
+    bool recoverable = ec->solveErasures(hot_tag ? l_f : l_c, group_of, erased, equations);
+    delete[] group_of;
+    if(!recoverable) {
+      return false;
+    }
+    int partial_num = 0;
+    map<string, string> cmds = generateDegradedReadCmds(&stripe_blks[slot.first][0], &stripe_IPs[slot.first][0], slot.second, equations[0], partial_num, &fallbacks);
+    cout<<"~~~~~~ rebuild "<<blk<<" from "<<equations[0].size()<<" blocks, "<<partial_num<<" partial sums"<<endl;
+    rebuild_bufs[blk] = new char[chunk_size];
+    memset(rebuild_bufs[blk], 0, chunk_size);
+    pending_partials[blk] = partial_num;
+    total += partial_num;
+      // the commands are sent aside, as the helpers may be busy sending blocks
+    degrade_thrds.push_back(thread([=]{
+      map<string, string>::const_iterator cmdsIter;
+      for(cmdsIter = cmds.begin(); cmdsIter != cmds.end(); ++cmdsIter) {
+        this->sendCmd(cmdsIter->second, cmdsIter->first);
+        cout<<"~~~~~~ send cmd to "<<cmdsIter->first<<" :"<<cmdsIter->second<<endl;
       }
-      for(int lp = i*delta; lp < i*delta + delta; ++lp) {
-        int temp_lp = lp + k;
-        if(dn_num == 1) {
-          blk_id2IP.insert(pair<int, string>(temp_lp, temp_dns[0]));
-        } else {
-          blk_id2IP.insert(pair<int, string>(temp_lp, temp_dns[index++]));
-        }
+    }));
+    return true;
+  };
+    // the missing and late blocks of a stripe, with read_lock held
+  auto avoidedBlocks = [&](int s, double deadline) -> set<int> {
+    set<int> avoid;
+    double now = elapsed();
+    for(int i = 0; i < k; ++i) {
+      string blk = stripe_blks[s][i];
+      if(missing_blks.find(blk) != missing_blks.end()) {
+        avoid.insert(i);
+      } else if(deadline > 0 && outstanding.find(blk) != outstanding.end() && now - issue_time[blk] > deadline) {
+        avoid.insert(i);
       }
-      for(int j = 0; j < delta - 1; ++j) {
-        string a_different_rack = temp_racks[l_c + i*(delta-1) + j];
-        dns = meta->getRack2DN(a_different_rack);
-        dn_num = dns.size();
-        string temptemp_dns[dn_num];
-        index = 0;
-        for(dnsIter = dns.begin(); dnsIter != dns.end(); ++dnsIter) {
-          temptemp_dns[index++] = *dnsIter;
-        }
+    }
+    return avoid;
+  };
+    // take a block, with read_lock held
+  auto finishBlock = [&](string blk) {
+    pair<int, int> slot = blk2slot[blk];
+    blk_state[blk] = BLK_DONE;
+    outstanding.erase(blk);
+    blk_latencies.push_back(elapsed() - issue_time[blk]);
+    recv_num[slot.first]++;
+    read_cv.notify_all();
+  };
+
+  int listener = cn2dnSoc->initListener(CN_READ_DATA_PORT);
+
+    // receivers, each takes one tagged block at a time
+  vector<thread> recv_thrds;
+  for(int t = 0; t < k; ++t) {
+    recv_thrds.push_back(thread([&]{
+      char tag[DATA_TAG_LEN + 1];
+      while(true) {
+        {
+          unique_lock<mutex> lk(read_lock);
+          if(claimed == total) {
+            return;
+          }
+          claimed++;
+        }
+        int connfd = cn2dnSoc->acceptTagged(listener, tag);
+        string blk = string(tag, DATA_TAG_LEN - 2);
+        string status = string(tag + DATA_TAG_LEN - 2);
+        pair<int, int> slot = blk2slot[blk];
+        char* dst = out + slot.first * stripe_size + (size_t)slot.second * chunk_size;
+        if(status == "ok") {
+          int state;
+          {
+            unique_lock<mutex> lk(read_lock);
+            state = blk_state[blk];
+            if(state != BLK_DONE) {
+              blk_state[blk] = BLK_RECEIVING;
+            }
+          }
+          if(state == BLK_DONE) {
+            // late, the block is already rebuilt
+            char* scratch = new char[chunk_size];
+            cn2dnSoc->recvTaggedData(connfd, scratch, chunk_size, packet_size);
+            delete[] scratch;
+          } else {
+            cn2dnSoc->recvTaggedData(connfd, dst, chunk_size, packet_size);
+          }
+          unique_lock<mutex> lk(read_lock);
+          double latency = elapsed() - issue_time[blk];
+          dn_latencies.push_back(latency);
+          ip2latencies[stripe_IPs[slot.first][slot.second]].push_back(latency);
+          if(state != BLK_DONE) {
+            finishBlock(blk);
+          }
+        } else if(status == "ps") {
+          // a partial sum of a rebuilt block
+          char* partial = new char[chunk_size];
+          cn2dnSoc->recvTaggedData(connfd, partial, chunk_size, packet_size);
+          unique_lock<mutex> lk(read_lock);
+          if(rebuild_bufs.find(blk) != rebuild_bufs.end()) {
+            ErasureCode::xorRegion(partial, rebuild_bufs[blk], chunk_size);
+            if(--pending_partials[blk] == 0) {
+              if(blk_state[blk] == BLK_WAITING) {
+                memcpy(dst, rebuild_bufs[blk], chunk_size);
+                if(hedged_blks.find(blk) != hedged_blks.end()) {
+                  hedge_win_num++;
+                }
+                finishBlock(blk);
+              }
+              delete[] rebuild_bufs[blk];
+              rebuild_bufs.erase(blk);
+            }
+          }
+          delete[] partial;
+        } else if(status == "pm") {
+          // a partial sum no longer cached, e.g., its aggregator restarted, is computed
+          char id_field[PARTIAL_ID_LEN + 1];
+          cn2dnSoc->recvTaggedData(connfd, id_field, PARTIAL_ID_LEN, packet_size);
+          id_field[PARTIAL_ID_LEN] = '\0';
+          long id = strtol(id_field, NULL, 10);
+          unique_lock<mutex> lk(read_lock);
+          map<long, PartialFallback>::iterator fallbackIter = fallbacks.find(id);
+          if(fallbackIter == fallbacks.end()) {
+            cout<<"WARNING: partial sum "<<id<<" of "<<blk<<" lost"<<endl;
+            continue;
+          }
+          partial_mirrors[fallbackIter->second.ip]->clear();
+          total++;
+          map<string, string> cmds = fallbackIter->second.cmds;
+          fallbacks.erase(fallbackIter);
+          degrade_thrds.push_back(thread([=]{
+            map<string, string>::const_iterator cmdsIter;
+            for(cmdsIter = cmds.begin(); cmdsIter != cmds.end(); ++cmdsIter) {
+              this->sendCmd(cmdsIter->second, cmdsIter->first);
+              cout<<"~~~~~~ send cmd to "<<cmdsIter->first<<" :"<<cmdsIter->second<<endl;
+            }
+          }));
+        } else {
+          // missing, rebuild it unless a hedged rebuild is in progress
+          cn2dnSoc->recvTaggedData(connfd, NULL, 0, packet_size);
+          unique_lock<mutex> lk(read_lock);
+          missing_blks.insert(blk);
+          missing_num[slot.first]++;
+          if(rebuild_bufs.find(blk) == rebuild_bufs.end() && blk_state[blk] == BLK_WAITING) {
+            if(!startRebuild(blk, avoidedBlocks(slot.first, 0))) {
+              cout<<"WARNING: cannot rebuild "<<blk<<", written as zeros"<<endl;
+              memset(dst, 0, chunk_size);
+              finishBlock(blk);
+            }
+          }
+        }
+      }
+    }));
+  }
+
+    // issuers, one per DN, a stripe is requested once it enters the window
+  vector<thread> issue_thrds;
+  for(map<string, vector<pair<int, string>>>::const_iterator it = ip2reqs.begin(); it != ip2reqs.end(); ++it) {
+    string ip = (*it).first;
+    vector<pair<int, string>> reqs = (*it).second;
+    issue_thrds.push_back(thread([&, ip, reqs]{
+      for(size_t i = 0; i < reqs.size(); ++i) {
+        {
+          unique_lock<mutex> lk(read_lock);
+          read_cv.wait(lk, [&]{return reqs[i].first < next_write + window;});
+          issue_time[reqs[i].second] = elapsed();
+        }
+        sendCmd("rd" + reqs[i].second, ip);
+          // the DN takes a command once done with the previous ones,
+          // so that the latency is counted from here
+        unique_lock<mutex> lk(read_lock);
+        if(blk_state[reqs[i].second] == BLK_WAITING) {
+          issue_time[reqs[i].second] = elapsed();
+          outstanding.insert(reqs[i].second);
+        }
+      }
+    }));
+  }
+
+    // hedger, checks the outstanding requests against the deadline
+  thread hedge_thrd;
+  if(hedge_percentile > 0) {
+    hedge_thrd = thread([&]{
+      unique_lock<mutex> lk(read_lock);
+      while(!read_cv.wait_for(lk, chrono::milliseconds(HEDGE_CHECK_INTERVAL), [&]{return next_write == stripe_num;})) {
+        if((int)dn_latencies.size() < HEDGE_MIN_SAMPLES) {
+          continue;
+        }
+        vector<double> sorted = dn_latencies;
+        size_t pos = (sorted.size() - 1) * hedge_percentile / 100;
+        nth_element(sorted.begin(), sorted.begin() + pos, sorted.end());
+        double deadline = sorted[pos];
+        double now = elapsed();
+        vector<string> late;
+        for(set<string>::const_iterator it = outstanding.begin(); it != outstanding.end(); ++it) {
+          if(blk_state[*it] == BLK_WAITING && now - issue_time[*it] > deadline && hedged_blks.find(*it) == hedged_blks.end() && rebuild_bufs.find(*it) == rebuild_bufs.end()) {
+            late.push_back(*it);
+          }
+        }
+        for(size_t i = 0; i < late.size(); ++i) {
+          cout<<"~~~~~~ "<<late[i]<<" is late ("<<(now - issue_time[late[i]])<<" s > "<<deadline<<" s), hedge it"<<endl;
+            // a block is hedged at most once, even if it cannot be rebuilt
+          hedged_blks.insert(late[i]);
+          startRebuild(late[i], avoidedBlocks(blk2slot[late[i]].first, deadline));
+        }
+      }
+    });
+  }
+
+    // the window slides in stripe order, the blocks are already in ./output
+  int missing_blk_num = 0;
+  for(int s = 0; s < stripe_num; ++s) {
+    unique_lock<mutex> lk(read_lock);
+    read_cv.wait(lk, [&]{return recv_num[s] == k;});
+    missing_blk_num += missing_num[s];
+    next_write++;
+    read_cv.notify_all();
+  }
+  gettimeofday(&read_end, NULL);
+
+    // the late blocks and partial sums are drained
+  if(hedge_percentile > 0) {
+    hedge_thrd.join();
+  }
+  for(size_t i = 0; i < issue_thrds.size(); ++i) {
+    issue_thrds[i].join();
+  }
+  for(size_t i = 0; i < recv_thrds.size(); ++i) {
+    recv_thrds[i].join();
+  }
+  for(size_t i = 0; i < degrade_thrds.size(); ++i) {
+    degrade_thrds[i].join();
+  }
+  cn2dnSoc->closeListener(listener);
+  map<string, char*>::const_iterator rebuildIter;
+  for(rebuildIter = rebuild_bufs.begin(); rebuildIter != rebuild_bufs.end(); ++rebuildIter) {
+    delete[] rebuildIter->second;
+  }
+
+    // !!! update stripe metadata, and queue the durable repairs
+  set<string>::const_iterator missingIter;
+  for(missingIter = missing_blks.begin(); missingIter != missing_blks.end(); ++missingIter) {
+    string stripe = stripe_names[blk2slot[*missingIter].first];
+    meta->markStripeUnderRedundant(stripe);
+    repairs->push(stripe, meta->getBlockIndexInStripe(*missingIter), meta->isFileHot(meta->getStripe2File(stripe)), false);
+  }
+  munmap(out, stripe_num * stripe_size);
+
+  double read_time = read_end.tv_sec-read_start.tv_sec+(read_end.tv_usec-read_start.tv_usec)*1.0/1000000;
+  double read_mb = (double)stripe_num * k * chunk_size / (1024 * 1024);
+  cout<<"****** Finish read !"<<endl;
+  map<string, vector<double>>::const_iterator latIter;
+  for(latIter = ip2latencies.begin(); latIter != ip2latencies.end(); ++latIter) {
+    double sum = 0.0;
+    for(size_t i = 0; i < latIter->second.size(); ++i) {
+      sum += latIter->second[i];
+    }
+    cout<<"DN "<<latIter->first<<": "<<latIter->second.size()<<" blocks, "<<sum / latIter->second.size()<<" s on average"<<endl;
+  }
+  sort(blk_latencies.begin(), blk_latencies.end());
+  fprintf(stderr, "****** read (window %d stripes): %.2lf s, %.2lf MB/s, %d degraded blocks, %d blocks queued for repair\n", window, read_time, read_time > 0 ? read_mb / read_time : 0.0, missing_blk_num, repairs->blockNum());
+  if(partial_hit_num + partial_miss_num > hit_base + miss_base) {
+    fprintf(stderr, "****** partial sums: %ld read from the caches of the aggregators, %ld computed\n", partial_hit_num - hit_base, partial_miss_num - miss_base);
+  }
+  if(!blk_latencies.empty()) {
+    size_t n = blk_latencies.size();
+    fprintf(stderr, "****** block latency: p50 %.3lf s, p99 %.3lf s, p999 %.3lf s, %d hedged (%d won)\n", blk_latencies[(n - 1) * 50 / 100], blk_latencies[(n - 1) * 99 / 100], blk_latencies[(n - 1) * 999 / 1000], (int)hedged_blks.size(), hedge_win_num);
+  }
+  return read_time;
+}
+
+  // read length bytes of a file from offset into ./output, fetching only the
+  // packets of the data blocks that the range covers ("rr"). A missing data
+  // block is read degraded over the same packets only ("mr"), i.e., each helper
+  // reads and multiplies the packets of its blocks, and the partial sums are
+  // summed up on the CN; the block is queued for a durable repair
+double Coordinator::readRange(string file, size_t offset, size_t length) {
+  set<string> stripes = meta->getFile2Stripes(file);
+  size_t stripe_size = (size_t)k * chunk_size;
+  size_t file_size = stripes.size() * stripe_size;
+  if(stripes.empty() || offset >= file_size || length == 0) {
+    cout<<"range [ "<<offset<<", +"<<length<<" ) out of file [ "<<file<<" ]"<<endl;
+    return 0.0;
+  }
+  if(length > file_size - offset) {
+    length = file_size - offset;
+  }
+  // a missing block is rebuilt from the parity blocks, patched first
+  set<string> unflushed = flushBeforeRebuild(stripes);
+  bool hot_tag = meta->isFileHot(file);
+  int stripe_len = hot_tag ? k + l_f + g : k + l_c + g;
+  size_t first_stripe = offset / stripe_size;
+  size_t last_stripe = (offset + length - 1) / stripe_size;
+
+    // the packets to fetch of each block, and where the requested bytes go
+  struct RangeReq {
+    int stripe_idx;
+    int data_id;
+    size_t pkt_offset;
+    size_t pkt_len;
+    size_t skip; // from the first packet to the requested bytes
+    size_t len;
+    size_t out_offset;
+  };
+  map<string, RangeReq> blk2req;
+  map<string, vector<string>> ip2blks;
+  vector<vector<string>> stripe_blks;
+  vector<vector<string>> stripe_IPs;
+  size_t stripe_idx = 0;
+  set<string>::const_iterator stripesIter;
+  for(stripesIter = stripes.begin(); stripesIter != stripes.end() && stripe_idx <= last_stripe; ++stripesIter, ++stripe_idx) {
+    if(stripe_idx < first_stripe) {
+      continue;
+    }
+    int s = stripe_blks.size();
+    stripe_blks.push_back(vector<string>(stripe_len));
+    stripe_IPs.push_back(vector<string>(stripe_len));
+    set<pair<unsigned int, string>> tmpBlocks = meta->getStripe2Blocks(*stripesIter);
+    set<pair<unsigned int, string>>::const_iterator tmpBlocksIter;
+    for(tmpBlocksIter = tmpBlocks.begin(); tmpBlocksIter != tmpBlocks.end(); ++tmpBlocksIter) {
+      stripe_blks[s][(*tmpBlocksIter).first] = (*tmpBlocksIter).second;
+      stripe_IPs[s][(*tmpBlocksIter).first] = meta->getBlock2IP((*tmpBlocksIter).second);
+    }
+    for(int i = 0; i < k; ++i) {
+      size_t blk_start = stripe_idx * stripe_size + (size_t)i * chunk_size;
+      size_t lo = (offset > blk_start) ? offset - blk_start : 0;
+      size_t hi = (offset + length < blk_start + chunk_size) ? offset + length - blk_start : chunk_size;
+      if(offset + length <= blk_start || lo >= hi) {
+        continue;
+      }
+      RangeReq req;
+      req.stripe_idx = s;
+      req.data_id = i;
+      req.pkt_offset = lo / packet_size * packet_size;
+      size_t pkt_end = (hi + packet_size - 1) / packet_size * packet_size;
+      req.pkt_len = ((pkt_end < (size_t)chunk_size) ? pkt_end : chunk_size) - req.pkt_offset;
+      req.skip = lo - req.pkt_offset;
+      req.len = hi - lo;
+      req.out_offset = blk_start + lo - offset;
+      blk2req[stripe_blks[s][i]] = req;
+      ip2blks[stripe_IPs[s][i]].push_back(stripe_blks[s][i]);
+    }
+  }
+  auto rangeFields = [](size_t pkt_offset, size_t pkt_len) -> string {
+    char fields[2 * RANGE_FIELD_LEN + 1];
+    sprintf(fields, "%010zu%010zu", pkt_offset, pkt_len);
+    return string(fields);
+  };
+
+  char* out = new char[length];
+  int listener = cn2dnSoc->initListener(CN_READ_DATA_PORT);
+  struct timeval read_start, read_end;
+  gettimeofday(&read_start, NULL);
+
+    // issuers, one per DN
+  vector<thread> issue_thrds;
+  for(map<string, vector<string>>::const_iterator it = ip2blks.begin(); it != ip2blks.end(); ++it) {
+    string ip = (*it).first;
+    vector<string> blks = (*it).second;
+    issue_thrds.push_back(thread([&, ip, blks]{
+      for(size_t i = 0; i < blks.size(); ++i) {
+        RangeReq req = blk2req[blks[i]];
+        sendCmd("rr" + blks[i] + rangeFields(req.pkt_offset, req.pkt_len), ip);
+      }
+    }));
+  }
+
+    // receive the packets, and the partial sums of the missing blocks
+  int expected = blk2req.size();
+  size_t transferred = 0;
+  map<string, char*> rebuild_bufs;
+  map<string, int> pending_partials;
+  set<string> missing_blks;
+  vector<thread> degrade_thrds;
+  char tag[DATA_TAG_LEN + 1];
+  for(int received = 0; received < expected; ++received) {
+    int connfd = cn2dnSoc->acceptTagged(listener, tag);
+    string blk = string(tag, DATA_TAG_LEN - 2);
+    string status = string(tag + DATA_TAG_LEN - 2);
+    RangeReq req = blk2req[blk];
+    if(status == "ok" || status == "ps") {
+      char* buf = new char[req.pkt_len];
+      cn2dnSoc->recvTaggedData(connfd, buf, req.pkt_len, packet_size);
+      transferred += req.pkt_len;
+      if(status == "ok") {
+        memcpy(out + req.out_offset, buf + req.skip, req.len);
+      } else if(rebuild_bufs.find(blk) != rebuild_bufs.end()) {
+        ErasureCode::xorRegion(buf, rebuild_bufs[blk], req.pkt_len);
+        if(--pending_partials[blk] == 0) {
+          memcpy(out + req.out_offset, rebuild_bufs[blk] + req.skip, req.len);
+          delete[] rebuild_bufs[blk];
+          rebuild_bufs.erase(blk);
+        }
+      }
+      delete[] buf;
+      continue;
+    }
+    // missing, rebuild its packets without the other missing blocks of the stripe
+    cn2dnSoc->recvTaggedData(connfd, NULL, 0, packet_size);
+    missing_blks.insert(blk);
+    vector<int> erased;
+    erased.push_back(req.data_id);
+    for(int i = 0; i < k; ++i) {
+      if(i != req.data_id && missing_blks.find(stripe_blks[req.stripe_idx][i]) != missing_blks.end()) {
+        erased.push_back(i);
+      }
+    }
+    int* group_of = new int[k];
+    for(int i = 0; i < k; ++i) {
+      group_of[i] = layout->groupOf(i, hot_tag);
+    }
+    vector<Equation> equations;
+    bool recoverable = ec->solveErasures(hot_tag ? l_f : l_c, group_of, erased, equations);
+    delete[] group_of;
+    recoverable = recoverable && unflushed.find(meta->getBlock2Stripe(blk)) == unflushed.end();
+    if(!recoverable) {
+      cout<<"WARNING: cannot rebuild "<<blk<<", read as zeros"<<endl;
+      memset(out + req.out_offset, 0, req.len);
+      continue;
+    }
+    int partial_num = 0;
+    map<string, string> cmds = generateDegradedReadCmds(&stripe_blks[req.stripe_idx][0], &stripe_IPs[req.stripe_idx][0], req.data_id, equations[0], partial_num, NULL);
+    rebuild_bufs[blk] = new char[req.pkt_len];
+    memset(rebuild_bufs[blk], 0, req.pkt_len);
+    pending_partials[blk] = partial_num;
+    expected += partial_num;
+    string range = rangeFields(req.pkt_offset, req.pkt_len);
+      // the commands are sent aside, as the helpers may be busy sending packets
+    degrade_thrds.push_back(thread([=]{
+      map<string, string>::const_iterator cmdsIter;
+      for(cmdsIter = cmds.begin(); cmdsIter != cmds.end(); ++cmdsIter) {
+        this->sendCmd("mr" + range + cmdsIter->second, cmdsIter->first);
+        cout<<"~~~~~~ send cmd to "<<cmdsIter->first<<" :mr"<<range<<cmdsIter->second<<endl;
+      }
+    }));
+  }
+  gettimeofday(&read_end, NULL);
+  for(size_t i = 0; i < issue_thrds.size(); ++i) {
+    issue_thrds[i].join();
+  }
+  for(size_t i = 0; i < degrade_thrds.size(); ++i) {
+    degrade_thrds[i].join();
+  }
+  cn2dnSoc->closeListener(listener);
+
+  FILE* fp = fopen("./output", "w");
+  if(fp != NULL) {
+    fwrite(out, 1, length, fp);
+    fclose(fp);
+  } else {
+    cout<<"open file error!"<<endl;
+  }
+  delete[] out;
+
+    // !!! update stripe metadata, and queue the durable repairs
+  set<string>::const_iterator missingIter;
+  for(missingIter = missing_blks.begin(); missingIter != missing_blks.end(); ++missingIter) {
+    string stripe = meta->getBlock2Stripe(*missingIter);
+    meta->markStripeUnderRedundant(stripe);
+    repairs->push(stripe, meta->getBlockIndexInStripe(*missingIter), meta->isFileHot(meta->getStripe2File(stripe)), false);
+  }
+
+  double read_time = read_end.tv_sec-read_start.tv_sec+(read_end.tv_usec-read_start.tv_usec)*1.0/1000000;
+  cout<<"****** Finish range read !"<<endl;
+  fprintf(stderr, "****** range read [%zu, +%zu): %.4lf s, %zu blocks, %zu bytes transferred, %d degraded blocks\n", offset, length, read_time, blk2req.size(), transferred, (int)missing_blks.size());
+  return read_time;
+}
+
+  // encode a replicated file into the fast code, stripe by stripe, without the
+  // data going through the CN: a fast local parity block is computed by its
+  // node from the replicas of its local group, a global parity block from the
+  // data blocks summed up within each rack (and its own replicas). The replicas
+  // of a stripe are deleted once all its parity blocks are written and read
+  // back to the CN to be checked against its data blocks
+double Coordinator::encodeReplicatedFile(string file) {
+  if(!meta->isFileReplicated(file)) {
+    cout<<"file [ "<<file<<" ] is not replicated, nothing to encode"<<endl;
+    return 0.0;
+  }
+  int stripe_len = k + l_f + g;
+  string gw_ip = meta->getGW();
+  set<string> stripes = meta->getFile2Stripes(file);
+  bool all_stripe_succ = true;
+  struct timeval encode_start, encode_end;
+  gettimeofday(&encode_start, NULL);
+  set<string>::const_iterator stripesIter;
+  for(stripesIter = stripes.begin(); stripesIter != stripes.end(); ++stripesIter) {
+    vector<string> names(stripe_len);
+    vector<string> IPs(stripe_len);
+    map<int, string> blk_id2IP;
+    set<pair<unsigned int, string>> tmpBlocks = meta->getStripe2Blocks(*stripesIter);
+    set<pair<unsigned int, string>>::const_iterator tmpBlocksIter;
+    for(tmpBlocksIter = tmpBlocks.begin(); tmpBlocksIter != tmpBlocks.end(); ++tmpBlocksIter) {
+      int blk_id = (*tmpBlocksIter).first;
+      names[blk_id] = (*tmpBlocksIter).second;
+      IPs[blk_id] = meta->getBlock2IP(names[blk_id]);
+      blk_id2IP[blk_id] = IPs[blk_id];
+    }
+
+    vector<int> parity_ids;
+    vector<Equation> equations;
+    vector<vector<string>> parity_names;
+    vector<vector<string>> parity_IPs;
+      // fast local parity blocks, from the 1st replicas
+    for(int group_id = 0; group_id < l_f; ++group_id) {
+      Equation equation;
+      vector<string> tmp_names = names;
+      vector<string> tmp_IPs = IPs;
+      for(int i = layout->fastGroupStart(group_id); i < layout->fastGroupStart(group_id) + layout->fastGroupSize(group_id); ++i) {
+        equation.push_back(make_pair(i, (unsigned char)1));
+        tmp_names[i] = replicaName(names[i], 1);
+        tmp_IPs[i] = replicaIP(i, 1, blk_id2IP);
+      }
+      parity_ids.push_back(k + group_id);
+      equations.push_back(equation);
+      parity_names.push_back(tmp_names);
+      parity_IPs.push_back(tmp_IPs);
+    }
+      // global parity blocks, from the data blocks and the 2nd replicas
+    for(int global_id = 0; global_id < g; ++global_id) {
+      Equation equation;
+      vector<string> tmp_names = names;
+      vector<string> tmp_IPs = IPs;
+      for(int i = 0; i < k; ++i) {
+        equation.push_back(make_pair(i, ec->getGlobalCoef(global_id, i)));
+        if(replica_num == 3 && i % g == global_id) {
+          tmp_names[i] = replicaName(names[i], 2);
+          tmp_IPs[i] = replicaIP(i, 2, blk_id2IP);
+        }
+      }
+      parity_ids.push_back(k + l_f + global_id);
+      equations.push_back(equation);
+      parity_names.push_back(tmp_names);
+      parity_IPs.push_back(tmp_IPs);
+    }
+
+    int succ_num = encodeParitiesOnDN(parity_ids, equations, parity_names, parity_IPs, gw_ip, NULL);
+    if(succ_num != l_f + g) {
+      cout<<"encode stripe "<<*stripesIter<<" fail, "<<(l_f + g - succ_num)<<" parity blocks not written, replicas kept"<<endl;
+      all_stripe_succ = false;
+      continue;
+    }
+    if(!verifyParities(names, IPs, parity_ids, equations)) {
+      cout<<"encode stripe "<<*stripesIter<<" fail, parity blocks not verified, replicas kept"<<endl;
+      all_stripe_succ = false;
+      continue;
+    }
+    for(int i = 0; i < k; ++i) {
+      for(int replica = 1; replica < replica_num; ++replica) {
+        sendCmd("rm" + replicaName(names[i], replica), replicaIP(i, replica, blk_id2IP));
+      }
+    }
+  }
+  gettimeofday(&encode_end, NULL);
+  double encode_time = encode_end.tv_sec-encode_start.tv_sec+(encode_end.tv_usec-encode_start.tv_usec)*1.0/1000000;
+
+  if(all_stripe_succ) {
+      // !!! update file metadata
+    meta->updateFileReplicated(file, false);
+    cout<<"****** Finish encoding replicated file "<<file<<" !"<<endl;
+  } else {
+    cout<<"****** Encoding replicated file "<<file<<" fail !"<<endl;
+  }
+  fprintf(stderr, "****** encode replicas: %.2lf s\n", encode_time);
+  return encode_time;
+}
+
+  // decide the stripe's blocks' locations
+  // main function for cluster-aware placement
+map<int, string> Coordinator::decide_location() {
+  map<int, string> blk_id2IP;
+
+  set<string> racks = meta->getRacks();
+  int rack_num = racks.size();
+  string temp_racks[rack_num];
+  int* dn_num_each_rack = new int[rack_num];
+  set<string> dns;
+  dns.clear();
+  set<string>::const_iterator racksIter;
+  int idx = 0;
+  for(racksIter = racks.begin(); racksIter != racks.end(); ++racksIter) {
+    temp_racks[idx] = *racksIter;
+    dns = meta->getRack2DN(temp_racks[idx]);
+    dn_num_each_rack[idx] = dns.size();
+    idx++;
+  }
+
+  // sort the racks according to the number of dns in each rack
+  for(int i = 0; i < rack_num - 1; ++i) {
+    for(int j = rack_num - 1; j > i; --j) {
+      if(dn_num_each_rack[j] > dn_num_each_rack[j-1]) {
+        int temp = dn_num_each_rack[j];
+        dn_num_each_rack[j] = dn_num_each_rack[j-1];
+        dn_num_each_rack[j-1] = temp;
+        string str = temp_racks[j];
+        temp_racks[j] = temp_racks[j - 1];
+        temp_racks[j - 1] = str;
+      }
+    }
+  }
+
+  if(place_method == OPT_S) {
+    // compact group i occupies compactDelta(i) racks; the other (non-core)
+    // racks of the compact groups are taken in order after the l_c core racks
+    int next_rack = l_c;
+    for(int i = 0; i < l_c; ++i) {
+      int delta = layout->compactDelta(i);
+      int first_fast = layout->compactFirstFast(i);
+      string core_rack = temp_racks[i];
+      dns = meta->getRack2DN(core_rack);
+      int dn_num = dns.size();
+      string temp_dns[dn_num];
+      int index = 0;
+      set<string>::const_iterator dnsIter;
+      for(dnsIter = dns.begin(); dnsIter != dns.end(); ++dnsIter) {
+        temp_dns[index++] = *dnsIter;
+      }
+      index = 0;
+      int start = layout->fastGroupStart(first_fast);
+      for(int blk_id = start; blk_id < start + layout->fastGroupSize(first_fast); ++blk_id) {
+        if(dn_num == 1) {
+          blk_id2IP.insert(pair<int, string>(blk_id, temp_dns[0]));
+        } else {
+          blk_id2IP.insert(pair<int, string>(blk_id, temp_dns[index++]));
+        }
+      }
+      for(int lp = first_fast; lp < first_fast + delta; ++lp) {
+        int temp_lp = lp + k;
+        if(dn_num == 1) {
+          blk_id2IP.insert(pair<int, string>(temp_lp, temp_dns[0]));
+        } else {
+          blk_id2IP.insert(pair<int, string>(temp_lp, temp_dns[index++]));
+        }
+      }
+      for(int j = 0; j < delta - 1; ++j) {
+        string a_different_rack = temp_racks[next_rack++];
+        dns = meta->getRack2DN(a_different_rack);
+        dn_num = dns.size();
+        string temptemp_dns[dn_num];
+        index = 0;
+        for(dnsIter = dns.begin(); dnsIter != dns.end(); ++dnsIter) {
+          temptemp_dns[index++] = *dnsIter;
+        }
         index = 0;
-        for(int blk_id = i*r_c + (j+1)*r_f; blk_id < i*r_c + (j+2)*r_f; ++blk_id) {
+        start = layout->fastGroupStart(first_fast + j + 1);
+        for(int blk_id = start; blk_id < start + layout->fastGroupSize(first_fast + j + 1); ++blk_id) {
           if(dn_num == 1) {
             blk_id2IP.insert(pair<int, string>(blk_id, temptemp_dns[0]));
           } else {
@@ -364,32 +1687,10 @@ map<int, string> Coordinator::decide_location() {
         }
       }
     } // end of outter for
-
-    /*
-    string gp_rack = temp_racks[l_c * delta];
-    dns = meta->getRack2DN(gp_rack);
-    int dn_num = dns.size();
-    string temp_dns[dn_num];
-    int index = 0;
-    set<string>::const_iterator dnsIter;
-    for(dnsIter = dns.begin(); dnsIter != dns.end(); ++dnsIter) {
-      temp_dns[index++] = *dnsIter;
-    }
-    index = 0;
-    for(int gpIdx = 0; gpIdx < g; ++gpIdx) {
-      int temp_gp = gpIdx + k + l_f;
-      if(dn_num == 1) {
-        blk_id2IP.insert(pair<int, string>(temp_gp, temp_dns[0]));
-      } else {
-        blk_id2IP.insert(pair<int, string>(temp_gp, temp_dns[index++]));
-      }
-    }
-    */ // Note: this part of code may be useful in future for placing global parity blocks
-
   } // end of if place_method == OPT_S
 
   if(place_method == OPT_R) {
-    for(int i = 0; i < l_c * delta; ++i) {
+    for(int i = 0; i < l_f; ++i) {
       string rack = temp_racks[i];
       dns = meta->getRack2DN(rack);
       int dn_num = dns.size();
@@ -400,8 +1701,9 @@ map<int, string> Coordinator::decide_location() {
         temp_dns[index++] = *dnsIter;
       }
       index = 0;
-      if(i < l_c * delta) {
-        for(int blk_id = i*r_f; blk_id < i*r_f + r_f; ++blk_id) {
+      if(i < l_f) {
+        int start = layout->fastGroupStart(i);
+        for(int blk_id = start; blk_id < start + layout->fastGroupSize(i); ++blk_id) {
           if(dn_num == 1) {
             blk_id2IP.insert(pair<int, string>(blk_id, temp_dns[0]));
           } else {
@@ -415,33 +1717,67 @@ map<int, string> Coordinator::decide_location() {
           blk_id2IP.insert(pair<int, string>(temp_lp, temp_dns[index++]));
         }
       }
-      /*
-      else {
-        for(int gpIdx = 0; gpIdx < g; ++gpIdx) {
-          int temp_gp = gpIdx + k + l_f;
-          if(dn_num == 1) {
-            blk_id2IP.insert(pair<int, string>(temp_gp, temp_dns[0]));
-          } else {
-            blk_id2IP.insert(pair<int, string>(temp_gp, temp_dns[index++]));          }
+    }
+  } // end of if place_method == OPT_R
+
+    // the node of a rack holding the fewest blocks placed so far, the first
+    // (or, backwards, the last) one on ties, so that the nodes already used
+    // are shared only when the rack has no free node left
+  auto placedNum = [&](string node) -> int {
+    int num = 0;
+    map<int, string>::const_iterator placedIter;
+    for(placedIter = blk_id2IP.begin(); placedIter != blk_id2IP.end(); ++placedIter) {
+      if(placedIter->second == node) {
+        num++;
+      }
+    }
+    return num;
+  };
+  auto leastUsedNode = [&](string rack, bool backwards) -> string {
+    set<string> rack_dns = meta->getRack2DN(rack);
+    vector<string> ordered(rack_dns.begin(), rack_dns.end());
+    if(backwards) {
+      reverse(ordered.begin(), ordered.end());
+    }
+    string node = ordered[0];
+    int node_num = placedNum(node);
+    for(size_t i = 1; i < ordered.size(); ++i) {
+      int num = placedNum(ordered[i]);
+      if(num < node_num) {
+        node = ordered[i];
+        node_num = num;
+      }
+    }
+    return node;
+  };
+
+  if(place_method == OPT_S || place_method == OPT_R) {
+    // in Opt-S and Opt-R, the local groups occupy l_f racks, and the g global 
+    // parity blocks are placed in the next rack. If there is no such rack, they 
+    // share the last (i.e., the smallest) rack, and are placed from its last node 
+    // backwards on the nodes that store no block yet; if the rack has none
+    // left, on a free node of another rack, and only if there is none at all,
+    // on the least used node of the rack
+    int gp_rack_idx = (l_f < rack_num) ? l_f : rack_num - 1;
+    string gp_rack = temp_racks[gp_rack_idx];
+    for(int gpIdx = 0; gpIdx < g; ++gpIdx) {
+      int temp_gp = gpIdx + k + l_f;
+      string node = leastUsedNode(gp_rack, true);
+      for(int r = rack_num - 1; r >= 0 && placedNum(node) != 0; --r) {
+        string other = leastUsedNode(temp_racks[r], true);
+        if(placedNum(other) == 0) {
+          node = other;
         }
       }
-      */ // Note: this part of code may be useful in future for placing global parity blocks
+      blk_id2IP.insert(pair<int, string>(temp_gp, node));
     }
-  } // end of if place_method == OPT_R
+  } // end of placing global parity blocks in Opt-S and Opt-R
 
   if(place_method == FLAT) {
-    for(int i = 0; i < k + l_f; ++i) {
-      string rack = temp_racks[i];
-      dns = meta->getRack2DN(rack);
-      int dn_num = dns.size();
-      string temp_dns[dn_num];
-      set<string>::const_iterator dnsIter;
-      int index = 0;
-      for(dnsIter = dns.begin(); dnsIter != dns.end(); ++dnsIter) {
-        temp_dns[index++] = *dnsIter;
-      }
-      index = 0;
-      blk_id2IP.insert(pair<int, string>(i, temp_dns[0]));
+    // in Flat, each block resides in a different rack, wrapping around the
+    // racks if there are not enough of them, on the least used node
+    for(int i = 0; i < k + l_f + g; ++i) {
+      blk_id2IP.insert(pair<int, string>(i, leastUsedNode(temp_racks[i % rack_num], false)));
     }
   } // end of if place_method == FLAT
 
@@ -466,6 +1802,8 @@ map<int, string> Coordinator::decide_location() {
    * * * * * * * * * * * * * * * * * * * */
 double Coordinator::downloadFile(string file, int sim_miss_id){
   double decode_time = 0.0;
+  // the parity blocks must reflect the pending overwrites
+  flushUpdates();
   set<string> stripes = meta->getFile2Stripes(file);
   string tmp_stripe;
   set<pair<unsigned int, string>> tmpBlocks;
@@ -475,12 +1813,13 @@ double Coordinator::downloadFile(string file, int sim_miss_id){
   int stripe_len;
   bool hot_tag = meta->isFileHot(file);
   if(hot_tag){
-    stripe_len = k + l_f; //k + l_f + g;
+    stripe_len = k + l_f + g;
   } else {
-    stripe_len = k + l_c; //k + l_c + g;
+    stripe_len = k + l_c + g;
   }
   string temp_blocks[stripe_len];
   string temp_IPs[stripe_len];
+  int temp_nodes[stripe_len];
   int ack_size = 1024;
   char** acks = new char*[k];
   for(int i = 0; i < k; ++i) {
@@ -490,13 +1829,17 @@ double Coordinator::downloadFile(string file, int sim_miss_id){
 
   string gw_ip = meta->getGW();
 
-  FILE* fp = fopen("./output", "w");
-  if(fp == NULL) {
+    // the blocks of a stripe are received straight into ./output (mapped)
+  size_t stripe_size = (size_t)k * chunk_size;
+  char* out = mapOutput(stripes.size() * stripe_size);
+  if(out == NULL) {
     cout<<"open file error!"<<endl;
     return decode_time;
   }
-  int BUFSIZE = chunk_size*k;
-  char* buf = new char[BUFSIZE];
+  char* swap_buf = new char[chunk_size];
+  int* arrival_of = new int[k];
+  bool* placed = new bool[k];
+  size_t stripe_idx = 0;
   int packet_num = chunk_size / packet_size;
   int* mark_recv = new int[packet_num*k];
   char** source_IPs_recv_data = new char*[k];
@@ -508,7 +1851,7 @@ double Coordinator::downloadFile(string file, int sim_miss_id){
   }
 
   set<string>::const_iterator stripesIter;
-  for(stripesIter = stripes.begin(); stripesIter != stripes.end(); ++stripesIter){
+  for(stripesIter = stripes.begin(); stripesIter != stripes.end(); ++stripesIter, ++stripe_idx){
     tmp_stripe = *stripesIter;
     tmpBlocks = meta->getStripe2Blocks(tmp_stripe);
     set<pair<unsigned int, string>>::const_iterator tmpBlocksIter;
@@ -517,7 +1860,7 @@ double Coordinator::downloadFile(string file, int sim_miss_id){
     for(tmpBlocksIter = tmpBlocks.begin(); tmpBlocksIter != tmpBlocks.end(); ++tmpBlocksIter){
       tmp_block_idx = (*tmpBlocksIter).first;
       tmp_block = (*tmpBlocksIter).second;
-      tmp_IP = meta->getBlock2IP(tmp_block);
+      tmp_IP = meta->getBlock2IP(tmp_block, temp_nodes[tmp_block_idx]);
       temp_blocks[tmp_block_idx] = tmp_block;
       temp_IPs[tmp_block_idx] = tmp_IP;
       cout<<"block "<<tmp_block_idx<<", "<<tmp_block<<", IP: "<<tmp_IP<<endl;
@@ -532,61 +1875,54 @@ double Coordinator::downloadFile(string file, int sim_miss_id){
       }
     }
 
-    // 2rd, receive blocks
-    bool block_miss = false;
-    int missing_ID = -1;
+    // check the local and global parity blocks, without touching the
+    // data block name kept by the datanodes for "re"
+    char* parity_ack = new char[ack_size];
+    vector<int> missing_IDs;
     for(int i = 0; i < k; ++i) {
-      if(strcmp(acks[i], "blk_ex") == 0){
-        // do nothing
-      } else if(strcmp(acks[i], "blk_mi") == 0) {
-        block_miss = true;
-        missing_ID = i;
-        break;
+      if(strcmp(acks[i], "blk_mi") == 0) {
+        missing_IDs.push_back(i);
+      }
+    }
+    for(int i = k; i < stripe_len; ++i) {
+      string cmd = "ck" + temp_blocks[i];
+      sendCmd(cmd, temp_IPs[i]);
+      recvAck(parity_ack);
+      if(strcmp(parity_ack, "blk_mi") == 0) {
+        missing_IDs.push_back(i);
       }
     }
-    if(!block_miss) {
+    delete[] parity_ack;
+
+    // 2rd, receive blocks
+    bool simulated = (missing_IDs.size() == 0);
+    if(simulated) {
       cout<<"###### all block exist ###### "<<endl;
       // simulate block miss
       cout<<"###### simulate block miss ###### "<<endl;
-      missing_ID = sim_miss_id;
+      missing_IDs.push_back(sim_miss_id);
     }
- 
-    cout<<"~~~~~~ data block "<<missing_ID<<" fails ~~~~~~"<<endl;
-    cout<<"trigger decode..."<<endl;
     struct timeval start_time, end_time;
     gettimeofday(&start_time, NULL);
-    int startDataIdx = requiredStartDataBlkID(missing_ID, hot_tag);
-    int endDataIdx = requiredEndDataBlkID(missing_ID, hot_tag);
-    int localParityIdx = requiredLocalParityBlkID(missing_ID, hot_tag);
-
-    char* gw_cmd = new char[400];
-    gw_cmd[0] = '\0';
-
-    for(int index = startDataIdx; index <= endDataIdx; ++index){
-      string cmd = generateDecodeCmd(temp_blocks, temp_IPs, index, missing_ID, hot_tag, gw_ip, gw_cmd);
-      sendCmd(cmd, temp_IPs[index]);
-      cout<<"~~~~~~ send cmd to data block "<<index<<" :"<<cmd<<endl;
-    }
-    string cmd = generateDecodeCmd(temp_blocks, temp_IPs, localParityIdx, missing_ID, hot_tag, gw_ip, gw_cmd);
-    sendCmd(cmd, temp_IPs[localParityIdx]);
-    cout<<"~~~~~~ send cmd to local parity block "<<(localParityIdx - k)<<" :"<<cmd<<endl;
 
-    if(gw_cmd[0] != '\0') {
-      cout<<"gw "<<gw_ip<<", decode cmd: "<<gw_cmd<<endl;
-      sendCmd(string(gw_cmd), gw_ip);
+    // the missing blocks are solved within their local groups when possible,
+    // otherwise with the global parity blocks as well, and repaired as planned
+    // for the current locations of the helpers
+    vector<string> requested_IPs(temp_IPs, temp_IPs + k);
+    if(!decodeMultiFailures(temp_blocks, temp_IPs, temp_nodes, missing_IDs, hot_tag, gw_ip, simulated)) {
+      cout<<"~~~~~~ unrecoverable erasure pattern, skip stripe "<<tmp_stripe<<endl;
+      continue;
     }
-    delete gw_cmd;
+    gettimeofday(&end_time, NULL);
+    decode_time = end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000;
+    fprintf(stderr, "~~~~~~ decode time: %.2lf s\n", decode_time);
 
-    int final_ack_size = 1024;
-    char* final_ack = new char[final_ack_size];
-    int final_ack_len = recvAck(final_ack);
-    cout<<"final ack length: "<<final_ack_len<<endl;
-    if(strcmp(final_ack, "fi_deco") == 0) {
-      // TODO, to ready download again
-      cout<<"~~~~~~ recieve finish decode !"<<endl;
-      gettimeofday(&end_time, NULL);
-      decode_time = end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000;
-      fprintf(stderr, "~~~~~~ decode time: %.2lf s\n", decode_time);
+    // the data blocks rebuilt on other nodes are requested there
+    for(int i = 0; i < k; ++i) {
+      if(temp_IPs[i] != requested_IPs[i]) {
+        sendCmd("dl" + temp_blocks[i], temp_IPs[i]);
+        ack_lens[i] = recvAck(acks[i]);
+      }
     }
 
     // download file again
@@ -595,28 +1931,58 @@ double Coordinator::downloadFile(string file, int sim_miss_id){
       sendCmd(re_download_cmd, temp_IPs[i]);
       cout<<"send ready to download cmd "<<i<<": "<<re_download_cmd<<endl;
     }
+    char* buf = out + stripe_idx * stripe_size;
     cn2dnSoc->paraRecvData(CN_DO_DATA_PORT, buf, chunk_size, packet_size, k, mark_recv, DATA_CHUNK, source_IPs_recv_data);
     //cout<<"source_IPs_recv_data: "<<endl;
       //for(int i = 0; i < k; ++i){
       //  cout<<source_IPs_recv_data[i]<<endl;
     //}
-    int write_len = 0;
+    // the blocks are received in their arrival order, move them in place,
+    // following the cycles of the permutation
     for(int i = 0; i < k; ++i){
+      placed[i] = false;
+    }
+    bool matched = true;
+    for(int i = 0; i < k && matched; ++i){
       int index = 0;
       for(; index < k; ++index){
-        if(strcmp(source_IPs_recv_data[index], (char*)temp_IPs[i].c_str()) == 0){
+        if(!placed[index] && strcmp(source_IPs_recv_data[index], (char*)temp_IPs[i].c_str()) == 0){
           break;
         }
       }
-      write_len = fwrite(buf + index*chunk_size, 1, chunk_size, fp);
-      //cout<<"write size: "<<write_len<<endl;
+      if(index == k) {
+        cout<<"WARNING: block "<<i<<" not received from "<<temp_IPs[i]<<endl;
+        matched = false;
+        break;
+      }
+      arrival_of[i] = index;
+      placed[index] = true;
+    }
+    for(int i = 0; i < k; ++i){
+      placed[i] = !matched || (arrival_of[i] == i);
+    }
+    for(int i = 0; i < k; ++i){
+      if(placed[i]) {
+        continue;
+      }
+      memcpy(swap_buf, buf + i*chunk_size, chunk_size);
+      int cur = i;
+      while(arrival_of[cur] != i) {
+        memcpy(buf + cur*chunk_size, buf + arrival_of[cur]*chunk_size, chunk_size);
+        placed[cur] = true;
+        cur = arrival_of[cur];
+      }
+      memcpy(buf + cur*chunk_size, swap_buf, chunk_size);
+      placed[cur] = true;
     }
 
   }// end of outer for
 
-  delete buf;
+  munmap(out, stripes.size() * stripe_size);
+  delete[] swap_buf;
+  delete[] arrival_of;
+  delete[] placed;
   delete mark_recv;
-  fclose(fp);
   for(int i = 0; i < k; ++i){
     delete source_IPs_recv_data[i];
   }
@@ -635,43 +2001,433 @@ double Coordinator::downloadFile(string file, int sim_miss_id){
   // functions required for decode
   // decide the local parity block id related to a missing data block
 int Coordinator::requiredLocalParityBlkID(int missing_ID, bool hot_tag){
-  int r_f = k / l_f;
-  int r_c = k / l_c;
-  int tmpLocalParityBlkID;
-  if(hot_tag) {
-    tmpLocalParityBlkID = missing_ID / r_f;
-  } else {
-    tmpLocalParityBlkID = missing_ID / r_c;
-  }
-  return (tmpLocalParityBlkID + k);
+  return (kernel->localGroup(missing_ID, hot_tag) + k);
 }
 
   // decide the start data block id of the local data set related to a missing data block
 int Coordinator::requiredStartDataBlkID(int missing_ID, bool hot_tag){
-  int r_f = k / l_f;
-  int r_c = k / l_c;
-  int tmpID;
-  if(hot_tag) {
-    tmpID = missing_ID / r_f;
-    return tmpID * r_f;
-  } else {
-    tmpID = missing_ID / r_c;
-    return tmpID * r_c;
-  }
+  return kernel->groupStart(kernel->localGroup(missing_ID, hot_tag), hot_tag);
 }
 
   // decide the end data block id of the local data set related to a missing data block
 int Coordinator::requiredEndDataBlkID(int missing_ID, bool hot_tag){
-  int r_f = k / l_f;
-  int r_c = k / l_c;
-  int tmpID;
-  if(hot_tag) {
-    tmpID = missing_ID / r_f;
-    return tmpID * r_f + r_f - 1;
-  } else {
-    tmpID = missing_ID / r_c;
-    return tmpID * r_c + r_c - 1;
-  }
+  return requiredStartDataBlkID(missing_ID, hot_tag) + kernel->groupSize(kernel->localGroup(missing_ID, hot_tag), hot_tag) - 1;
+}
+
+  // test the throughput of local (XOR) and global (GF) parity encoding,
+  // over one in-memory stripe, and append the results to ./results
+void Coordinator::testEncodeThroughput(){
+  int stripe_len = k + l_f + g;
+  char** buf = new char*[stripe_len];
+  for(int i = 0; i < stripe_len; ++i) {
+    buf[i] = new char[chunk_size];
+    for(int j = 0; j < chunk_size; ++j) {
+      buf[i][j] = (char)rand();
+    }
+  }
+  struct timeval start_time, end_time;
+  int running_times = 3;
+
+  gettimeofday(&start_time, NULL);
+  for(int i = 0; i < running_times; ++i) {
+    for(int blk_id = k; blk_id < k + l_f; ++blk_id) {
+      calculateLocalParityBlock(blk_id, buf);
+    }
+  }
+  gettimeofday(&end_time, NULL);
+  double xor_time = end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000;
+
+  gettimeofday(&start_time, NULL);
+  for(int i = 0; i < running_times; ++i) {
+    calculateGlobalParityBlocks(buf);
+  }
+  gettimeofday(&end_time, NULL);
+  double gf_time = end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000;
+
+  // all the local and global parity blocks in one pass, on the encode engine
+  double engine_time = 0.0;
+  for(int i = 0; i < running_times; ++i) {
+    int job = engine->submit(buf, chunk_size);
+    engine_time += engine->wait(job);
+    engine->release(job);
+  }
+
+  double encoded_mb = (double)running_times * k * chunk_size / (1024 * 1024);
+  double xor_tput = xor_time > 0 ? encoded_mb / xor_time : 0.0;
+  double gf_tput = gf_time > 0 ? encoded_mb / gf_time : 0.0;
+  double engine_tput = engine_time > 0 ? encoded_mb / engine_time : 0.0;
+  cout<<"local parity (XOR) encode throughput: "<<xor_tput<<" MB/s"<<endl;
+  cout<<"global parity (GF, "<<(ErasureCode::simdEnabled() ? "pshufb" : "table")<<") encode throughput: "<<gf_tput<<" MB/s"<<endl;
+  cout<<"all parities, encode engine ("<<engine->workerNum()<<" workers) throughput: "<<engine_tput<<" MB/s"<<endl;
+  FILE* fpr = fopen("./results", "a");
+  if(fpr != NULL) {
+    fprintf(fpr, "------ k: %d, l_f: %d, g: %d, l_c: %d\n ", k, l_f, g, l_c);
+    fprintf(fpr, "^^^^^^ local parity (XOR) encode throughput: %.2lf MB/s\n ", xor_tput);
+    fprintf(fpr, "^^^^^^ global parity (GF, %s) encode throughput: %.2lf MB/s\n ", ErasureCode::simdEnabled() ? "pshufb" : "table", gf_tput);
+    fprintf(fpr, "^^^^^^ all parities, encode engine (%d workers) throughput: %.2lf MB/s\n", engine->workerNum(), engine_tput);
+    fclose(fpr);
+  }
+
+  for(int i = 0; i < stripe_len; ++i) {
+    delete[] buf[i];
+  }
+  delete[] buf;
+}
+
+  // every erasure pattern of up to g + 1 blocks that solveErasures solves is
+  // rebuilt as the DNs do, i.e., by ErasureCode::gfMulRegion over the
+  // surviving blocks, and compared byte for byte with the lost blocks; once
+  // at once ("md"), once packet by packet along the helpers ("ch")
+void Coordinator::testGlobalRepair(){
+  size_t len = 64 * 1024;
+  size_t packet = 4096;
+  int checked_num = 0;
+  int global_num = 0;
+  int mismatch_num = 0;
+  for(int hot = 1; hot >= 0; --hot) {
+    int l = hot ? l_f : l_c;
+    int stripe_len = k + l + g;
+    int* group_of = new int[k];
+    for(int i = 0; i < k; ++i) {
+      group_of[i] = layout->groupOf(i, hot != 0);
+    }
+    char** blks = new char*[stripe_len];
+    for(int i = 0; i < stripe_len; ++i) {
+      blks[i] = new char[len];
+      memset(blks[i], 0, len);
+    }
+    for(int i = 0; i < k; ++i) {
+      for(size_t j = 0; j < len; ++j) {
+        blks[i][j] = (char)rand();
+      }
+      ErasureCode::xorRegion(blks[i], blks[k + group_of[i]], len);
+    }
+    ec->encodeGlobalParities(blks, blks + k + l, len);
+    char* out = new char[len];
+
+    // the patterns in lexicographic order, by their sizes
+    for(int num = 1; num <= g + 1 && num <= stripe_len; ++num) {
+      vector<int> erased(num);
+      for(int i = 0; i < num; ++i) {
+        erased[i] = i;
+      }
+      while(true) {
+        vector<Equation> equations;
+        if(ec->solveErasures(l, group_of, erased, equations)) {
+          bool global = false;
+          for(size_t t = 0; t < erased.size(); ++t) {
+            memset(out, 0, len);
+            for(size_t i = 0; i < equations[t].size(); ++i) {
+              ErasureCode::gfMulRegion(equations[t][i].second, blks[equations[t][i].first], out, len, true);
+              global = global || equations[t][i].first >= k + l || erased[t] >= k + l;
+            }
+            bool matched = (memcmp(out, blks[erased[t]], len) == 0);
+            for(size_t pos = 0; pos < len; pos += packet) {
+              memset(out + pos, 0, packet);
+              for(size_t i = 0; i < equations[t].size(); ++i) {
+                ErasureCode::gfMulRegion(equations[t][i].second, blks[equations[t][i].first] + pos, out + pos, packet, true);
+              }
+            }
+            matched = matched && (memcmp(out, blks[erased[t]], len) == 0);
+            if(!matched) {
+              cout<<"mismatch: block "<<erased[t]<<" of pattern";
+              for(size_t i = 0; i < erased.size(); ++i) {
+                cout<<" "<<erased[i];
+              }
+              cout<<(hot ? " (fast)" : " (compact)")<<endl;
+              mismatch_num++;
+            }
+          }
+          checked_num++;
+          if(global) {
+            global_num++;
+          }
+        }
+        int p = num - 1;
+        while(p >= 0 && erased[p] == stripe_len - num + p) {
+          p--;
+        }
+        if(p < 0) {
+          break;
+        }
+        erased[p]++;
+        for(int i = p + 1; i < num; ++i) {
+          erased[i] = erased[i - 1] + 1;
+        }
+      }
+    }
+
+    delete[] out;
+    for(int i = 0; i < stripe_len; ++i) {
+      delete[] blks[i];
+    }
+    delete[] blks;
+    delete[] group_of;
+  }
+  cout<<"repair check: "<<checked_num<<" erasure patterns, "<<global_num<<" with global parity blocks, "<<mismatch_num<<" mismatched blocks"<<endl;
+}
+
+  // test the throughput of the XOR fan-in of the shape's kernel against
+  // the generic kernel, for the fan-ins r_f (fast local parity), r_c
+  // (compact local parity) and delta (upcode), and append to ./results
+void Coordinator::testKernelThroughput(){
+  GenericKernel generic(k, l_f, l_c);
+  int fan_ins[3] = {kernel->groupSize(0, true), kernel->groupSize(0, false), layout->compactDelta(0)};
+  const char* fan_in_names[3] = {"r_f", "r_c", "delta"};
+  int max_fan_in = fan_ins[1] > fan_ins[0] ? fan_ins[1] : fan_ins[0];
+  char** buf = new char*[max_fan_in + 1];
+  for(int i = 0; i <= max_fan_in; ++i) {
+    buf[i] = new char[chunk_size];
+    for(int j = 0; j < chunk_size; ++j) {
+      buf[i][j] = (char)rand();
+    }
+  }
+  struct timeval start_time, end_time;
+  int running_times = 3;
+  FILE* fpr = fopen("./results", "a");
+  if(fpr != NULL) {
+    fprintf(fpr, "------ k: %d, l_f: %d, g: %d, l_c: %d, kernel: %s\n ", k, l_f, g, l_c, kernel->name());
+  }
+  for(int f = 0; f < 3; ++f) {
+    double tput[2];
+    LRCKernel* kernels[2] = {&generic, kernel};
+    for(int o = 0; o < 2; ++o) {
+      gettimeofday(&start_time, NULL);
+      for(int i = 0; i < running_times; ++i) {
+        kernels[o]->xorFanIn(buf + 1, fan_ins[f], buf[0], chunk_size);
+      }
+      gettimeofday(&end_time, NULL);
+      double t = end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000;
+      double mb = (double)running_times * fan_ins[f] * chunk_size / (1024 * 1024);
+      tput[o] = t > 0 ? mb / t : 0.0;
+    }
+    cout<<"XOR fan-in "<<fan_in_names[f]<<" = "<<fan_ins[f]<<", generic: "<<tput[0]<<" MB/s, "<<kernel->name()<<": "<<tput[1]<<" MB/s"<<endl;
+    if(fpr != NULL) {
+      fprintf(fpr, "^^^^^^ XOR fan-in %s = %d, generic: %.2lf MB/s, %s: %.2lf MB/s\n ", fan_in_names[f], fan_ins[f], tput[0], kernel->name(), tput[1]);
+    }
+  }
+  if(fpr != NULL) {
+    fprintf(fpr, "\n");
+    fclose(fpr);
+  }
+
+  for(int i = 0; i <= max_fan_in; ++i) {
+    delete[] buf[i];
+  }
+  delete[] buf;
+}
+
+  // report the cross-rack block transfers of a single-block repair (average
+  // over the data blocks, fast and compact code), an upcode and a downcode
+  // (per stripe) for the three placements, then of repairing each type of
+  // block for the configured one, and append to ./results
+void Coordinator::reportCrossRackCost(){
+  int methods[3] = {OPT_S, OPT_R, FLAT};
+  const char* method_names[3] = {"Opt-S", "Opt-R", "Flat"};
+  cout<<"fast groups:";
+  for(int f = 0; f < l_f; ++f) {
+    cout<<" "<<layout->fastGroupSize(f);
+  }
+  cout<<", compact groups merge:";
+  for(int c = 0; c < l_c; ++c) {
+    cout<<" "<<layout->compactDelta(c);
+  }
+  cout<<endl;
+  FILE* fpr = fopen("./results", "a");
+  if(fpr != NULL) {
+    fprintf(fpr, "------ k: %d, l_f: %d, g: %d, l_c: %d, cross-rack cost\n ", k, l_f, g, l_c);
+  }
+  for(int m = 0; m < 3; ++m) {
+    double fast_repair = layout->fastRepairCost(methods[m]);
+    double compact_repair = layout->compactRepairCost(methods[m]);
+    int upcode = layout->upcodeCost(methods[m]);
+    int downcode = layout->downcodeCost(methods[m]);
+    cout<<method_names[m]<<": repair (fast) "<<fast_repair<<", repair (compact) "<<compact_repair<<", upcode "<<upcode<<", downcode "<<downcode<<endl;
+    if(fpr != NULL) {
+      fprintf(fpr, "^^^^^^ %s: repair (fast) %.2lf, repair (compact) %.2lf, upcode %d, downcode %d\n ", method_names[m], fast_repair, compact_repair, upcode, downcode);
+    }
+  }
+  reportRepairCostByType(fpr);
+  if(fpr != NULL) {
+    fprintf(fpr, "\n");
+    fclose(fpr);
+  }
+  ec->printCacheStats();
+}
+
+  // the stripes take their placements round robin from a pool drawn by
+  // decide_location; a cold stripe is the hot one upcoded, i.e., the head
+  // fast local parity block of each compact group becomes its compact local
+  // parity block, and the fast ones are reserved. The stripes are planned by
+  // a planner of their own, the loads of the repairs are left as they are
+void Coordinator::testPlanCache(int stripe_num){
+  RepairPlanner* repair_planner = planner;
+  planner = new RepairPlanner(meta);
+  int stripe_len = k + l_f + g;
+  int cold_len = k + l_c + g;
+  int reserved_len = k + l_f;
+  int pool_num = 64;
+  string gw_ip = meta->getGW();
+  vector<vector<string>> pool_IPs(pool_num);
+  vector<vector<int>> pool_nodes(pool_num);
+  for(int p = 0; p < pool_num; ++p) {
+    map<int, string> blk_id2IP = decide_location();
+    for(int i = 0; i < stripe_len; ++i) {
+      pool_IPs[p].push_back(blk_id2IP[i]);
+      pool_nodes[p].push_back(meta->getDNID(blk_id2IP[i]));
+    }
+  }
+  int* group_of = new int[k];
+  for(int i = 0; i < k; ++i) {
+    group_of[i] = layout->groupOf(i, true);
+  }
+  vector<int> missing_IDs(1, 0);
+  vector<Equation> equations;
+  ec->solveErasures(l_f, group_of, missing_IDs, equations);
+  delete[] group_of;
+
+  string blks[stripe_len];
+  string IPs[stripe_len];
+  int nodes[stripe_len];
+  string cold_blks[cold_len];
+  string cold_IPs[cold_len];
+  int cold_nodes[cold_len];
+  string reserved_blks[reserved_len];
+  string reserved_IPs[reserved_len];
+  int reserved_nodes[reserved_len];
+  char blk_name[32];
+  auto fillStripe = [&](int s) {
+    vector<string>& pool = pool_IPs[s % pool_num];
+    vector<int>& pool_node = pool_nodes[s % pool_num];
+    for(int i = 0; i < stripe_len; ++i) {
+      sprintf(blk_name, "FI9999-%04d-%02d", s % 10000, i);
+      blks[i] = string(blk_name);
+      IPs[i] = pool[i];
+      nodes[i] = pool_node[i];
+    }
+    for(int i = 0; i < k; ++i) {
+      cold_blks[i] = blks[i];
+      cold_IPs[i] = IPs[i];
+      cold_nodes[i] = nodes[i];
+    }
+    for(int c = 0; c < l_c; ++c) {
+      cold_blks[k + c] = blks[k + layout->compactFirstFast(c)];
+      cold_IPs[k + c] = IPs[k + layout->compactFirstFast(c)];
+      cold_nodes[k + c] = nodes[k + layout->compactFirstFast(c)];
+    }
+    for(int j = 0; j < g; ++j) {
+      cold_blks[k + l_c + j] = blks[k + l_f + j];
+      cold_IPs[k + l_c + j] = IPs[k + l_f + j];
+      cold_nodes[k + l_c + j] = nodes[k + l_f + j];
+    }
+    for(int f = 0; f < l_f; ++f) {
+      reserved_blks[k + f] = blks[k + f];
+      reserved_IPs[k + f] = IPs[k + f];
+      reserved_nodes[k + f] = nodes[k + f];
+    }
+  };
+
+  struct timeval start_time, end_time;
+  double plan_time[2];
+  size_t cmd_bytes[2] = {0, 0};
+  char* gw_cmd = new char[400];
+  char* gw_cmd_f = new char[100];
+
+  // [per stripe, by the generators]
+  gettimeofday(&start_time, NULL);
+  for(int s = 0; s < stripe_num; ++s) {
+    fillStripe(s);
+    gw_cmd[0] = '\0';
+    for(int idx = k; idx < k + l_f; ++idx) {
+      cmd_bytes[0] += generateUpcodeCmd(blks, IPs, idx, gw_ip, gw_cmd).size();
+    }
+    cmd_bytes[0] += strlen(gw_cmd);
+    gw_cmd[0] = '\0';
+    gw_cmd_f[0] = '\0';
+    for(int i = 0; i < k + l_c; ++i) {
+      cmd_bytes[0] += generateDowncodeCmd(cold_blks, cold_IPs, reserved_blks, reserved_IPs, i, -1, gw_ip, gw_cmd, gw_cmd_f).size();
+    }
+    for(int i = k; i < k + l_f; ++i) {
+      cmd_bytes[0] += generateDowncodeCmd(cold_blks, cold_IPs, reserved_blks, reserved_IPs, -1, i, gw_ip, gw_cmd, gw_cmd_f).size();
+    }
+    if(gw_cmd[0] != '\0') {
+      cmd_bytes[0] += strlen(gw_cmd) + strlen(gw_cmd_f);
+    }
+    gw_cmd[0] = '\0';
+    map<string, string> cmds = generateMultiDecodeCmd(blks, IPs, 0, equations[0], gw_ip, gw_cmd);
+    map<string, string>::const_iterator cmdsIter;
+    for(cmdsIter = cmds.begin(); cmdsIter != cmds.end(); ++cmdsIter) {
+      cmd_bytes[0] += cmdsIter->second.size();
+    }
+    cmd_bytes[0] += strlen(gw_cmd);
+  }
+  gettimeofday(&end_time, NULL);
+  plan_time[0] = end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000;
+
+  // [from the templates]
+  long hit_num = plans->hitNum();
+  long miss_num = plans->missNum();
+  gettimeofday(&start_time, NULL);
+  for(int s = 0; s < stripe_num; ++s) {
+    fillStripe(s);
+    string sig = placementSignature(nodes, stripe_len);
+    string key = "uc:" + sig;
+    PlanTemplate* plan = plans->find(key);
+    if(plan == NULL) {
+      plan = compileUpcodePlan(key, gw_ip);
+    }
+    for(size_t c = 0; c < plan->cmds.size(); ++c) {
+      cmd_bytes[1] += PlanCache::instantiate(plan->cmds[c].second, blks, IPs, NULL, NULL).size();
+    }
+    cmd_bytes[1] += PlanCache::instantiate(plan->gw_cmd, blks, IPs, NULL, NULL).size();
+
+    key = "dc:" + placementSignature(cold_nodes, cold_len) + "|" + placementSignature(reserved_nodes + k, l_f);
+    plan = plans->find(key);
+    if(plan == NULL) {
+      plan = compileDowncodePlan(key, gw_ip);
+    }
+    for(size_t c = 0; c < plan->cmds.size(); ++c) {
+      cmd_bytes[1] += PlanCache::instantiate(plan->cmds[c].second, cold_blks, cold_IPs, reserved_blks, reserved_IPs).size();
+    }
+    cmd_bytes[1] += PlanCache::instantiate(plan->gw_cmd, cold_blks, cold_IPs, reserved_blks, reserved_IPs).size();
+
+    key = "re:1:0,:" + sig + ":0:" + loadSignature(nodes, equations[0]);
+    plan = plans->find(key);
+    if(plan == NULL) {
+      plan = compileRepairPlan(key, IPs, nodes, stripe_len, 0, equations[0], gw_ip);
+    }
+    for(size_t c = 0; c < plan->cmds.size(); ++c) {
+      cmd_bytes[1] += PlanCache::instantiate(plan->cmds[c].second, blks, IPs, NULL, NULL).size();
+    }
+    cmd_bytes[1] += PlanCache::instantiate(plan->gw_cmd, blks, IPs, NULL, NULL).size();
+  }
+  gettimeofday(&end_time, NULL);
+  plan_time[1] = end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000;
+  hit_num = plans->hitNum() - hit_num;
+  miss_num = plans->missNum() - miss_num;
+  delete[] gw_cmd;
+  delete[] gw_cmd_f;
+
+  const char* names[2] = {"per stripe", "templates"};
+  FILE* fpr = fopen("./results", "a");
+  if(fpr != NULL) {
+    fprintf(fpr, "------ k: %d, l_f: %d, g: %d, l_c: %d, planning %d stripes (upcode, downcode, repair)\n ", k, l_f, g, l_c, stripe_num);
+  }
+  for(int o = 0; o < 2; ++o) {
+    double us = stripe_num > 0 ? plan_time[o] * 1000000 / stripe_num : 0.0;
+    double rate = plan_time[o] > 0 ? stripe_num / plan_time[o] : 0.0;
+    cout<<names[o]<<": "<<plan_time[o]<<" s, "<<us<<" us/stripe, "<<rate<<" stripes/s, "<<cmd_bytes[o]<<" command bytes"<<endl;
+    if(fpr != NULL) {
+      fprintf(fpr, "^^^^^^ %s: %.2lf s, %.2lf us/stripe, %.0lf stripes/s, %zu command bytes\n ", names[o], plan_time[o], us, rate, cmd_bytes[o]);
+    }
+  }
+  cout<<"templates: "<<plans->size()<<", hits: "<<hit_num<<", misses: "<<miss_num<<endl;
+  if(fpr != NULL) {
+    fprintf(fpr, "^^^^^^ templates: %d, hits: %ld, misses: %ld\n\n", plans->size(), hit_num, miss_num);
+    fclose(fpr);
+  }
+  delete planner;
+  planner = repair_planner;
 }
 
   // test decode command
@@ -746,7 +2502,8 @@ string Coordinator::generateDecodeCmd(string stripe_blks[], string blk_IPs[], in
 
   retCmd += "de";
 
-  // Note: currently, we recover a block in its original place
+  // Note: the block is recovered at blk_IPs[missing_ID], i.e., its original
+  // place unless the caller chose another target (see chooseRepairTarget)
   if(blk_id == missing_ID) {
     int num_blk_missing_rack = 0;
     int num_wait_other_racks = 0;
@@ -791,101 +2548,1495 @@ string Coordinator::generateDecodeCmd(string stripe_blks[], string blk_IPs[], in
       }
     }
 
-    // missing block command, e.g., [D0 in Fig.4 in paper]
-    retCmd += "wa";
-    retCmd += to_string(num_blk_missing_rack - 1 + num_wait_other_racks);
-    retCmd += "blk";
-    set<int>::const_iterator wait_blk_idx_iter;
-    for(wait_blk_idx_iter = wait_blk_idx.begin(); wait_blk_idx_iter != wait_blk_idx.end(); ++wait_blk_idx_iter) {
-      if((*wait_blk_idx_iter) != blk_id) {
-        tmp_ip = blk_IPs[*wait_blk_idx_iter];
-        retCmd += tmp_ip;
+    // missing block command, e.g., [D0 in Fig.4 in paper]
+    retCmd += "wa";
+    retCmd += Socket::countField(num_blk_missing_rack - 1 + num_wait_other_racks);
+    retCmd += "blk";
+    set<int>::const_iterator wait_blk_idx_iter;
+    for(wait_blk_idx_iter = wait_blk_idx.begin(); wait_blk_idx_iter != wait_blk_idx.end(); ++wait_blk_idx_iter) {
+      if((*wait_blk_idx_iter) != blk_id) {
+        tmp_ip = blk_IPs[*wait_blk_idx_iter];
+        retCmd += tmp_ip;
+      }
+    }
+    retCmd += waited_gw_ip_concated_str;
+    retCmd += "reco";
+
+    if(num_wait_other_racks != 0) {
+      // gateway command
+      string gw_cmd_str = "ga";
+      gw_cmd_str += Socket::countField(1);
+      gw_cmd_str += "wa";
+      gw_cmd_str += Socket::countField(num_wait_other_racks);
+      gw_cmd_str += gw_waited_block_ip_concated_str;
+      gw_cmd_str += "se";
+      gw_cmd_str += missing_block_ip;
+      strcpy(gw_cmd, (char*)gw_cmd_str.c_str());
+    }
+
+  } else {
+    if(rack == missing_block_rack) {
+      // command for a block residing in the missing block's rack, but not 
+      // the missing block, e.g., [D1 in Fig.4 in paper]
+      // "se block missing_block_ip"
+      retCmd += "se";
+      retCmd += block;
+      retCmd += missing_block_ip;
+    } else {
+      int num_blk_this_rack = 0;
+      int smallest_idx_this_rack = blk_id;
+      set<int> idx_this_rack;
+      idx_this_rack.clear();
+      string tmp_blk;
+      string tmp_ip;
+      string tmp_rack;
+      // iterate over the data blocks
+      for(int idx = startIdx; idx <= endIdx; ++idx) {
+        tmp_blk = stripe_blks[idx];
+        tmp_ip = blk_IPs[idx];
+        tmp_rack = meta->getDN2Rack(tmp_ip);
+        if(tmp_rack == rack) {
+          num_blk_this_rack++;
+          if(idx < smallest_idx_this_rack) {
+            smallest_idx_this_rack = idx;
+          }
+          idx_this_rack.insert(idx);
+        }
+      }
+      // consider the local parity block
+      tmp_blk = stripe_blks[localParityIdx];
+      tmp_ip = blk_IPs[localParityIdx];
+      tmp_rack = meta->getDN2Rack(tmp_ip);
+      if(tmp_rack == rack) {
+        num_blk_this_rack++;
+        idx_this_rack.insert(localParityIdx);
+      }
+
+      if(num_blk_this_rack == 1) {
+        retCmd += "se";
+        retCmd += block;
+        retCmd += gw_ip;
+      } else {
+        if(smallest_idx_this_rack < blk_id) {
+          // e.g., [D3/D5 in Fig.4 in paper]
+          tmp_ip = blk_IPs[smallest_idx_this_rack];
+          retCmd += "se";
+          retCmd += block;
+          retCmd += tmp_ip;
+        } else {
+          // e.g., [D2/D4 in Fig.4 in paper]
+          retCmd += "wa";
+          retCmd += Socket::countField(num_blk_this_rack - 1);
+          retCmd += "blk";
+          set<int>::const_iterator idx_this_rack_iter;
+          for(idx_this_rack_iter = idx_this_rack.begin(); idx_this_rack_iter != idx_this_rack.end(); ++idx_this_rack_iter) {
+            if((*idx_this_rack_iter) != blk_id) {
+              tmp_ip = blk_IPs[*idx_this_rack_iter];
+              retCmd += tmp_ip;
+            }
+          }
+          retCmd += "se";
+          retCmd += block;
+          retCmd += gw_ip;
+        }
+      }
+    }
+  }
+  return retCmd;
+}
+
+  // repair several failed blocks of a stripe, one by one; a block whose miss
+  // is only simulated is still on its node, and is rebuilt there
+bool Coordinator::decodeMultiFailures(string stripe_blks[], string blk_IPs[], int blk_nodes[], vector<int> missing_IDs, bool hot, string gw_ip, bool simulated) {
+  int l = hot ? l_f : l_c;
+  int* group_of = new int[k];
+  for(int i = 0; i < k; ++i) {
+    group_of[i] = requiredLocalParityBlkID(i, hot) - k;
+  }
+  vector<Equation> equations;
+  bool recoverable = ec->solveErasures(l, group_of, missing_IDs, equations);
+  delete[] group_of;
+  if(!recoverable) {
+    return false;
+  }
+
+  int ack_size = 1024;
+  char* ack = new char[ack_size];
+  int stripe_len = hot ? k + l_f + g : k + l_c + g;
+  // the blocks are rebuilt at the targets chosen, and moved there in the
+  // metadata once written; the repairs are planned for the targets
+  vector<string> origin_IPs;
+  for(size_t t = 0; t < missing_IDs.size(); ++t) {
+    string origin = blk_IPs[missing_IDs[t]];
+    string target = origin;
+    if(!simulated) {
+      target = chooseRepairTarget(blk_IPs, stripe_len, missing_IDs[t], equations[t], hot, gw_ip);
+    }
+    origin_IPs.push_back(origin);
+    blk_IPs[missing_IDs[t]] = target;
+    blk_nodes[missing_IDs[t]] = meta->getDNID(target);
+    repair_load[target]++;
+    for(size_t i = 0; i < equations[t].size(); ++i) {
+      repair_load[blk_IPs[equations[t][i].first]]++;
+    }
+    if(target != origin) {
+      cout<<"~~~~~~ block "<<missing_IDs[t]<<" is rebuilt on "<<target<<" ("<<meta->getDN2Rack(target)<<") instead of "<<origin<<" ("<<meta->getDN2Rack(origin)<<")"<<endl;
+    }
+  }
+  // the repairs are planned once per placement and erasure pattern
+  string key_prefix = "re:" + to_string(hot) + ":";
+  for(size_t t = 0; t < missing_IDs.size(); ++t) {
+    key_prefix += to_string(missing_IDs[t]) + ",";
+  }
+  key_prefix += ":" + placementSignature(blk_nodes, stripe_len) + ":";
+  for(size_t t = 0; t < missing_IDs.size(); ++t) {
+    cout<<"~~~~~~ block "<<missing_IDs[t]<<" fails, solved by "<<equations[t].size()<<" blocks ~~~~~~"<<endl;
+    char* gw_cmd = new char[400];
+    gw_cmd[0] = '\0';
+    map<string, string> cmds;
+    if(chain_repair) {
+      cmds = generateChainRepairCmds(stripe_blks, blk_IPs, missing_IDs[t], equations[t], gw_ip);
+    } else {
+      if(repair_slices > 1) {
+        cmds = generateSlicedRepairCmds(stripe_blks, blk_IPs, stripe_len, missing_IDs[t], equations[t], gw_ip);
+      }
+      if(cmds.empty()) {
+        string key = key_prefix + to_string(t) + ":" + loadSignature(blk_nodes, equations[t]);
+        PlanTemplate* plan = plans->find(key);
+        if(plan == NULL) {
+          plan = compileRepairPlan(key, blk_IPs, blk_nodes, stripe_len, missing_IDs[t], equations[t], gw_ip);
+        }
+        for(size_t c = 0; c < plan->cmds.size(); ++c) {
+          cmds[PlanCache::instantiate(plan->cmds[c].first, stripe_blks, blk_IPs, NULL, NULL)] = PlanCache::instantiate(plan->cmds[c].second, stripe_blks, blk_IPs, NULL, NULL);
+        }
+        if(plan->gw_cmd != "") {
+          strcpy(gw_cmd, PlanCache::instantiate(plan->gw_cmd, stripe_blks, blk_IPs, NULL, NULL).c_str());
+        }
+        // the template was planned for the current loads, and adds to them
+        planner->account(cmds, gw_ip, gw_cmd[0] != '\0' ? string(gw_cmd + 2 + COUNT_FIELD_LEN) : "");
+      }
+    }
+    if(cmds.empty()) {
+      cout<<"~~~~~~ no repair plan for block "<<missing_IDs[t]<<endl;
+      delete[] gw_cmd;
+      delete[] ack;
+      return false;
+    }
+    map<string, string>::const_iterator cmdsIter;
+    for(cmdsIter = cmds.begin(); cmdsIter != cmds.end(); ++cmdsIter) {
+      sendCmd(cmdsIter->second, cmdsIter->first);
+      cout<<"~~~~~~ send cmd to "<<cmdsIter->first<<" :"<<cmdsIter->second<<endl;
+    }
+    if(gw_cmd[0] != '\0') {
+      cout<<"gw "<<gw_ip<<", decode cmd: "<<gw_cmd<<endl;
+      sendCmd(string(gw_cmd), gw_ip);
+    }
+    delete[] gw_cmd;
+
+    recvAck(ack);
+    string blk = stripe_blks[missing_IDs[t]];
+    if(strncmp(ack, "fi_deco", 7) == 0 && string(ack + 7) == blk) {
+      cout<<"~~~~~~ recieve finish decode of block "<<missing_IDs[t]<<" !"<<endl;
+      if(blk_IPs[missing_IDs[t]] != origin_IPs[t]) {
+          // !!! update block metadata
+        meta->relocateBlkIP(blk, origin_IPs[t], blk_IPs[missing_IDs[t]]);
+      }
+    } else {
+      cout<<"~~~~~~ block "<<missing_IDs[t]<<" not rebuilt, ack: "<<ack<<endl;
+      blk_IPs[missing_IDs[t]] = origin_IPs[t];
+      blk_nodes[missing_IDs[t]] = meta->getDNID(origin_IPs[t]);
+    }
+  }
+  delete[] ack;
+  return true;
+}
+
+string Coordinator::chooseRepairTarget(string blk_IPs[], int stripe_len, int missing_ID, const Equation& equation, bool hot, string gw_ip) {
+  string origin = blk_IPs[missing_ID];
+  set<string> used_ips(blk_IPs, blk_IPs + stripe_len);
+  vector<string> candidates(1, origin);
+  set<string> racks = meta->getRacks();
+  for(set<string>::const_iterator rackIter = racks.begin(); rackIter != racks.end(); ++rackIter) {
+    set<string> dns = meta->getRack2DN(*rackIter);
+    for(set<string>::const_iterator it = dns.begin(); it != dns.end(); ++it) {
+      if(used_ips.find(*it) == used_ips.end() && *it != gw_ip) {
+        candidates.push_back(*it);
+      }
+    }
+  }
+  string target = "";
+  int target_violations = 0;
+  int target_cost = 0;
+  for(size_t c = 0; c < candidates.size(); ++c) {
+    blk_IPs[missing_ID] = candidates[c];
+    int violations = placementViolations(blk_IPs, stripe_len, hot);
+    int cost = crossRackBlocks(blk_IPs, equation, candidates[c]);
+    if(target == "" || violations < target_violations || (violations == target_violations && (cost < target_cost || (cost == target_cost && repair_load[candidates[c]] < repair_load[target])))) {
+      target = candidates[c];
+      target_violations = violations;
+      target_cost = cost;
+    }
+  }
+  blk_IPs[missing_ID] = origin;
+  return target;
+}
+
+  // the helpers of each other rack cross the gateway as a single block
+int Coordinator::crossRackBlocks(string blk_IPs[], const Equation& equation, string target) {
+  string target_rack = meta->getDN2Rack(target);
+  set<string> helper_racks;
+  for(size_t i = 0; i < equation.size(); ++i) {
+    string helper_rack = meta->getDN2Rack(blk_IPs[equation[i].first]);
+    if(helper_rack != target_rack) {
+      helper_racks.insert(helper_rack);
+    }
+  }
+  return helper_racks.size();
+}
+
+int Coordinator::placementViolations(string blk_IPs[], int stripe_len, bool hot) {
+  int violations = 0;
+  if(place_method == FLAT) {
+    map<string, int> rack_blk_num;
+    for(int i = 0; i < stripe_len; ++i) {
+      rack_blk_num[meta->getDN2Rack(blk_IPs[i])]++;
+    }
+    int rack_num = meta->getRacks().size();
+    int cap = (stripe_len + rack_num - 1) / rack_num;
+    map<string, int>::const_iterator it;
+    for(it = rack_blk_num.begin(); it != rack_blk_num.end(); ++it) {
+      if(it->second > cap) {
+        violations += it->second - cap;
+      }
+    }
+    return violations;
+  }
+    // the blocks of each fast local group, and the global parity blocks, that
+    // are out of the rack holding most of them; a local parity block goes with
+    // its fast group in Opt-R, and with the head fast group of its compact
+    // group in Opt-S, as decide_location places them
+  int l = hot ? l_f : l_c;
+  vector<vector<int>> groups(l_f + 1);
+  for(int i = 0; i < k; ++i) {
+    groups[layout->fastGroupOf(i)].push_back(i);
+  }
+  for(int lp = 0; lp < l; ++lp) {
+    int fast_id = lp;
+    if(!hot) {
+      fast_id = layout->compactFirstFast(lp);
+    } else if(place_method == OPT_S) {
+      fast_id = layout->compactFirstFast(layout->compactGroupOfFast(lp));
+    }
+    groups[fast_id].push_back(k + lp);
+  }
+  for(int i = k + l; i < stripe_len; ++i) {
+    groups[l_f].push_back(i);
+  }
+  for(size_t j = 0; j < groups.size(); ++j) {
+    map<string, int> rack_blk_num;
+    int most = 0;
+    for(size_t i = 0; i < groups[j].size(); ++i) {
+      int num = ++rack_blk_num[meta->getDN2Rack(blk_IPs[groups[j][i]])];
+      most = num > most ? num : most;
+    }
+    violations += groups[j].size() - most;
+  }
+  return violations;
+}
+
+  // a degraded read, the helper nodes in each rack are summed up by the first
+  // one of them, which returns its partial sum to the CN tagged with the name of
+  // the missing block ("rt"). Return the commands keyed by the node ip, and the
+  // number of partial sums, i.e., of helper racks. With fallbacks, a partial
+  // sum that its aggregator has cached is read by "pr" + id + block alone, and
+  // the others are cached ("ca" + id + the id evicted for it)
+map<string, string> Coordinator::generateDegradedReadCmds(string stripe_blks[], string blk_IPs[], int missing_ID, const Equation& equation, int& partial_num, map<long, PartialFallback>* fallbacks) {
+  map<string, string> retCmds;
+  vector<string> helper_ips;
+  map<string, string> ip2in;
+  map<string, int> ip2num;
+    // the versions of the blocks of each helper, which name a partial sum with ip2in
+  map<string, string> ip2versions;
+  char coef[4];
+  for(size_t i = 0; i < equation.size(); ++i) {
+    string tmp_ip = blk_IPs[equation[i].first];
+    if(ip2in.find(tmp_ip) == ip2in.end()) {
+      helper_ips.push_back(tmp_ip);
+      ip2in[tmp_ip] = "";
+      ip2num[tmp_ip] = 0;
+    }
+    sprintf(coef, "%03d", equation[i].second);
+    ip2in[tmp_ip] += string(coef) + stripe_blks[equation[i].first];
+    ip2num[tmp_ip]++;
+    ip2versions[tmp_ip] += "v" + to_string(blk_versions[stripe_blks[equation[i].first]]);
+  }
+
+  vector<string> racks;
+  map<string, vector<string>> rack2ips;
+  for(size_t i = 0; i < helper_ips.size(); ++i) {
+    string tmp_rack = meta->getDN2Rack(helper_ips[i]);
+    if(rack2ips.find(tmp_rack) == rack2ips.end()) {
+      racks.push_back(tmp_rack);
+    }
+    rack2ips[tmp_rack].push_back(helper_ips[i]);
+  }
+  for(size_t r = 0; r < racks.size(); ++r) {
+    vector<string>& ips = rack2ips[racks[r]];
+    string aggregator_ip = ips[0];
+    string aggregator_cmd = "mdwa" + Socket::countField(ips.size() - 1) + "blk";
+    for(size_t i = 1; i < ips.size(); ++i) {
+      retCmds[ips[i]] = "mdwa" + Socket::countField(0) + "blkin" + Socket::countField(ip2num[ips[i]]) + ip2in[ips[i]] + "se" + aggregator_ip;
+      aggregator_cmd += ips[i];
+    }
+    aggregator_cmd += "in" + Socket::countField(ip2num[aggregator_ip]) + ip2in[aggregator_ip];
+    if(fallbacks == NULL || partial_cache_blocks <= 0) {
+      retCmds[aggregator_ip] = aggregator_cmd + "rt" + stripe_blks[missing_ID];
+      continue;
+    }
+    string desc = "";
+    for(size_t i = 0; i < ips.size(); ++i) {
+      desc += ips[i] + ip2in[ips[i]] + ip2versions[ips[i]];
+    }
+    if(partial_mirrors.find(aggregator_ip) == partial_mirrors.end()) {
+      partial_mirrors[aggregator_ip] = new PartialSumCache(partial_cache_blocks);
+    }
+    PartialSumCache* mirror = partial_mirrors[aggregator_ip];
+    map<string, long>::const_iterator idIter = partial_ids.find(desc);
+    if(idIter != partial_ids.end() && mirror->touch(idIter->second)) {
+      PartialFallback fallback;
+      fallback.ip = aggregator_ip;
+      for(size_t i = 1; i < ips.size(); ++i) {
+        fallback.cmds[ips[i]] = retCmds[ips[i]];
+        retCmds.erase(ips[i]);
+      }
+      fallback.cmds[aggregator_ip] = aggregator_cmd + "rt" + stripe_blks[missing_ID];
+      (*fallbacks)[idIter->second] = fallback;
+      retCmds[aggregator_ip] = "pr" + PartialSumCache::idField(idIter->second) + stripe_blks[missing_ID];
+      partial_hit_num++;
+      continue;
+    }
+    if(idIter != partial_ids.end()) {
+      partial_descs.erase(idIter->second);
+    }
+    long id = next_partial_id++;
+    partial_ids[desc] = id;
+    partial_descs[id] = desc;
+    long evicted = mirror->insert(id, NULL, 0);
+    if(evicted != 0) {
+      partial_ids.erase(partial_descs[evicted]);
+      partial_descs.erase(evicted);
+    }
+    retCmds[aggregator_ip] = aggregator_cmd + "ca" + PartialSumCache::idField(id) + PartialSumCache::idField(evicted) + "rt" + stripe_blks[missing_ID];
+    partial_miss_num++;
+  }
+  partial_num = racks.size();
+  return retCmds;
+}
+
+void Coordinator::bumpParityVersions(string stripe) {
+  set<pair<unsigned int, string>> tmpBlocks = meta->getStripe2Blocks(stripe);
+  set<pair<unsigned int, string>>::const_iterator tmpBlocksIter;
+  for(tmpBlocksIter = tmpBlocks.begin(); tmpBlocksIter != tmpBlocks.end(); ++tmpBlocksIter) {
+    if((int)(*tmpBlocksIter).first >= k) {
+      blk_versions[(*tmpBlocksIter).second]++;
+    }
+  }
+}
+
+  // the queue is drained round by round, with no pacing, until a round
+  // repairs nothing
+int Coordinator::repairQueuedBlocks() {
+  int repaired_num = 0;
+  double min_time;
+  repair_deferred.clear();
+  while(!repairs->empty()) {
+    int round_num = repairRound(min_time);
+    if(round_num == 0) {
+      break;
+    }
+    repaired_num += round_num;
+  }
+  repair_deferred.clear();
+  cout<<"****** repaired "<<repaired_num<<" blocks, "<<repairs->blockNum()<<" left in the queue"<<endl;
+  return repaired_num;
+}
+
+  // the stripes not repaired by a round are deferred, so that the next rounds
+  // go on with the others; they are retried once a round finds nothing to do.
+  // The pacing counts a block read by each helper node and written by each
+  // target, and a block through the gateway per helper rack of another rack
+int Coordinator::repairRound(double& min_time) {
+  min_time = 0.0;
+  vector<RepairEntry> entries = repairs->top(repair_concurrency + repair_deferred.size());
+  string gw_ip = meta->getGW();
+  vector<RecoveryTask> tasks;
+  map<string, double> node_mb;
+  double gw_mb = 0.0;
+  double blk_mb = (double)chunk_size / (1024 * 1024);
+  int stripe_num = 0;
+  for(size_t e = 0; e < entries.size() && stripe_num < repair_concurrency; ++e) {
+    string stripe = entries[e].stripe;
+    if(repair_deferred.find(stripe) != repair_deferred.end()) {
+      continue;
+    }
+    stripe_num++;
+    if(meta->getStripe2File(stripe) == "Exception") {
+      cout<<"~~~~~~ stripe "<<stripe<<" not in the metadata, dropped from the queue"<<endl;
+      repairs->remove(stripe);
+      continue;
+    }
+    if(!flushBeforeRebuild(set<string>(&stripe, &stripe + 1)).empty()) {
+      repair_deferred.insert(stripe);
+      continue;
+    }
+    bool hot_tag = meta->isFileHot(meta->getStripe2File(stripe));
+    vector<string> names;
+    vector<string> IPs;
+    getStripeLayout(stripe, names, IPs);
+    vector<int> missing_IDs(entries[e].missing_IDs.begin(), entries[e].missing_IDs.end());
+    int* group_of = new int[k];
+    for(int i = 0; i < k; ++i) {
+      group_of[i] = layout->groupOf(i, hot_tag);
+    }
+    vector<Equation> equations;
+    bool recoverable = ec->solveErasures(hot_tag ? l_f : l_c, group_of, missing_IDs, equations);
+    delete[] group_of;
+    if(!recoverable) {
+      cout<<"~~~~~~ cannot repair stripe "<<stripe<<", unrecoverable erasure pattern"<<endl;
+      repair_deferred.insert(stripe);
+      continue;
+    }
+    for(size_t t = 0; t < missing_IDs.size(); ++t) {
+      string target = chooseRepairTarget(&IPs[0], IPs.size(), missing_IDs[t], equations[t], hot_tag, gw_ip);
+      IPs[missing_IDs[t]] = target;
+      repair_load[target]++;
+      node_mb[target] += blk_mb;
+      for(size_t i = 0; i < equations[t].size(); ++i) {
+        repair_load[IPs[equations[t][i].first]]++;
+        node_mb[IPs[equations[t][i].first]] += blk_mb;
+      }
+      gw_mb += crossRackBlocks(&IPs[0], equations[t], target) * blk_mb;
+    }
+    for(size_t t = 0; t < missing_IDs.size(); ++t) {
+      RecoveryTask task;
+      task.stripe = stripe;
+      task.blk_id = missing_IDs[t];
+      task.equation = equations[t];
+      task.names = names;
+      task.IPs = IPs;
+      tasks.push_back(task);
+    }
+  }
+  if(tasks.empty()) {
+    return 0;
+  }
+
+  set<string> written_blks;
+  int repaired_num = runRecoveryTasks(tasks, written_blks);
+  for(size_t t = 0; t < tasks.size(); ++t) {
+    if(written_blks.find(tasks[t].names[tasks[t].blk_id]) == written_blks.end()) {
+      repair_deferred.insert(tasks[t].stripe);
+    }
+  }
+
+  if(repair_node_mbps > 0) {
+    map<string, double>::const_iterator nodeIter;
+    for(nodeIter = node_mb.begin(); nodeIter != node_mb.end(); ++nodeIter) {
+      min_time = max(min_time, nodeIter->second / repair_node_mbps);
+    }
+  }
+  if(repair_gw_mbps > 0) {
+    min_time = max(min_time, gw_mb / repair_gw_mbps);
+  }
+  return repaired_num;
+}
+
+  // a round holds io_lock while it runs, and sleeps out its pacing without it
+void Coordinator::runRepairDaemon() {
+  unique_lock<mutex> lk(io_lock);
+  while(true) {
+    daemon_cv.wait(lk, [&]{return daemon_stop || (fg_waiting == 0 && !repairs->empty());});
+    if(daemon_stop) {
+      break;
+    }
+    struct timeval start_time, end_time;
+    gettimeofday(&start_time, NULL);
+    double min_time;
+    int repaired_num = repairRound(min_time);
+    gettimeofday(&end_time, NULL);
+    double round_time = end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000;
+    if(repaired_num == 0) {
+      repair_deferred.clear();
+      daemon_cv.wait_for(lk, chrono::milliseconds(REPAIR_RETRY_INTERVAL), [&]{return daemon_stop;});
+    } else if(min_time > round_time) {
+      daemon_cv.wait_for(lk, chrono::duration<double>(min_time - round_time), [&]{return daemon_stop;});
+    }
+  }
+}
+
+void Coordinator::enterForeground() {
+  fg_waiting++;
+  io_lock.lock();
+  fg_waiting--;
+}
+
+void Coordinator::leaveForeground() {
+  io_lock.unlock();
+  daemon_cv.notify_all();
+}
+
+void Coordinator::reportRepairQueue() {
+  map<int, int> hist = repairs->toleranceHistogram();
+  cout<<"****** repair queue: "<<repairs->stripeNum()<<" stripes, "<<repairs->blockNum()<<" blocks"<<endl;
+  map<int, int>::const_iterator histIter;
+  for(histIter = hist.begin(); histIter != hist.end(); ++histIter) {
+    cout<<"  "<<histIter->second<<" stripes take "<<histIter->first<<" more failures"<<endl;
+  }
+  fprintf(stderr, "****** repair queue: %d stripes, %d blocks, %ld blocks repaired, drain rate %.3lf blocks/s\n", repairs->stripeNum(), repairs->blockNum(), repairs->repairedNum(), repairs->drainRate());
+}
+
+  // recover a failed DN: every stripe with blocks on it is repaired by the
+  // equations of solveErasures, i.e., within the local group when possible.
+  // The new home of a block is the surviving node of the failed node's rack
+  // (of another rack if none is left) that holds no block of the stripe and
+  // has the least load so far, counting both the blocks it rebuilds and the
+  // blocks it reads as a helper
+double Coordinator::recoverNode(string dn_ip) {
+  dn_ip = conf->normalizeDNIP(dn_ip);
+  string failed_rack = meta->getDN2Rack(dn_ip);
+  set<string> failed_ips;
+  failed_ips.insert(dn_ip);
+  map<string, vector<int>> stripe2missing = collectLostBlocks(failed_ips);
+  if(stripe2missing.empty()) {
+    cout<<"DN [ "<<dn_ip<<" ] holds no block"<<endl;
+    return 0.0;
+  }
+
+    // the nodes of the failed rack first, then the others
+  vector<string> candidates;
+  set<string> rack_dns = meta->getRack2DN(failed_rack);
+  for(set<string>::const_iterator it = rack_dns.begin(); it != rack_dns.end(); ++it) {
+    if(*it != dn_ip) {
+      candidates.push_back(*it);
+    }
+  }
+  size_t in_rack_num = candidates.size();
+  set<string> racks = meta->getRacks();
+  for(set<string>::const_iterator rackIter = racks.begin(); rackIter != racks.end(); ++rackIter) {
+    if(*rackIter == failed_rack) {
+      continue;
+    }
+    set<string> dns = meta->getRack2DN(*rackIter);
+    candidates.insert(candidates.end(), dns.begin(), dns.end());
+  }
+  map<string, int> load;
+  for(size_t i = 0; i < candidates.size(); ++i) {
+    load[candidates[i]] = 0;
+  }
+
+  int failed_num = 0;
+  vector<RecoveryTask> tasks;
+  map<string, vector<int>>::const_iterator missingIter;
+  for(missingIter = stripe2missing.begin(); missingIter != stripe2missing.end(); ++missingIter) {
+    string stripe = missingIter->first;
+    vector<int> missing_IDs = missingIter->second;
+    bool hot_tag = meta->isFileHot(meta->getStripe2File(stripe));
+    vector<string> names;
+    vector<string> IPs;
+    getStripeLayout(stripe, names, IPs);
+    set<string> used_ips(IPs.begin(), IPs.end());
+    int* group_of = new int[k];
+    for(int i = 0; i < k; ++i) {
+      group_of[i] = layout->groupOf(i, hot_tag);
+    }
+    vector<Equation> equations;
+    bool recoverable = ec->solveErasures(hot_tag ? l_f : l_c, group_of, missing_IDs, equations);
+    delete[] group_of;
+    if(!recoverable) {
+      cout<<"~~~~~~ cannot recover stripe "<<stripe<<", unrecoverable erasure pattern"<<endl;
+      failed_num += missing_IDs.size();
+      continue;
+    }
+      // pick the targets, the least loaded first, the failed rack first
+    vector<string> targets;
+    for(size_t t = 0; t < missing_IDs.size(); ++t) {
+      string target = "";
+      for(size_t c = 0; c < candidates.size(); ++c) {
+        // the other racks only if no node of the failed rack is left
+        if(c == in_rack_num && target != "") {
+          break;
+        }
+        if(used_ips.find(candidates[c]) != used_ips.end()) {
+          continue;
+        }
+        if(target == "" || load[candidates[c]] < load[target]) {
+          target = candidates[c];
+        }
+      }
+      if(target == "") {
+        break;
+      }
+      used_ips.insert(target);
+      targets.push_back(target);
+    }
+    if(targets.size() < missing_IDs.size()) {
+      cout<<"~~~~~~ cannot recover stripe "<<stripe<<", no node left to hold its blocks"<<endl;
+      failed_num += missing_IDs.size();
+      continue;
+    }
+    for(size_t t = 0; t < missing_IDs.size(); ++t) {
+      IPs[missing_IDs[t]] = targets[t];
+    }
+    for(size_t t = 0; t < missing_IDs.size(); ++t) {
+      load[targets[t]]++;
+      for(size_t i = 0; i < equations[t].size(); ++i) {
+        load[IPs[equations[t][i].first]]++;
+      }
+      RecoveryTask task;
+      task.stripe = stripe;
+      task.blk_id = missing_IDs[t];
+      task.equation = equations[t];
+      task.names = names;
+      task.IPs = IPs;
+      tasks.push_back(task);
+    }
+  }
+
+  struct timeval start_time, end_time;
+  gettimeofday(&start_time, NULL);
+  set<string> written_blks;
+  int repaired_num = runRecoveryTasks(tasks, written_blks);
+  failed_num += tasks.size() - repaired_num;
+  gettimeofday(&end_time, NULL);
+
+  double recover_time = end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000;
+  map<string, int> target_num;
+  for(size_t t = 0; t < tasks.size(); ++t) {
+    if(written_blks.find(tasks[t].names[tasks[t].blk_id]) != written_blks.end()) {
+      target_num[tasks[t].IPs[tasks[t].blk_id]]++;
+    }
+  }
+  cout<<"****** Finish node recovery !"<<endl;
+  for(map<string, int>::const_iterator it = target_num.begin(); it != target_num.end(); ++it) {
+    cout<<"DN "<<it->first<<" ("<<meta->getDN2Rack(it->first)<<"): "<<it->second<<" blocks rebuilt, load "<<load[it->first]<<endl;
+  }
+  double recovered_mb = (double)repaired_num * chunk_size / (1024 * 1024);
+  fprintf(stderr, "****** node recovery of %s: %.2lf s, %d blocks (%.2lf MB/s), %d not recovered, %d stripes, %d nodes rebuilt blocks\n", dn_ip.c_str(), recover_time, repaired_num, recover_time > 0 ? recovered_mb / recover_time : 0.0, failed_num, (int)stripe2missing.size(), (int)target_num.size());
+  return recover_time;
+}
+
+  // recover a failed rack: the blocks of a stripe in the rack are solved
+  // together by the local and global parity blocks. Each rebuilt block goes to
+  // the least loaded free node of the surviving rack that holds most of its
+  // helpers, as the helpers of each other rack are aggregated before crossing
+  // the gateway, i.e., a block costs one cross-rack transfer per other helper
+  // rack. The helper set is then narrowed greedily: the blocks of a whole
+  // surviving rack are left out (treated as erased) as long as the stripe
+  // stays recoverable and the cross-rack transfers drop
+double Coordinator::recoverRack(string rack) {
+  set<string> failed_ips = meta->getRack2DN(rack);
+  if(failed_ips.empty()) {
+    cout<<"rack [ "<<rack<<" ] not exist"<<endl;
+    return 0.0;
+  }
+  map<string, vector<int>> stripe2missing = collectLostBlocks(failed_ips);
+  if(stripe2missing.empty()) {
+    cout<<"rack [ "<<rack<<" ] holds no block"<<endl;
+    return 0.0;
+  }
+  set<string> racks = meta->getRacks();
+  racks.erase(rack);
+  map<string, int> load;
+  for(set<string>::const_iterator rackIter = racks.begin(); rackIter != racks.end(); ++rackIter) {
+    set<string> dns = meta->getRack2DN(*rackIter);
+    for(set<string>::const_iterator it = dns.begin(); it != dns.end(); ++it) {
+      load[*it] = 0;
+    }
+  }
+
+    // place the blocks of equations[0 ~ missing_num-1], return the cross-rack
+    // transfers, and the targets unless the stripe cannot be placed (-1)
+  auto placeBlocks = [&](vector<int>& missing_IDs, vector<Equation>& equations, vector<string>& IPs, vector<string>& targets) -> int {
+    set<string> used_ips(IPs.begin(), IPs.end());
+    int cost = 0;
+    targets.clear();
+    for(size_t t = 0; t < missing_IDs.size(); ++t) {
+      set<string> helper_racks;
+      for(size_t i = 0; i < equations[t].size(); ++i) {
+        helper_racks.insert(meta->getDN2Rack(IPs[equations[t][i].first]));
+      }
+      string target = "";
+      int target_cost = 0;
+      for(set<string>::const_iterator rackIter = racks.begin(); rackIter != racks.end(); ++rackIter) {
+        int rack_cost = helper_racks.size() - helper_racks.count(*rackIter);
+        set<string> dns = meta->getRack2DN(*rackIter);
+        for(set<string>::const_iterator it = dns.begin(); it != dns.end(); ++it) {
+          if(used_ips.find(*it) != used_ips.end()) {
+            continue;
+          }
+          if(target == "" || rack_cost < target_cost || (rack_cost == target_cost && load[*it] < load[target])) {
+            target = *it;
+            target_cost = rack_cost;
+          }
+        }
+      }
+      if(target == "") {
+        return -1;
+      }
+      used_ips.insert(target);
+      targets.push_back(target);
+      cost += target_cost;
+    }
+    return cost;
+  };
+
+  int failed_num = 0;
+  int base_cost = 0;
+  int planned_cost = 0;
+  map<string, int> stripe2cost;
+  vector<RecoveryTask> tasks;
+  map<string, vector<int>>::const_iterator missingIter;
+  for(missingIter = stripe2missing.begin(); missingIter != stripe2missing.end(); ++missingIter) {
+    string stripe = missingIter->first;
+    vector<int> missing_IDs = missingIter->second;
+    bool hot_tag = meta->isFileHot(meta->getStripe2File(stripe));
+    int l = hot_tag ? l_f : l_c;
+    vector<string> names;
+    vector<string> IPs;
+    getStripeLayout(stripe, names, IPs);
+    int* group_of = new int[k];
+    for(int i = 0; i < k; ++i) {
+      group_of[i] = layout->groupOf(i, hot_tag);
+    }
+    vector<Equation> equations;
+    vector<string> targets;
+    int cost = -1;
+    if(ec->solveErasures(l, group_of, missing_IDs, equations)) {
+      cost = placeBlocks(missing_IDs, equations, IPs, targets);
+    }
+    if(cost < 0) {
+      cout<<"~~~~~~ cannot recover stripe "<<stripe<<", "<<missing_IDs.size()<<" blocks lost"<<endl;
+      failed_num += missing_IDs.size();
+      delete[] group_of;
+      continue;
+    }
+    base_cost += cost;
+      // leave out the blocks of a surviving rack while it saves transfers
+    vector<int> erased = missing_IDs;
+    set<string> left_racks;
+    bool improved = true;
+    while(improved) {
+      improved = false;
+      for(set<string>::const_iterator rackIter = racks.begin(); rackIter != racks.end(); ++rackIter) {
+        if(left_racks.find(*rackIter) != left_racks.end()) {
+          continue;
+        }
+        vector<int> tmp_erased = erased;
+        for(size_t i = 0; i < IPs.size(); ++i) {
+          if(find(erased.begin(), erased.end(), (int)i) == erased.end() && meta->getDN2Rack(IPs[i]) == *rackIter) {
+            tmp_erased.push_back(i);
+          }
+        }
+        vector<Equation> tmp_equations;
+        vector<string> tmp_targets;
+        if(tmp_erased.size() == erased.size() || !ec->solveErasures(l, group_of, tmp_erased, tmp_equations)) {
+          continue;
+        }
+        int tmp_cost = placeBlocks(missing_IDs, tmp_equations, IPs, tmp_targets);
+        if(tmp_cost >= 0 && tmp_cost < cost) {
+          cost = tmp_cost;
+          erased = tmp_erased;
+          equations = tmp_equations;
+          targets = tmp_targets;
+          left_racks.insert(*rackIter);
+          improved = true;
+        }
+      }
+    }
+    delete[] group_of;
+    planned_cost += cost;
+    stripe2cost[stripe] = cost;
+    cout<<"~~~~~~ stripe "<<stripe<<": "<<missing_IDs.size()<<" blocks lost, "<<cost<<" cross-rack blocks planned, "<<left_racks.size()<<" racks left out"<<endl;
+
+    for(size_t t = 0; t < missing_IDs.size(); ++t) {
+      IPs[missing_IDs[t]] = targets[t];
+    }
+    for(size_t t = 0; t < missing_IDs.size(); ++t) {
+      load[targets[t]]++;
+      RecoveryTask task;
+      task.stripe = stripe;
+      task.blk_id = missing_IDs[t];
+      task.equation = equations[t];
+      task.names = names;
+      task.IPs = IPs;
+      tasks.push_back(task);
+    }
+  }
+
+  struct timeval start_time, end_time;
+  gettimeofday(&start_time, NULL);
+  set<string> written_blks;
+  int repaired_num = runRecoveryTasks(tasks, written_blks);
+  failed_num += tasks.size() - repaired_num;
+  gettimeofday(&end_time, NULL);
+
+    // the cross-rack transfers of the blocks actually rebuilt, i.e., the
+    // partial sums relayed by the gateway for them
+  int actual_cost = 0;
+  map<string, int> stripe2actual;
+  for(size_t t = 0; t < tasks.size(); ++t) {
+    string target = tasks[t].IPs[tasks[t].blk_id];
+    if(written_blks.find(tasks[t].names[tasks[t].blk_id]) == written_blks.end()) {
+      continue;
+    }
+    set<string> helper_racks;
+    for(size_t i = 0; i < tasks[t].equation.size(); ++i) {
+      string helper_rack = meta->getDN2Rack(tasks[t].IPs[tasks[t].equation[i].first]);
+      if(helper_rack != meta->getDN2Rack(target)) {
+        helper_racks.insert(helper_rack);
+      }
+    }
+    actual_cost += helper_racks.size();
+    stripe2actual[tasks[t].stripe] += helper_racks.size();
+  }
+  double recover_time = end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000;
+  double blk_mb = (double)chunk_size / (1024 * 1024);
+  cout<<"****** Finish rack recovery !"<<endl;
+  for(map<string, int>::const_iterator it = stripe2cost.begin(); it != stripe2cost.end(); ++it) {
+    cout<<"stripe "<<it->first<<": expected "<<it->second * blk_mb<<" MB, actual "<<stripe2actual[it->first] * blk_mb<<" MB cross-rack"<<endl;
+  }
+  fprintf(stderr, "****** rack recovery of %s: %.2lf s, %d blocks (%.2lf MB/s), %d not recovered, %d stripes\n", rack.c_str(), recover_time, repaired_num, recover_time > 0 ? repaired_num * blk_mb / recover_time : 0.0, failed_num, (int)stripe2missing.size());
+  fprintf(stderr, "****** cross-rack: %.2lf MB expected (%.2lf MB without helper selection), %.2lf MB actual\n", planned_cost * blk_mb, base_cost * blk_mb, actual_cost * blk_mb);
+  return recover_time;
+}
+
+map<string, vector<int>> Coordinator::collectLostBlocks(set<string>& failed_ips) {
+  map<string, vector<int>> stripe2missing;
+  for(set<string>::const_iterator ipIter = failed_ips.begin(); ipIter != failed_ips.end(); ++ipIter) {
+    set<string> lost_blks = meta->getDN2Blocks(*ipIter);
+    set<string>::const_iterator lostIter;
+    for(lostIter = lost_blks.begin(); lostIter != lost_blks.end(); ++lostIter) {
+      string stripe = meta->getBlock2Stripe(*lostIter);
+      int blk_id = meta->getBlockIndexInStripe(*lostIter);
+      if(stripe != "Exception" && blk_id < 0) {
+        set<pair<unsigned int, string>> reserved_blks = meta->getStripe2ReservedBlocks(stripe);
+        set<pair<unsigned int, string>>::const_iterator reservedIter;
+        for(reservedIter = reserved_blks.begin(); reservedIter != reserved_blks.end(); ++reservedIter) {
+          if((*reservedIter).second == *lostIter) {
+            break;
+          }
+        }
+        if(reservedIter != reserved_blks.end()) {
+          cout<<"~~~~~~ reserved block "<<*lostIter<<" is left to the next downcode"<<endl;
+          lost_reserved.insert(*lostIter);
+          continue;
+        }
+      }
+      if(stripe == "Exception" || blk_id < 0 || meta->isFileReplicated(meta->getStripe2File(stripe))) {
+        cout<<"~~~~~~ skip block "<<*lostIter<<", not in an encoded stripe"<<endl;
+        continue;
+      }
+      stripe2missing[stripe].push_back(blk_id);
+        // !!! update stripe metadata, and queue the block until it is rebuilt
+      meta->markStripeUnderRedundant(stripe);
+      repairs->push(stripe, blk_id, meta->isFileHot(meta->getStripe2File(stripe)), false);
+    }
+  }
+  // the stripes are rebuilt from their parity blocks, patched first
+  set<string> stripes;
+  map<string, vector<int>>::const_iterator missingIter;
+  for(missingIter = stripe2missing.begin(); missingIter != stripe2missing.end(); ++missingIter) {
+    stripes.insert(missingIter->first);
+  }
+  set<string> unflushed = flushBeforeRebuild(stripes);
+  for(set<string>::const_iterator it = unflushed.begin(); it != unflushed.end(); ++it) {
+    stripe2missing.erase(*it);
+  }
+  return stripe2missing;
+}
+
+void Coordinator::getStripeLayout(string stripe, vector<string>& names, vector<string>& IPs) {
+  bool hot_tag = meta->isFileHot(meta->getStripe2File(stripe));
+  int stripe_len = hot_tag ? k + l_f + g : k + l_c + g;
+  names.assign(stripe_len, "");
+  IPs.assign(stripe_len, "");
+  set<pair<unsigned int, string>> tmpBlocks = meta->getStripe2Blocks(stripe);
+  set<pair<unsigned int, string>>::const_iterator tmpBlocksIter;
+  for(tmpBlocksIter = tmpBlocks.begin(); tmpBlocksIter != tmpBlocks.end(); ++tmpBlocksIter) {
+    names[(*tmpBlocksIter).first] = (*tmpBlocksIter).second;
+    IPs[(*tmpBlocksIter).first] = meta->getBlock2IP((*tmpBlocksIter).second);
+  }
+}
+
+int Coordinator::runRecoveryTasks(vector<RecoveryTask>& tasks, set<string>& written_blks) {
+  string gw_ip = meta->getGW();
+  int repaired_num = 0;
+  size_t next = 0;
+  while(next < tasks.size()) {
+    // the tasks of recovery_batch stripes
+    vector<int> blk_ids;
+    vector<Equation> equations;
+    vector<vector<string>> blk_names;
+    vector<vector<string>> blk_IPs;
+    map<string, int> remaining_num;
+    size_t first = next;
+    while(next < tasks.size() && (remaining_num.find(tasks[next].stripe) != remaining_num.end() || (int)remaining_num.size() < recovery_batch)) {
+      blk_ids.push_back(tasks[next].blk_id);
+      equations.push_back(tasks[next].equation);
+      blk_names.push_back(tasks[next].names);
+      blk_IPs.push_back(tasks[next].IPs);
+      remaining_num[tasks[next].stripe]++;
+      next++;
+    }
+    set<string> batch_written;
+    encodeParitiesOnDN(blk_ids, equations, blk_names, blk_IPs, gw_ip, &batch_written);
+    map<string, vector<int>> stripe2repaired;
+    for(size_t t = first; t < next; ++t) {
+      string blk = tasks[t].names[tasks[t].blk_id];
+      if(batch_written.find(blk) == batch_written.end()) {
+        cout<<"~~~~~~ block "<<blk<<" not recovered"<<endl;
+        continue;
+      }
+        // !!! update block metadata
+      meta->moveBlkIP(blk, tasks[t].IPs[tasks[t].blk_id]);
+      written_blks.insert(blk);
+      stripe2repaired[tasks[t].stripe].push_back(tasks[t].blk_id);
+      repaired_num++;
+      if(--remaining_num[tasks[t].stripe] == 0) {
+          // !!! update stripe metadata
+        meta->markStripeRedundant(tasks[t].stripe);
+      }
+    }
+      // the rebuilt blocks leave the repair queue, the others stay queued
+    map<string, vector<int>>::const_iterator repairedIter;
+    for(repairedIter = stripe2repaired.begin(); repairedIter != stripe2repaired.end(); ++repairedIter) {
+      repairs->repaired(repairedIter->first, repairedIter->second);
+    }
+  }
+  return repaired_num;
+}
+
+
+  // generate the commands of repairing a block by an equation, planned by the
+  // RepairPlanner for the current locations of the blocks. Return the commands
+  // keyed by the node ip, and the gateway relay, if any, in gw_cmd
+map<string, string> Coordinator::generateMultiDecodeCmd(string stripe_blks[], string blk_IPs[], int missing_ID, const Equation& equation, string gw_ip, char* gw_cmd) {
+  string gw_round;
+  map<string, string> retCmds = planner->plan(stripe_blks, blk_IPs, missing_ID, equation, gw_ip, gw_round);
+  if(gw_round != "") {
+    strcpy(gw_cmd, ("ga" + Socket::countField(1) + gw_round).c_str());
+  }
+  return retCmds;
+}
+
+  // the helpers of each other rack form a chain ending at the gateway, which
+  // merges the chains into a single stream for the rack of the missing block;
+  // there the stream goes along the helpers in the rack, and ends at the node
+  // of the missing block, which adds its own blocks and stores the sum, e.g.,
+  //   D4 -> D5 -> gw, D6 -> gw, gw -> D1 -> D2 -> D0 (missing)
+map<string, string> Coordinator::generateChainRepairCmds(string stripe_blks[], string blk_IPs[], int missing_ID, const Equation& equation, string gw_ip) {
+  map<string, string> retCmds;
+  string missing_block_ip = blk_IPs[missing_ID];
+  string missing_block_rack = meta->getDN2Rack(missing_block_ip);
+
+  // "in" part of each helper node, i.e., its coefficients and blocks
+  vector<string> helper_ips;
+  map<string, string> ip2in;
+  map<string, int> ip2num;
+  char coef[4];
+  for(size_t i = 0; i < equation.size(); ++i) {
+    string tmp_ip = blk_IPs[equation[i].first];
+    if(ip2in.find(tmp_ip) == ip2in.end()) {
+      helper_ips.push_back(tmp_ip);
+      ip2in[tmp_ip] = "";
+      ip2num[tmp_ip] = 0;
+    }
+    sprintf(coef, "%03d", equation[i].second);
+    ip2in[tmp_ip] += string(coef) + stripe_blks[equation[i].first];
+    ip2num[tmp_ip]++;
+  }
+
+  vector<string> in_rack_ips;
+  vector<string> other_racks;
+  map<string, vector<string>> rack2ips;
+  for(size_t i = 0; i < helper_ips.size(); ++i) {
+    if(helper_ips[i] == missing_block_ip) {
+      continue;
+    }
+    string tmp_rack = meta->getDN2Rack(helper_ips[i]);
+    if(tmp_rack == missing_block_rack) {
+      in_rack_ips.push_back(helper_ips[i]);
+    } else {
+      if(rack2ips.find(tmp_rack) == rack2ips.end()) {
+        other_racks.push_back(tmp_rack);
+      }
+      rack2ips[tmp_rack].push_back(helper_ips[i]);
+    }
+  }
+
+  // the chain in the rack of the missing block, and its first hop
+  in_rack_ips.push_back(missing_block_ip);
+  string first_hop = in_rack_ips[0];
+
+  // chains of the other racks, merged by the gateway
+  for(size_t r = 0; r < other_racks.size(); ++r) {
+    vector<string>& ips = rack2ips[other_racks[r]];
+    for(size_t i = 0; i < ips.size(); ++i) {
+      string next_ip = (i + 1 < ips.size()) ? ips[i + 1] : gw_ip;
+      retCmds[ips[i]] = "chwa" + Socket::countField(i == 0 ? 0 : 1) + "in" + Socket::countField(ip2num[ips[i]]) + ip2in[ips[i]] + "se" + next_ip;
+    }
+  }
+  if(other_racks.size() != 0) {
+    retCmds[gw_ip] = "chwa" + Socket::countField(other_racks.size()) + "in" + Socket::countField(0) + "se" + first_hop;
+  }
+
+  for(size_t i = 0; i < in_rack_ips.size(); ++i) {
+    int upstream_num = (i == 0) ? (other_racks.size() != 0 ? 1 : 0) : 1;
+    string cmd = "chwa" + Socket::countField(upstream_num) + "in" + Socket::countField(ip2num[in_rack_ips[i]]) + ip2in[in_rack_ips[i]];
+    if(i + 1 < in_rack_ips.size()) {
+      cmd += "se" + in_rack_ips[i + 1];
+    } else {
+      cmd += "reco" + stripe_blks[missing_ID];
+    }
+    retCmds[in_rack_ips[i]] = cmd;
+  }
+  return retCmds;
+}
+
+  // the block is cut into packet-aligned slices, slice 0 for the node of the
+  // missing block and one for each other slice node; the helpers in the rack of
+  // the missing block scatter the slices of their partial sums to the slice
+  // nodes ("sc"), the aggregators of the other racks send theirs to the
+  // gateway, which sums them up and scatters the sum once; each slice node
+  // streams its slice to the node of the missing block ("sl"), which stores
+  // the block ("sm"). The receiving is spread over the slice nodes, and the
+  // node of the missing block takes in a single block
+map<string, string> Coordinator::generateSlicedRepairCmds(string stripe_blks[], string blk_IPs[], int stripe_len, int missing_ID, const Equation& equation, string gw_ip) {
+  map<string, string> retCmds;
+  string missing_block_ip = blk_IPs[missing_ID];
+  string missing_block_rack = meta->getDN2Rack(missing_block_ip);
+
+  // "in" part of each helper node, i.e., its coefficients and blocks
+  vector<string> helper_ips;
+  map<string, string> ip2in;
+  map<string, int> ip2num;
+  char coef[4];
+  for(size_t i = 0; i < equation.size(); ++i) {
+    string tmp_ip = blk_IPs[equation[i].first];
+    if(ip2in.find(tmp_ip) == ip2in.end()) {
+      helper_ips.push_back(tmp_ip);
+      ip2in[tmp_ip] = "";
+      ip2num[tmp_ip] = 0;
+    }
+    sprintf(coef, "%03d", equation[i].second);
+    ip2in[tmp_ip] += string(coef) + stripe_blks[equation[i].first];
+    ip2num[tmp_ip]++;
+  }
+  // the node of the missing block only receives, its slice is summed up
+  // from the others
+  if(ip2in.find(missing_block_ip) != ip2in.end()) {
+    return retCmds;
+  }
+
+  // slice nodes, which hold no block of the stripe
+  set<string> stripe_ips(blk_IPs, blk_IPs + stripe_len);
+  vector<string> slice_ips;
+  slice_ips.push_back(missing_block_ip);
+  set<string> rack_dns = meta->getRack2DN(missing_block_rack);
+  for(set<string>::const_iterator it = rack_dns.begin(); it != rack_dns.end() && (int)slice_ips.size() < repair_slices; ++it) {
+    if(stripe_ips.find(*it) == stripe_ips.end() && *it != gw_ip) {
+      slice_ips.push_back(*it);
+    }
+  }
+  int slice_num = slice_ips.size();
+  if(slice_num < 2) {
+    return retCmds;
+  }
+  int packet_num = chunk_size / packet_size;
+  vector<size_t> slice_offsets;
+  vector<size_t> slice_lens;
+  string scatter = "sc" + Socket::countField(slice_num);
+  char fields[2 * RANGE_FIELD_LEN + 1];
+  for(int j = 0; j < slice_num; ++j) {
+    int first_packet = packet_num * j / slice_num;
+    int end_packet = packet_num * (j + 1) / slice_num;
+    slice_offsets.push_back((size_t)first_packet * packet_size);
+    slice_lens.push_back((size_t)(end_packet - first_packet) * packet_size);
+    sprintf(fields, "%010zu", slice_lens[j]);
+    scatter += slice_ips[j] + string(fields);
+  }
+
+  vector<string> in_rack_ips;
+  vector<string> other_racks;
+  map<string, vector<string>> rack2ips;
+  for(size_t i = 0; i < helper_ips.size(); ++i) {
+    string tmp_rack = meta->getDN2Rack(helper_ips[i]);
+    if(tmp_rack == missing_block_rack) {
+      in_rack_ips.push_back(helper_ips[i]);
+    } else {
+      if(rack2ips.find(tmp_rack) == rack2ips.end()) {
+        other_racks.push_back(tmp_rack);
+      }
+      rack2ips[tmp_rack].push_back(helper_ips[i]);
+    }
+  }
+
+  // helper nodes in other racks, aggregated as by generateMultiDecodeCmd
+  if(other_racks.size() != 0) {
+    string gw_cmd = "mdwa" + Socket::countField(other_racks.size()) + "blk";
+    for(size_t r = 0; r < other_racks.size(); ++r) {
+      vector<string>& ips = rack2ips[other_racks[r]];
+      string aggregator_ip = ips[0];
+      string aggregator_cmd = "mdwa" + Socket::countField(ips.size() - 1) + "blk";
+      for(size_t i = 1; i < ips.size(); ++i) {
+        retCmds[ips[i]] = "mdwa" + Socket::countField(0) + "blkin" + Socket::countField(ip2num[ips[i]]) + ip2in[ips[i]] + "se" + aggregator_ip;
+        aggregator_cmd += ips[i];
+      }
+      aggregator_cmd += "in" + Socket::countField(ip2num[aggregator_ip]) + ip2in[aggregator_ip] + "se" + gw_ip;
+      retCmds[aggregator_ip] = aggregator_cmd;
+      gw_cmd += aggregator_ip;
+    }
+    retCmds[gw_ip] = gw_cmd + "in" + Socket::countField(0) + scatter;
+  }
+
+  // helper nodes in the rack of the missing block
+  for(size_t i = 0; i < in_rack_ips.size(); ++i) {
+    retCmds[in_rack_ips[i]] = "mdwa" + Socket::countField(0) + "blkin" + Socket::countField(ip2num[in_rack_ips[i]]) + ip2in[in_rack_ips[i]] + scatter;
+  }
+
+  // slice nodes, the gateway is waited last
+  for(int j = 0; j < slice_num; ++j) {
+    sprintf(fields, "%010zu%010zu", slice_offsets[j], slice_lens[j]);
+    string cmd = "mr" + string(fields) + "mdwa" + Socket::countField(in_rack_ips.size() + (other_racks.size() != 0 ? 1 : 0)) + "blk";
+    for(size_t i = 0; i < in_rack_ips.size(); ++i) {
+      cmd += in_rack_ips[i];
+    }
+    if(other_racks.size() != 0) {
+      cmd += gw_ip;
+    }
+    cmd += "in" + Socket::countField(0);
+    if(j == 0) {
+      cmd += "sm" + Socket::countField(slice_num - 1) + stripe_blks[missing_ID];
+    } else {
+      cmd += "sl" + missing_block_ip;
+    }
+    retCmds[slice_ips[j]] = cmd;
+  }
+  return retCmds;
+}
+
+  // the node ids are kept with the blocks in the metadata, so a signature
+  // takes no lookup by ip
+string Coordinator::placementSignature(const int blk_nodes[], int len) {
+  int racks[len];
+  for(int i = 0; i < len; ++i) {
+    racks[i] = meta->getDNRackID(blk_nodes[i]);
+  }
+  return PlanCache::signature(blk_nodes, racks, len);
+}
+
+  // the planner takes the least loaded helpers as aggregators, so a repair
+  // template holds for the helpers loaded in the same order: their loads are
+  // ranked, equal loads sharing a rank
+string Coordinator::loadSignature(const int blk_nodes[], const Equation& equation) {
+  vector<int> loads;
+  for(size_t i = 0; i < equation.size(); ++i) {
+    loads.push_back(planner->recvLoad(blk_nodes[equation[i].first]));
+  }
+  vector<int> sorted_loads(loads);
+  sort(sorted_loads.begin(), sorted_loads.end());
+  sorted_loads.erase(unique(sorted_loads.begin(), sorted_loads.end()), sorted_loads.end());
+  string sig(loads.size(), ' ');
+  for(size_t i = 0; i < loads.size(); ++i) {
+    sig[i] = (char)('0' + (lower_bound(sorted_loads.begin(), sorted_loads.end(), loads[i]) - sorted_loads.begin()));
+  }
+  return sig;
+}
+
+  // a fast local parity block is the XOR of its data blocks, and the compact
+  // one of its compact group the XOR of all the fast ones
+vector<Equation> Coordinator::reservedEquations(int reserved_id) {
+  int fast_id = reserved_id - k;
+  int compact_id = layout->compactGroupOfFast(fast_id);
+  vector<Equation> equations(2);
+  int start = layout->fastGroupStart(fast_id);
+  for(int i = start; i < start + layout->fastGroupSize(fast_id); ++i) {
+    equations[0].push_back(make_pair(i, (unsigned char)1));
+  }
+  equations[1].push_back(make_pair(k + compact_id, (unsigned char)1));
+  start = layout->compactGroupStart(compact_id);
+  for(int i = start; i < start + layout->compactGroupSize(compact_id); ++i) {
+    if(layout->fastGroupOf(i) != fast_id) {
+      equations[1].push_back(make_pair(i, (unsigned char)1));
+    }
+  }
+  return equations;
+}
+
+  // the reserved block is appended to the stripe, so that the planner plans
+  // its repair as that of a block of the stripe
+bool Coordinator::repairReservedBlock(string stripe_blks[], string blk_IPs[], string reserved_blks[], string reserved_IPs[], int reserved_id, string gw_ip) {
+  int stripe_len = k + l_c + g;
+  string blk = reserved_blks[reserved_id];
+  string origin = reserved_IPs[reserved_id];
+  string origin_rack = meta->getDN2Rack(origin);
+  vector<Equation> equations = reservedEquations(reserved_id);
+
+    // a block lost with its node goes to a node holding no block of the
+    // stripe, of the same rack if possible
+  vector<string> candidates;
+  if(lost_reserved.find(blk) == lost_reserved.end()) {
+    candidates.push_back(origin);
+  } else {
+    set<string> used_ips(blk_IPs, blk_IPs + stripe_len);
+    for(int i = k; i < k + l_f; ++i) {
+      used_ips.insert(reserved_IPs[i]);
+    }
+    set<string> racks = meta->getRacks();
+    for(set<string>::const_iterator rackIter = racks.begin(); rackIter != racks.end(); ++rackIter) {
+      set<string> dns = meta->getRack2DN(*rackIter);
+      for(set<string>::const_iterator it = dns.begin(); it != dns.end(); ++it) {
+        if(used_ips.find(*it) == used_ips.end() && *it != gw_ip) {
+          candidates.push_back(*it);
+        }
+      }
+    }
+  }
+  string target = "";
+  int target_eq = 0;
+  int target_out = 0;
+  int target_cost = 0;
+  for(size_t c = 0; c < candidates.size(); ++c) {
+    int out = meta->getDN2Rack(candidates[c]) != origin_rack ? 1 : 0;
+    for(size_t e = 0; e < equations.size(); ++e) {
+      int cost = crossRackBlocks(blk_IPs, equations[e], candidates[c]);
+      bool better = target == "" || out < target_out || (out == target_out && cost < target_cost);
+      if(!better && out == target_out && cost == target_cost) {
+        if(candidates[c] == target) {
+          better = equations[e].size() < equations[target_eq].size();
+        } else {
+          better = repair_load[candidates[c]] < repair_load[target];
+        }
+      }
+      if(better) {
+        target = candidates[c];
+        target_eq = e;
+        target_out = out;
+        target_cost = cost;
+      }
+    }
+  }
+  if(target == "") {
+    cout<<"~~~~~~ no node left to hold reserved block "<<blk<<endl;
+    return false;
+  }
+
+  string ext_blks[stripe_len + 1];
+  string ext_IPs[stripe_len + 1];
+  for(int i = 0; i < stripe_len; ++i) {
+    ext_blks[i] = stripe_blks[i];
+    ext_IPs[i] = blk_IPs[i];
+  }
+  ext_blks[stripe_len] = blk;
+  ext_IPs[stripe_len] = target;
+  string gw_round;
+  map<string, string> cmds = planner->plan(ext_blks, ext_IPs, stripe_len, equations[target_eq], gw_ip, gw_round);
+  if(cmds.empty()) {
+    cout<<"~~~~~~ no repair plan for reserved block "<<blk<<endl;
+    return false;
+  }
+  cout<<"~~~~~~ reserved block "<<blk<<" is rebuilt on "<<target<<" from "<<(target_eq == 0 ? "its fast group" : "the compact local parity block")<<", "<<equations[target_eq].size()<<" blocks, "<<target_cost<<" across racks"<<endl;
+  map<string, string>::const_iterator cmdsIter;
+  for(cmdsIter = cmds.begin(); cmdsIter != cmds.end(); ++cmdsIter) {
+    sendCmd(cmdsIter->second, cmdsIter->first);
+    cout<<"~~~~~~ send cmd to "<<cmdsIter->first<<" :"<<cmdsIter->second<<endl;
+  }
+  if(gw_round != "") {
+    sendCmd("ga" + Socket::countField(1) + gw_round, gw_ip);
+  }
+  repair_load[target]++;
+  for(size_t i = 0; i < equations[target_eq].size(); ++i) {
+    repair_load[blk_IPs[equations[target_eq][i].first]]++;
+  }
+
+  char* ack = new char[1024];
+  recvAck(ack);
+  bool repaired = strncmp(ack, "fi_deco", 7) == 0 && string(ack + 7) == blk;
+  delete[] ack;
+  if(!repaired) {
+    cout<<"~~~~~~ reserved block "<<blk<<" not rebuilt"<<endl;
+    return false;
+  }
+  if(target != origin) {
+      // !!! update block metadata
+    meta->relocateBlkIP(blk, origin, target);
+    reserved_IPs[reserved_id] = target;
+  }
+  lost_reserved.erase(blk);
+  return true;
+}
+
+  // single-block repairs on a placement of decide_location, each rebuilt at
+  // its node; a reserved block by the cheaper of its equations
+void Coordinator::reportRepairCostByType(FILE* fpr) {
+  int hot_len = k + l_f + g;
+  int cold_len = k + l_c + g;
+  map<int, string> blk_id2IP = decide_location();
+  string hot_IPs[hot_len];
+  string cold_IPs[cold_len];
+  for(int i = 0; i < hot_len; ++i) {
+    hot_IPs[i] = blk_id2IP[i];
+  }
+  for(int i = 0; i < k; ++i) {
+    cold_IPs[i] = hot_IPs[i];
+  }
+  for(int c = 0; c < l_c; ++c) {
+    cold_IPs[k + c] = hot_IPs[k + layout->compactFirstFast(c)];
+  }
+  for(int j = 0; j < g; ++j) {
+    cold_IPs[k + l_c + j] = hot_IPs[k + l_f + j];
+  }
+
+    // [data, local parity, global parity] of the fast and the compact code
+  double cost[2][3] = {{0, 0, 0}, {0, 0, 0}};
+  for(int h = 0; h < 2; ++h) {
+    bool hot = (h == 0);
+    int l = hot ? l_f : l_c;
+    string* IPs = hot ? hot_IPs : cold_IPs;
+    int* group_of = new int[k];
+    for(int i = 0; i < k; ++i) {
+      group_of[i] = layout->groupOf(i, hot);
+    }
+    for(int id = 0; id < k + l + g; ++id) {
+      vector<int> missing_IDs(1, id);
+      vector<Equation> equations;
+      if(!ec->solveErasures(l, group_of, missing_IDs, equations)) {
+        continue;
       }
+      int type = id < k ? 0 : (id < k + l ? 1 : 2);
+      cost[h][type] += crossRackBlocks(IPs, equations[0], IPs[id]);
     }
-    retCmd += waited_gw_ip_concated_str;
-    retCmd += "reco";
+    delete[] group_of;
+    cost[h][0] /= k;
+    cost[h][1] /= l;
+    cost[h][2] /= g;
+  }
+  double reserved_cost = 0;
+  int reserved_num = 0;
+  for(int f = 0; f < l_f; ++f) {
+    if(layout->isHeadFast(f)) {
+      continue;
+    }
+    vector<Equation> equations = reservedEquations(k + f);
+    int eq_cost[2];
+    for(int e = 0; e < 2; ++e) {
+      eq_cost[e] = crossRackBlocks(cold_IPs, equations[e], hot_IPs[k + f]);
+    }
+    reserved_cost += eq_cost[0] < eq_cost[1] ? eq_cost[0] : eq_cost[1];
+    reserved_num++;
+  }
+  if(reserved_num > 0) {
+    reserved_cost /= reserved_num;
+  }
 
-    if(num_wait_other_racks != 0) {
-      // gateway command
-      string gw_cmd_str = "ga";
-      gw_cmd_str += to_string(1);
-      gw_cmd_str += "wa";
-      gw_cmd_str += to_string(num_wait_other_racks);
-      gw_cmd_str += gw_waited_block_ip_concated_str;
-      gw_cmd_str += "se";
-      gw_cmd_str += missing_block_ip;
-      strcpy(gw_cmd, (char*)gw_cmd_str.c_str());
+  cout<<"repair by block type: fast data "<<cost[0][0]<<", fast local parity "<<cost[0][1]<<", fast global parity "<<cost[0][2]<<", compact data "<<cost[1][0]<<", compact local parity "<<cost[1][1]<<", compact global parity "<<cost[1][2]<<", reserved "<<reserved_cost<<endl;
+  if(fpr != NULL) {
+    fprintf(fpr, "^^^^^^ repair by block type (place_method %d): fast data %.2lf, fast local parity %.2lf, fast global parity %.2lf, compact data %.2lf, compact local parity %.2lf, compact global parity %.2lf, reserved %.2lf\n ", place_method, cost[0][0], cost[0][1], cost[0][2], cost[1][0], cost[1][1], cost[1][2], reserved_cost);
+  }
+}
+
+  // the generators run on the slots of the blocks, each block being in
+  // a node of its own, which they do not compare
+PlanTemplate* Coordinator::compileUpcodePlan(string key, string gw_ip) {
+  int stripe_len = k + l_f + g;
+  string slot_blks[stripe_len];
+  string slot_IPs[stripe_len];
+  for(int i = 0; i < stripe_len; ++i) {
+    slot_blks[i] = PlanCache::blockSlot(i);
+    slot_IPs[i] = PlanCache::nodeSlot(i);
+  }
+  PlanTemplate plan;
+  char* gw_cmd = new char[400];
+  gw_cmd[0] = '\0';
+  for(int idx = k; idx < k + l_f; ++idx) {
+    string cmd = generateUpcodeCmd(slot_blks, slot_IPs, idx, gw_ip, gw_cmd);
+    if(cmd != "") {
+      plan.cmds.push_back(make_pair(slot_IPs[idx], cmd));
     }
+  }
+  plan.gw_cmd = string(gw_cmd);
+  delete[] gw_cmd;
+  return plans->insert(key, plan);
+}
 
-  } else {
-    if(rack == missing_block_rack) {
-      // command for a block residing in the missing block's rack, but not 
-      // the missing block, e.g., [D1 in Fig.4 in paper]
-      // "se block missing_block_ip"
-      retCmd += "se";
-      retCmd += block;
-      retCmd += missing_block_ip;
-    } else {
-      int num_blk_this_rack = 0;
-      int smallest_idx_this_rack = blk_id;
-      set<int> idx_this_rack;
-      idx_this_rack.clear();
-      string tmp_blk;
-      string tmp_ip;
-      string tmp_rack;
-      // iterate over the data blocks
-      for(int idx = startIdx; idx <= endIdx; ++idx) {
-        tmp_blk = stripe_blks[idx];
-        tmp_ip = blk_IPs[idx];
-        tmp_rack = meta->getDN2Rack(tmp_ip);
-        if(tmp_rack == rack) {
-          num_blk_this_rack++;
-          if(idx < smallest_idx_this_rack) {
-            smallest_idx_this_rack = idx;
-          }
-          idx_this_rack.insert(idx);
-        }
-      }
-      // consider the local parity block
-      tmp_blk = stripe_blks[localParityIdx];
-      tmp_ip = blk_IPs[localParityIdx];
-      tmp_rack = meta->getDN2Rack(tmp_ip);
-      if(tmp_rack == rack) {
-        num_blk_this_rack++;
-        idx_this_rack.insert(localParityIdx);
-      }
+PlanTemplate* Coordinator::compileDowncodePlan(string key, string gw_ip) {
+  int stripe_len = k + l_c + g;
+  int reserved_len = k + l_f;
+  string slot_blks[stripe_len];
+  string slot_IPs[stripe_len];
+  string slot_reserved_blks[reserved_len];
+  string slot_reserved_IPs[reserved_len];
+  for(int i = 0; i < stripe_len; ++i) {
+    slot_blks[i] = PlanCache::blockSlot(i);
+    slot_IPs[i] = PlanCache::nodeSlot(i);
+  }
+  for(int i = 0; i < reserved_len; ++i) {
+    slot_reserved_blks[i] = PlanCache::reservedBlockSlot(i);
+    slot_reserved_IPs[i] = PlanCache::reservedNodeSlot(i);
+  }
+  PlanTemplate plan;
+  char* gw_cmd = new char[400];
+  gw_cmd[0] = '\0';
+  char* gw_cmd_further4flat = new char[100];
+  gw_cmd_further4flat[0] = '\0';
+  for(int i = 0; i < k + l_c; ++i) {
+    string cmd = generateDowncodeCmd(slot_blks, slot_IPs, slot_reserved_blks, slot_reserved_IPs, i, -1, gw_ip, gw_cmd, gw_cmd_further4flat);
+    if(cmd != "") {
+      plan.cmds.push_back(make_pair(slot_IPs[i], cmd));
+    }
+  }
+  for(int i = k; i < k + l_f; ++i) {
+    string cmd = generateDowncodeCmd(slot_blks, slot_IPs, slot_reserved_blks, slot_reserved_IPs, -1, i, gw_ip, gw_cmd, gw_cmd_further4flat);
+    if(cmd != "") {
+      plan.cmds.push_back(make_pair(slot_reserved_IPs[i], cmd));
+    }
+  }
+  if(gw_cmd[0] != '\0') {
+    plan.gw_cmd = string(gw_cmd) + string(gw_cmd_further4flat);
+  }
+  delete[] gw_cmd;
+  delete[] gw_cmd_further4flat;
+  return plans->insert(key, plan);
+}
 
-      if(num_blk_this_rack == 1) {
-        retCmd += "se";
-        retCmd += block;
-        retCmd += gw_ip;
-      } else {
-        if(smallest_idx_this_rack < blk_id) {
-          // e.g., [D3/D5 in Fig.4 in paper]
-          tmp_ip = blk_IPs[smallest_idx_this_rack];
-          retCmd += "se";
-          retCmd += block;
-          retCmd += tmp_ip;
-        } else {
-          // e.g., [D2/D4 in Fig.4 in paper]
-          retCmd += "wa";
-          retCmd += to_string(num_blk_this_rack - 1);
-          retCmd += "blk";
-          set<int>::const_iterator idx_this_rack_iter;
-          for(idx_this_rack_iter = idx_this_rack.begin(); idx_this_rack_iter != idx_this_rack.end(); ++idx_this_rack_iter) {
-            if((*idx_this_rack_iter) != blk_id) {
-              tmp_ip = blk_IPs[*idx_this_rack_iter];
-              retCmd += tmp_ip;
-            }
-          }
-          retCmd += "se";
-          retCmd += block;
-          retCmd += gw_ip;
-        }
-      }
+  // the planner compares the nodes, their racks and their loads, so the blocks
+  // of a node share its slot, that of its first block
+PlanTemplate* Coordinator::compileRepairPlan(string key, string blk_IPs[], const int blk_nodes[], int stripe_len, int missing_ID, const Equation& equation, string gw_ip) {
+  string slot_blks[stripe_len];
+  string slot_IPs[stripe_len];
+  map<string, string> first_slot;
+  map<string, string> rack_of;
+  map<string, int> load_of;
+  for(int i = 0; i < stripe_len; ++i) {
+    slot_blks[i] = PlanCache::blockSlot(i);
+    if(first_slot.find(blk_IPs[i]) == first_slot.end()) {
+      first_slot[blk_IPs[i]] = PlanCache::nodeSlot(i);
     }
+    slot_IPs[i] = first_slot[blk_IPs[i]];
+    rack_of[slot_IPs[i]] = meta->getDN2Rack(blk_IPs[i]);
+    load_of[slot_IPs[i]] = planner->recvLoad(blk_nodes[i]);
   }
-  return retCmd;
+  PlanTemplate plan;
+  string gw_round;
+  map<string, string> cmds = planner->plan(slot_blks, slot_IPs, missing_ID, equation, gw_ip, gw_round, &rack_of, &load_of);
+  map<string, string>::const_iterator cmdsIter;
+  for(cmdsIter = cmds.begin(); cmdsIter != cmds.end(); ++cmdsIter) {
+    plan.cmds.push_back(make_pair(cmdsIter->first, cmdsIter->second));
+  }
+  if(gw_round != "") {
+    plan.gw_cmd = "ga" + Socket::countField(1) + gw_round;
+  }
+  return plans->insert(key, plan);
 }
 
   /* * * * * * * * * * * * * * * * * * * *
@@ -893,27 +4044,39 @@ string Coordinator::generateDecodeCmd(string stripe_blks[], string blk_IPs[], in
    * * * * * * * * * * * * * * * * * * * */
 double Coordinator::upcodeFile(string file){
   double upcode_time = 0.0;
+  // the parity blocks must reflect the pending overwrites
+  flushUpdates();
   set<string> stripes = meta->getFile2Stripes(file);
   string tmp_stripe;
   set<pair<unsigned int, string>> tmpBlocks;
   unsigned int tmp_block_idx;
   string tmp_block;
   string tmp_IP;
+  if(meta->isFileReplicated(file)) {
+    cout<<"file [ "<<file<<" ] is replicated, encode it first"<<endl;
+    return upcode_time;
+  }
   bool hot_tag = meta->isFileHot(file);
   if(!hot_tag) {
     cout<<"file [ "<<file<<" ] is cold, cannot upcode"<<endl;
     return upcode_time;
   }
+  for(set<string>::const_iterator it = stripes.begin(); it != stripes.end(); ++it) {
+    bumpParityVersions(*it);
+  }
   int stripe_len = k + l_f + g;
   string temp_blocks[stripe_len];
   string temp_IPs[stripe_len];
+  int temp_nodes[stripe_len];
 
+  // only the compact groups that merge several fast groups are upcoded
+  int ack_num = layout->mergedGroupNum();
   int ack_size = 1024;
-  char** acks = new char*[l_c];
-  for(int i = 0; i < l_c; ++i) {
+  char** acks = new char*[ack_num];
+  for(int i = 0; i < ack_num; ++i) {
     acks[i] = new char[ack_size];
   }
-  int* ack_lens = new int[l_c];
+  int* ack_lens = new int[ack_num];
 
   int stripe_num = stripes.size();
   bool* all_stripe_finish_tag = new bool[stripe_num];
@@ -934,7 +4097,7 @@ double Coordinator::upcodeFile(string file){
     for(tmpBlocksIter = tmpBlocks.begin(); tmpBlocksIter != tmpBlocks.end(); ++tmpBlocksIter){
       tmp_block_idx = (*tmpBlocksIter).first;
       tmp_block = (*tmpBlocksIter).second;
-      tmp_IP = meta->getBlock2IP(tmp_block);
+      tmp_IP = meta->getBlock2IP(tmp_block, temp_nodes[tmp_block_idx]);
       temp_blocks[tmp_block_idx] = tmp_block;
       temp_IPs[tmp_block_idx] = tmp_IP;
       cout<<"block "<<tmp_block_idx<<", "<<tmp_block<<", IP: "<<tmp_IP<<endl;
@@ -943,27 +4106,31 @@ double Coordinator::upcodeFile(string file){
     cout<<"start upcode..."<<endl;
     gettimeofday(&start_time, NULL);
 
-    char* gw_cmd = new char[400];
-    gw_cmd[0] = '\0';
-
-    for(int idx = k; idx < k + l_f; ++idx) {
-      string cmd = generateUpcodeCmd(temp_blocks, temp_IPs, idx, gw_ip, gw_cmd);
-      sendCmd(cmd, temp_IPs[idx]);
-      cout<<"~~~~~~ send cmd to local parity block "<<(idx - k)<<" :"<<cmd<<endl;
+    // the commands are instantiated from the template of the placement
+    string key = "uc:" + placementSignature(temp_nodes, stripe_len);
+    PlanTemplate* plan = plans->find(key);
+    if(plan == NULL) {
+      plan = compileUpcodePlan(key, gw_ip);
+    }
+    for(size_t c = 0; c < plan->cmds.size(); ++c) {
+      string cmd = PlanCache::instantiate(plan->cmds[c].second, temp_blocks, temp_IPs, NULL, NULL);
+      string dest_ip = PlanCache::instantiate(plan->cmds[c].first, temp_blocks, temp_IPs, NULL, NULL);
+      sendCmd(cmd, dest_ip);
+      cout<<"~~~~~~ send cmd to "<<dest_ip<<" :"<<cmd<<endl;
     }
 
-    if(gw_cmd[0] != '\0') {
+    if(plan->gw_cmd != "") {
+      string gw_cmd = PlanCache::instantiate(plan->gw_cmd, temp_blocks, temp_IPs, NULL, NULL);
       cout<<"gw "<<gw_ip<<", upcode cmd: "<<gw_cmd<<endl;
-      sendCmd(string(gw_cmd), gw_ip);
+      sendCmd(gw_cmd, gw_ip);
     }
-    delete gw_cmd;
 
-    for(int i = 0; i < l_c; ++i) {
+    for(int i = 0; i < ack_num; ++i) {
       ack_lens[i] = recvAck(acks[i]);
       cout<<"ack length: "<<ack_lens[i]<<endl;
     }
     bool finish_upcode = true;
-    for(int i = 0; i < l_c; ++i) {
+    for(int i = 0; i < ack_num; ++i) {
       if(strcmp(acks[i], "fi_upco") != 0) {
         finish_upcode = false;
         break;
@@ -995,13 +4162,13 @@ double Coordinator::upcodeFile(string file){
     fprintf(stderr, "@@@@@@ upcode time: %.2lf s\n", upcode_time);
   }
 
-  for(int i = 0; i < l_c; ++i){
-    delete acks[i];
+  for(int i = 0; i < ack_num; ++i){
+    delete[] acks[i];
   }
 
-  delete acks;
-  delete ack_lens;
-  delete all_stripe_finish_tag;
+  delete[] acks;
+  delete[] ack_lens;
+  delete[] all_stripe_finish_tag;
   tmpBlocks.clear();
   stripes.clear();
   return upcode_time;
@@ -1084,15 +4251,20 @@ string Coordinator::generateUpcodeCmd(string stripe_blks[], string blk_IPs[], in
     return retCmd;
   }
 
+  int fast_id = fast_local_parity_id - k;
+  int compact_id = layout->compactGroupOfFast(fast_id);
+  int delta = layout->compactDelta(compact_id);
+  if(delta == 1) {
+    // a compact group that merges a single fast group is left as it is
+    return retCmd;
+  }
+
   retCmd += "up";
 
-  int delta = l_f / l_c;
   string block = stripe_blks[fast_local_parity_id];
   string block_ip = blk_IPs[fast_local_parity_id];
-  
-  int compact_local_parity_id = k + (fast_local_parity_id - k) / delta;
 
-  if((fast_local_parity_id - k) == (compact_local_parity_id - k) * delta) {
+  if(layout->isHeadFast(fast_id)) {
     string gw_waited_block_ip_concated_str = "";    
 
     // e.g., [L0/L0' in Fig.4]
@@ -1100,7 +4272,7 @@ string Coordinator::generateUpcodeCmd(string stripe_blks[], string blk_IPs[], in
     retCmd += block;
     retCmd += "wa";
     int num_wait_blks = delta - 1;
-    retCmd += to_string(num_wait_blks);
+    retCmd += Socket::countField(num_wait_blks);
     retCmd += "blk";
     string tmp_blk;
     string tmp_ip;
@@ -1125,16 +4297,16 @@ string Coordinator::generateUpcodeCmd(string stripe_blks[], string blk_IPs[], in
       // the gateway will receive commands from the coordinator
       if(gw_cmd[0] == '\0') {
         string gw_cmd_str = "ga";
-        gw_cmd_str += to_string(l_c);
+        gw_cmd_str += Socket::countField(layout->mergedGroupNum());
         gw_cmd_str += "wa";
-        gw_cmd_str += to_string(delta-1);
+        gw_cmd_str += Socket::countField(delta-1);
         gw_cmd_str += gw_waited_block_ip_concated_str;
         gw_cmd_str += "se";
         gw_cmd_str += block_ip;
         strcpy(gw_cmd, (char*)gw_cmd_str.c_str());
       } else {
         string gw_cmd_str = "wa";
-        gw_cmd_str += to_string(delta-1);
+        gw_cmd_str += Socket::countField(delta-1);
         gw_cmd_str += gw_waited_block_ip_concated_str;
         gw_cmd_str += "se";
         gw_cmd_str += block_ip;
@@ -1144,7 +4316,7 @@ string Coordinator::generateUpcodeCmd(string stripe_blks[], string blk_IPs[], in
 
   } else {
     // e.g., [L1, L2 in Fig.4]
-    int dest_fast_local_parity_id = (compact_local_parity_id - k) * delta + k;
+    int dest_fast_local_parity_id = k + layout->compactFirstFast(compact_id);
     string dest_block = stripe_blks[dest_fast_local_parity_id];
     string dest_ip = blk_IPs[dest_fast_local_parity_id];
     if(place_method == OPT_S) {
@@ -1170,6 +4342,8 @@ string Coordinator::generateUpcodeCmd(string stripe_blks[], string blk_IPs[], in
    * * * * * * * * * * * * * * * * * * * */
 double Coordinator::downcodeFile(string file){
   double downcode_time = 0.0;
+  // the parity blocks must reflect the pending overwrites
+  flushUpdates();
   set<string> stripes = meta->getFile2Stripes(file);
   string tmp_stripe;
   set<pair<unsigned int, string>> tmpBlocks;
@@ -1181,16 +4355,22 @@ double Coordinator::downcodeFile(string file){
     cout<<"file [ "<<file<<" ] is hot, cannot downcode"<<endl;
     return downcode_time;
   }
+  for(set<string>::const_iterator it = stripes.begin(); it != stripes.end(); ++it) {
+    bumpParityVersions(*it);
+  }
   int stripe_len = k + l_c + g;
   string temp_blocks[stripe_len];
   string temp_IPs[stripe_len];
+  int temp_nodes[stripe_len];
   // reserved blocks are for example, [L1, L2, L4, L5 in Fig.4 in paper]
   int reserved_len = k + l_f;
   string reserved_blocks[reserved_len];
   string reserved_IPs[reserved_len];
+  int reserved_nodes[reserved_len];
 
   int ack_size = 1024;
-  int ack_num = l_c;
+  // only the compact groups that merge several fast groups are downcoded
+  int ack_num = layout->mergedGroupNum();
   char** acks = new char*[ack_num];
   for(int i = 0; i < ack_num; ++i) {
     acks[i] = new char[ack_size];
@@ -1216,7 +4396,7 @@ double Coordinator::downcodeFile(string file){
     for(tmpBlocksIter = tmpBlocks.begin(); tmpBlocksIter != tmpBlocks.end(); ++tmpBlocksIter){
       tmp_block_idx = (*tmpBlocksIter).first;
       tmp_block = (*tmpBlocksIter).second;
-      tmp_IP = meta->getBlock2IP(tmp_block);
+      tmp_IP = meta->getBlock2IP(tmp_block, temp_nodes[tmp_block_idx]);
       temp_blocks[tmp_block_idx] = tmp_block;
       temp_IPs[tmp_block_idx] = tmp_IP;
       cout<<"block "<<tmp_block_idx<<", "<<tmp_block<<", IP: "<<tmp_IP<<endl;
@@ -1228,48 +4408,57 @@ double Coordinator::downcodeFile(string file){
     for(tmpBlocksIter = tmpBlocks.begin(); tmpBlocksIter != tmpBlocks.end(); ++tmpBlocksIter){
       tmp_block_idx = (*tmpBlocksIter).first;
       tmp_block = (*tmpBlocksIter).second;
-      tmp_IP = meta->getBlock2IP(tmp_block);
+      tmp_IP = meta->getBlock2IP(tmp_block, reserved_nodes[tmp_block_idx]);
       reserved_blocks[tmp_block_idx] = tmp_block;
       reserved_IPs[tmp_block_idx] = tmp_IP;
       cout<<"reserved block "<<tmp_block_idx<<", "<<tmp_block<<", IP: "<<tmp_IP<<endl;
     }
 
+    // the reserved blocks are repaired only now that they are needed, those
+    // lost with their nodes are known, the others are checked
+    bool reserved_ready = true;
+    for(tmpBlocksIter = tmpBlocks.begin(); tmpBlocksIter != tmpBlocks.end() && reserved_ready; ++tmpBlocksIter){
+      tmp_block_idx = (*tmpBlocksIter).first;
+      tmp_block = (*tmpBlocksIter).second;
+      bool lost = (lost_reserved.find(tmp_block) != lost_reserved.end());
+      if(!lost) {
+        sendCmd("ck" + tmp_block, reserved_IPs[tmp_block_idx]);
+        recvAck(acks[0]);
+        lost = (strcmp(acks[0], "blk_mi") == 0);
+      }
+      if(lost) {
+        reserved_ready = repairReservedBlock(temp_blocks, temp_IPs, reserved_blocks, reserved_IPs, tmp_block_idx, gw_ip);
+        reserved_nodes[tmp_block_idx] = meta->getDNID(reserved_IPs[tmp_block_idx]);
+      }
+    }
+    if(!reserved_ready) {
+      cout<<"%%%%%% reserved blocks lost, cannot downcode stripe "<<tmp_stripe<<" xxxxxx"<<endl;
+      ++stripe_index;
+      continue;
+    }
+
     cout<<"start downcode..."<<endl;
     gettimeofday(&start_time, NULL);
 
-    char* gw_cmd = new char[400];
-    gw_cmd[0] = '\0';
-    char* gw_cmd_further4flat = new char[100];
-    gw_cmd_further4flat[0] = '\0';
-
-    // [send commands to D0-D5, L0]
-    for(int i = 0; i < k + l_c; ++i) {
-      string cmd = generateDowncodeCmd(temp_blocks, temp_IPs, reserved_blocks, reserved_IPs, i, -1, gw_ip, gw_cmd, gw_cmd_further4flat);
-      if(cmd != "") {
-        sendCmd(cmd, temp_IPs[i]);
-      }
-      if(i < k) {
-        cout<<"%%%%%% send cmd to data block "<<i<<" :"<<cmd<<endl;
-      } else {
-        cout<<"%%%%%% send cmd to compact local parity block "<<(i - k)<<" :"<<cmd<<endl;
-      }
+    // the commands are instantiated from the template of the placement,
+    // [D0-D5, L0] first, then [L1, L2]
+    string key = "dc:" + placementSignature(temp_nodes, stripe_len) + "|" + placementSignature(reserved_nodes + k, l_f);
+    PlanTemplate* plan = plans->find(key);
+    if(plan == NULL) {
+      plan = compileDowncodePlan(key, gw_ip);
     }
-    // [send commands to L1, L2]
-    for(int i = k; i < k + l_f; ++i) {
-      string cmd = generateDowncodeCmd(temp_blocks, temp_IPs, reserved_blocks, reserved_IPs, -1, i, gw_ip, gw_cmd, gw_cmd_further4flat);
-      int delta = l_f / l_c;
-      if((i - k) % delta != 0) {
-        sendCmd(cmd, reserved_IPs[i]);
-        cout<<"------ send cmd to fast local parity block "<<(i - k)<<" :"<<cmd<<endl;
-      }
+    for(size_t c = 0; c < plan->cmds.size(); ++c) {
+      string cmd = PlanCache::instantiate(plan->cmds[c].second, temp_blocks, temp_IPs, reserved_blocks, reserved_IPs);
+      string dest_ip = PlanCache::instantiate(plan->cmds[c].first, temp_blocks, temp_IPs, reserved_blocks, reserved_IPs);
+      sendCmd(cmd, dest_ip);
+      cout<<"%%%%%% send cmd to "<<dest_ip<<" :"<<cmd<<endl;
     }
 
-    if(gw_cmd[0] != '\0') {
-      strcat(gw_cmd, gw_cmd_further4flat);
+    if(plan->gw_cmd != "") {
+      string gw_cmd = PlanCache::instantiate(plan->gw_cmd, temp_blocks, temp_IPs, reserved_blocks, reserved_IPs);
       cout<<"gw "<<gw_ip<<", downcode cmd: "<<gw_cmd<<endl;
-      sendCmd(string(gw_cmd), gw_ip);
+      sendCmd(gw_cmd, gw_ip);
     }
-    delete gw_cmd;
 
     for(int i = 0; i < ack_num; ++i) {
       ack_lens[i] = recvAck(acks[i]);
@@ -1407,23 +4596,27 @@ string Coordinator::generateDowncodeCmd(string stripe_blks[], string blk_IPs[],
   //int l_c = 2; // (this is for testDowncodeCmd_k_12)
   string retCmd = "";
 
-  int r_c = k / l_c;
-  int r_f = k / l_f;
-  int delta = l_f / l_c;
-
   if(reserved_id == -1) {
     // for blocks D0-D5, L0
     if(0 <= blk_id && blk_id < k) {
       // data block
+      int compact_local_group_id = layout->compactGroupOf(blk_id);
+      if(layout->compactDelta(compact_local_group_id) == 1) {
+        // the compact local group is also a fast local group, nothing to do
+        return retCmd;
+      }
       if(place_method == OPT_S || place_method == FLAT) {
-        int compact_local_group_id = blk_id / r_c;
-        if(compact_local_group_id * r_c <= blk_id && blk_id < compact_local_group_id * r_c + (delta - 1) * g) {
-        } else {
+        // the last fast local group of a compact local group, e.g., D4, D5,
+        // does not participate, its fast local parity block is L0' + L0 + L1
+        if(layout->isLastFast(layout->fastGroupOf(blk_id))) {
           return retCmd;
         }
       }
     } else if (blk_id < k + l_c) {
       // compact local parity block
+      if(layout->compactDelta(blk_id - k) == 1) {
+        return retCmd;
+      }
     } else {
       // global parity block
       return retCmd;
@@ -1434,7 +4627,7 @@ string Coordinator::generateDowncodeCmd(string stripe_blks[], string blk_IPs[],
     // for blocks L1, L2
     if(k <= reserved_id && reserved_id < k + l_f) {
       int fast_local_group_id = reserved_id - k;
-      if(fast_local_group_id % delta == 0) {
+      if(layout->isHeadFast(fast_local_group_id)) {
         return retCmd;
       } else {
       }
@@ -1456,10 +4649,6 @@ string Coordinator::generateDowncodeCmd(string stripe_blks[], string blk_IPs[],
 
   // generate downcode commands for D0-D5, L0
 string Coordinator::generateDowncodeCmd4DataAndFastLP(string stripe_blks[], string blk_IPs[], string reserved_blks[], string reserved_IPs[], int blk_id, string gw_ip, char* gw_cmd) {
-    int r_c = k / l_c;
-    int r_f = k / l_f;
-    int delta = l_f / l_c;
-
     string block;
     string block_ip;
     string reserved_block;
@@ -1472,13 +4661,15 @@ string Coordinator::generateDowncodeCmd4DataAndFastLP(string stripe_blks[], stri
     block_ip = blk_IPs[blk_id];
     if(0 <= blk_id && blk_id < k) {
       // data block
-      int compact_local_group_id = blk_id / r_c;
-      int fast_local_group_id = blk_id / r_f;
-      int smallest_id_this_fast_local_group = fast_local_group_id * r_f;
-      if(place_method == OPT_S && compact_local_group_id * r_c <= blk_id && blk_id < compact_local_group_id * r_c + (delta - 1) * g) {
-        if(fast_local_group_id % delta == 0) {
+      int compact_local_group_id = layout->compactGroupOf(blk_id);
+      int fast_local_group_id = layout->fastGroupOf(blk_id);
+      int smallest_id_this_fast_local_group = layout->fastGroupStart(fast_local_group_id);
+      int r_f = layout->fastGroupSize(fast_local_group_id);
+      bool head_fast = layout->isHeadFast(fast_local_group_id);
+      if(place_method == OPT_S) {
+        if(head_fast) {
           // in Opt-S, D0, D1, send blocks to L0
-          int dest_parity_id = k + fast_local_group_id / delta;
+          int dest_parity_id = k + compact_local_group_id;
           tmp_blk = stripe_blks[dest_parity_id];
           tmp_ip = blk_IPs[dest_parity_id];
           retCmd += "se";
@@ -1486,14 +4677,17 @@ string Coordinator::generateDowncodeCmd4DataAndFastLP(string stripe_blks[], stri
           retCmd += tmp_ip;
         } else {
           if(blk_id == smallest_id_this_fast_local_group) {
-            // in Opt-S, D2 waits for D3, and re-sends an XOR sum (D2+D3) to the gateway
-            retCmd += "wa";
-            retCmd += to_string(r_f - 1);
-            retCmd += "blk";
-            for(int idx = smallest_id_this_fast_local_group + 1; idx < smallest_id_this_fast_local_group + r_f; ++idx) {
-              tmp_blk = stripe_blks[idx];
-              tmp_ip = blk_IPs[idx];
-              retCmd += tmp_ip;
+            // in Opt-S, D2 waits for D3, and re-sends an XOR sum (D2+D3) to the gateway,
+            // if D2 is the only block of its fast local group, it sends itself
+            if(r_f > 1) {
+              retCmd += "wa";
+              retCmd += Socket::countField(r_f - 1);
+              retCmd += "blk";
+              for(int idx = smallest_id_this_fast_local_group + 1; idx < smallest_id_this_fast_local_group + r_f; ++idx) {
+                tmp_blk = stripe_blks[idx];
+                tmp_ip = blk_IPs[idx];
+                retCmd += tmp_ip;
+              }
             }
             int reserved_parity_id = fast_local_group_id + k;
             tmp_blk = reserved_blks[reserved_parity_id];
@@ -1502,26 +4696,25 @@ string Coordinator::generateDowncodeCmd4DataAndFastLP(string stripe_blks[], stri
             retCmd += block;
             retCmd += gw_ip;
 
-            if(delta - 2 > 0) {
-              // gateway command
-              // the gateway re-sends D2+D3 to L1
-              if(gw_cmd[0] == '\0') {
-                string gw_cmd_str = "ga";
-                gw_cmd_str += to_string((delta - 2) * l_c);
-                gw_cmd_str += "wa";
-                gw_cmd_str += to_string(1);
-                gw_cmd_str += block_ip;
-                gw_cmd_str += "se";
-                gw_cmd_str += tmp_ip;
-                strcpy(gw_cmd, (char*)gw_cmd_str.c_str());
-              } else {
-                string gw_cmd_str = "wa";
-                gw_cmd_str += to_string(1);
-                gw_cmd_str += block_ip;
-                gw_cmd_str += "se";
-                gw_cmd_str += tmp_ip;
-                strcat(gw_cmd, (char*)gw_cmd_str.c_str());
-              }
+            // gateway command
+            // the gateway re-sends D2+D3 to L1, a round for each fast local group
+            // that is neither the first nor the last one of its compact local group
+            if(gw_cmd[0] == '\0') {
+              string gw_cmd_str = "ga";
+              gw_cmd_str += Socket::countField(l_f - l_c - layout->mergedGroupNum());
+              gw_cmd_str += "wa";
+              gw_cmd_str += Socket::countField(1);
+              gw_cmd_str += block_ip;
+              gw_cmd_str += "se";
+              gw_cmd_str += tmp_ip;
+              strcpy(gw_cmd, (char*)gw_cmd_str.c_str());
+            } else {
+              string gw_cmd_str = "wa";
+              gw_cmd_str += Socket::countField(1);
+              gw_cmd_str += block_ip;
+              gw_cmd_str += "se";
+              gw_cmd_str += tmp_ip;
+              strcat(gw_cmd, (char*)gw_cmd_str.c_str());
             }
           } else {
             // in Opt-S, D3 directly sends its content to D2
@@ -1534,9 +4727,9 @@ string Coordinator::generateDowncodeCmd4DataAndFastLP(string stripe_blks[], stri
         }
       } // place_method == OPT_S
 
-      if(place_method == OPT_R || (place_method == FLAT && compact_local_group_id * r_c <= blk_id && blk_id < compact_local_group_id * r_c + (delta - 1) * g)) {
-        if(fast_local_group_id % delta == 0) {
-          int dest_parity_id = k + fast_local_group_id / delta;
+      if(place_method == OPT_R || place_method == FLAT) {
+        if(head_fast) {
+          int dest_parity_id = k + compact_local_group_id;
           tmp_blk = stripe_blks[dest_parity_id];
           tmp_ip = blk_IPs[dest_parity_id];
           retCmd += "se";
@@ -1569,13 +4762,15 @@ string Coordinator::generateDowncodeCmd4DataAndFastLP(string stripe_blks[], stri
       // compact local parity block
       retCmd += "lp";
       int compact_local_group_id = blk_id - k;
-      int fast_local_group_id = compact_local_group_id * delta;
+      int fast_local_group_id = layout->compactFirstFast(compact_local_group_id);
+      int start_data_block_id = layout->fastGroupStart(fast_local_group_id);
+      int r_f = layout->fastGroupSize(fast_local_group_id);
       retCmd += "wa";
-      retCmd += to_string(r_f);
+      retCmd += Socket::countField(r_f);
       retCmd += "blk";
 
       string gw_waited_block_ip_concated_str = "";
-      for(int idx = fast_local_group_id * r_f; idx < fast_local_group_id * r_f + r_f; ++idx) {
+      for(int idx = start_data_block_id; idx < start_data_block_id + r_f; ++idx) {
         tmp_blk = stripe_blks[idx];
         tmp_ip = blk_IPs[idx];
         if(place_method != FLAT) {
@@ -1592,16 +4787,16 @@ string Coordinator::generateDowncodeCmd4DataAndFastLP(string stripe_blks[], stri
         // in Flat, gateway command
         if(gw_cmd[0] == '\0') {
           string gw_cmd_str = "ga";
-          gw_cmd_str += to_string(l_f - l_c);
+          gw_cmd_str += Socket::countField(l_f - l_c);
           gw_cmd_str += "wa";
-          gw_cmd_str += to_string(r_f);
+          gw_cmd_str += Socket::countField(r_f);
           gw_cmd_str += gw_waited_block_ip_concated_str;
           gw_cmd_str += "se";
           gw_cmd_str += block_ip;
           strcpy(gw_cmd, (char*)gw_cmd_str.c_str());
         } else {
           string gw_cmd_str = "wa";
-          gw_cmd_str += to_string(r_f);
+          gw_cmd_str += Socket::countField(r_f);
           gw_cmd_str += gw_waited_block_ip_concated_str;
           gw_cmd_str += "se";
           gw_cmd_str += block_ip;
@@ -1613,7 +4808,7 @@ string Coordinator::generateDowncodeCmd4DataAndFastLP(string stripe_blks[], stri
         // in Opt-S and Flat, L0 shoud be redirected to L2
         retCmd += "st";
         retCmd += "re";
-        int reserved_parity_id = fast_local_group_id + delta - 1 + k;
+        int reserved_parity_id = fast_local_group_id + layout->compactDelta(compact_local_group_id) - 1 + k;
         tmp_blk = reserved_blks[reserved_parity_id];
         tmp_ip = reserved_IPs[reserved_parity_id];
         retCmd += "se";
@@ -1634,10 +4829,6 @@ string Coordinator::generateDowncodeCmd4DataAndFastLP(string stripe_blks[], stri
 
   // generate downcode commands for L1, L2
 string Coordinator::generateDowncodeCmd4ReservedLP(string stripe_blks[], string blk_IPs[], string reserved_blks[], string reserved_IPs[], int reserved_id, string gw_ip, char* gw_cmd, char* gw_cmd_f) {
-    int r_c = k / l_c;
-    int r_f = k / l_f;
-    int delta = l_f / l_c;
-
     string block;
     string block_ip;
     string reserved_block;
@@ -1650,17 +4841,20 @@ string Coordinator::generateDowncodeCmd4ReservedLP(string stripe_blks[], string
     reserved_ip = reserved_IPs[reserved_id];
     retCmd += "lp";
     int fast_local_group_id = reserved_id - k;
-    int id = (fast_local_group_id / delta) * delta;
+    int compact_local_group_id = layout->compactGroupOfFast(fast_local_group_id);
+    int delta = layout->compactDelta(compact_local_group_id);
+    int id = layout->compactFirstFast(compact_local_group_id);
     int id2 = id + delta - 1;
+    int start_data_block_id = layout->fastGroupStart(fast_local_group_id);
+    int r_f = layout->fastGroupSize(fast_local_group_id);
     
     if(place_method == OPT_S && fast_local_group_id < id2) {
       // in Opt-S, L1
       retCmd += "wa";
-      retCmd += to_string(1);
+      retCmd += Socket::countField(1);
       retCmd += "blk";
-      int data_block_id = fast_local_group_id * r_f;
-      tmp_blk = stripe_blks[data_block_id];
-      tmp_ip = blk_IPs[data_block_id];
+      tmp_blk = stripe_blks[start_data_block_id];
+      tmp_ip = blk_IPs[start_data_block_id];
       retCmd += gw_ip;
 
       retCmd += "st";
@@ -1674,9 +4868,9 @@ string Coordinator::generateDowncodeCmd4ReservedLP(string stripe_blks[], string
     } else if (place_method == OPT_S &&fast_local_group_id == id2) {
       // in Opt-S, L2
       retCmd += "wa";
-      retCmd += to_string(delta - 1);
+      retCmd += Socket::countField(delta - 1);
       retCmd += "blk";
-      int start_parity_id = id / delta + k;
+      int start_parity_id = compact_local_group_id + k;
       tmp_blk = stripe_blks[start_parity_id];
       tmp_ip = blk_IPs[start_parity_id];
       retCmd += tmp_ip;
@@ -1691,9 +4885,8 @@ string Coordinator::generateDowncodeCmd4ReservedLP(string stripe_blks[], string
     else if (place_method == OPT_R) {
       // in Opt-R, L1, L2
       retCmd += "wa";
-      retCmd += to_string(r_f);
+      retCmd += Socket::countField(r_f);
       retCmd += "blk";
-      int start_data_block_id = fast_local_group_id * r_f;
       for(int idx = start_data_block_id; idx < start_data_block_id + r_f; ++idx) {
         tmp_blk = stripe_blks[idx];
         tmp_ip = blk_IPs[idx];
@@ -1705,9 +4898,8 @@ string Coordinator::generateDowncodeCmd4ReservedLP(string stripe_blks[], string
     else if (place_method == FLAT && fast_local_group_id < id2) {
       // in Flat, L1
       retCmd += "wa";
-      retCmd += to_string(r_f);
+      retCmd += Socket::countField(r_f);
       retCmd += "blk";
-      int start_data_block_id = fast_local_group_id * r_f;
 
       string gw_waited_block_ip_concated_str = "";
       for(int idx = start_data_block_id; idx < start_data_block_id + r_f; ++idx) {
@@ -1719,16 +4911,16 @@ string Coordinator::generateDowncodeCmd4ReservedLP(string stripe_blks[], string
 
       if(gw_cmd[0] == '\0') {
         string gw_cmd_str = "ga";
-        gw_cmd_str += to_string(l_f - l_c);
+        gw_cmd_str += Socket::countField(l_f - l_c);
         gw_cmd_str += "wa";
-        gw_cmd_str += to_string(r_f);
+        gw_cmd_str += Socket::countField(r_f);
         gw_cmd_str += gw_waited_block_ip_concated_str;
         gw_cmd_str += "se";
         gw_cmd_str += reserved_ip;
         strcpy(gw_cmd, (char*)gw_cmd_str.c_str());
       } else {
         string gw_cmd_str = "wa";
-        gw_cmd_str += to_string(r_f);
+        gw_cmd_str += Socket::countField(r_f);
         gw_cmd_str += gw_waited_block_ip_concated_str;
         gw_cmd_str += "se";
         gw_cmd_str += reserved_ip;
@@ -1747,11 +4939,11 @@ string Coordinator::generateDowncodeCmd4ReservedLP(string stripe_blks[], string
     else if (place_method == FLAT && fast_local_group_id == id2) {
       // in Flat, L2
       retCmd += "wa";
-      retCmd += to_string(delta - 1);
+      retCmd += Socket::countField(delta - 1);
       retCmd += "blk";
 
       string gw_waited_block_ip_concated_str = "";
-      int start_parity_id = id / delta + k;
+      int start_parity_id = compact_local_group_id + k;
       tmp_blk = stripe_blks[start_parity_id];
       tmp_ip = blk_IPs[start_parity_id];
       retCmd += gw_ip;
@@ -1764,16 +4956,16 @@ string Coordinator::generateDowncodeCmd4ReservedLP(string stripe_blks[], string
       }
       
       if(gw_cmd_f[0] == '\0') {
-        string gw_cmd_str = to_string(l_c);
+        string gw_cmd_str = Socket::countField(layout->mergedGroupNum());
         gw_cmd_str += "wa";
-        gw_cmd_str += to_string(delta - 1);
+        gw_cmd_str += Socket::countField(delta - 1);
         gw_cmd_str += gw_waited_block_ip_concated_str;
         gw_cmd_str += "se";
         gw_cmd_str += reserved_ip;
         strcpy(gw_cmd_f, (char*)gw_cmd_str.c_str());
       } else {
         string gw_cmd_str = "wa";
-        gw_cmd_str += to_string(delta - 1);
+        gw_cmd_str += Socket::countField(delta - 1);
         gw_cmd_str += gw_waited_block_ip_concated_str;
         gw_cmd_str += "se";
         gw_cmd_str += reserved_ip;
@@ -1786,3 +4978,215 @@ string Coordinator::generateDowncodeCmd4ReservedLP(string stripe_blks[], string
 
     return retCmd;
 }
+
+  /* * * * * * * * * * * * * * * * * * * * *
+   *    kernel routine 5: overwriteBlock     *
+   * * * * * * * * * * * * * * * * * * * * */
+  // overwrite the blk_idx-th data block of a file with the content of new_data_file,
+  // the DN keeps the delta (old XOR new) of the block, and the parity blocks
+  // are patched by the deltas when UPDATE_WINDOW overwrites are pending
+void Coordinator::overwriteBlock(string file, int blk_idx, string new_data_file) {
+  set<string> stripes = meta->getFile2Stripes(file);
+  if(meta->isFileReplicated(file)) {
+    cout<<"file [ "<<file<<" ] is replicated, encode it first"<<endl;
+    return;
+  }
+  if(blk_idx < 0 || blk_idx >= (int)stripes.size() * k) {
+    cout<<"WARNING: block "<<blk_idx<<" not in file "<<file<<endl;
+    return;
+  }
+  set<string>::const_iterator stripesIter = stripes.begin();
+  advance(stripesIter, blk_idx / k);
+  string stripe = *stripesIter;
+  int data_id = blk_idx % k;
+  string block;
+  set<pair<unsigned int, string>> tmpBlocks = meta->getStripe2Blocks(stripe);
+  set<pair<unsigned int, string>>::const_iterator tmpBlocksIter;
+  for(tmpBlocksIter = tmpBlocks.begin(); tmpBlocksIter != tmpBlocks.end(); ++tmpBlocksIter) {
+    if((int)(*tmpBlocksIter).first == data_id) {
+      block = (*tmpBlocksIter).second;
+    }
+  }
+  string block_ip = meta->getBlock2IP(block);
+  // a new delta would reach the parity blocks already patched twice
+  if(patched_parities.find(stripe) != patched_parities.end()) {
+    flushUpdates();
+    if(patched_parities.find(stripe) != patched_parities.end()) {
+      cout<<"WARNING: stripe "<<stripe<<" has parity blocks not patched yet, cannot overwrite"<<endl;
+      return;
+    }
+  }
+
+  char* buf = new char[chunk_size];
+  memset(buf, 0, chunk_size);
+  FILE* fp = fopen((char*)new_data_file.c_str(), "r");
+  if(fp == NULL) {
+    cout<<"WARNING: file "<<new_data_file<<" not exist, cannot proceed..."<<endl;
+    delete[] buf;
+    return;
+  }
+  fread(buf, 1, chunk_size, fp);
+  fclose(fp);
+
+  struct timeval start_time, end_time;
+  gettimeofday(&start_time, NULL);
+  string cmd = "ow" + block;
+  cout<<"~~~overwrite block "<<data_id<<" of stripe "<<stripe<<", send cmd: "<<cmd<<endl;
+  sendCmd(cmd, block_ip);
+  cn2dnSoc->sendData(buf, chunk_size, packet_size, (char*)block_ip.c_str(), CN_UP_DATA_PORT);
+  char* ack = new char[1024];
+  recvAck(ack);
+  if(strcmp(ack, "fi_owri") == 0) {
+    blk_versions[block]++;
+    if(pending_updates[stripe].find(data_id) == pending_updates[stripe].end()) {
+      pending_updates[stripe].insert(data_id);
+      pending_update_num++;
+    }
+  }
+  gettimeofday(&end_time, NULL);
+  fprintf(stderr, "~~~~~~ overwrite time: %.2lf s\n", end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000);
+  delete[] ack;
+  delete[] buf;
+
+  if(pending_update_num >= UPDATE_WINDOW) {
+    flushUpdates();
+  }
+}
+
+  // patch the parity blocks of the stripes with pending overwrites, each affected
+  // local or global parity block is sent the deltas of the updated data blocks
+  // (scaled by their coefficients) and applies them in one read-modify-write.
+  // A parity block counts as patched once its node acks it; a stripe with a
+  // parity block not patched keeps its deltas and stays pending, and the next
+  // flush patches only the others
+void Coordinator::flushUpdates() {
+  if(pending_update_num == 0) {
+    return;
+  }
+  string gw_ip = meta->getGW();
+  char* ack = new char[1024];
+  int written_blk_num = 0;
+  int data_blk_num = 0;
+  set<string> failed_stripes;
+  struct timeval start_time, end_time;
+  gettimeofday(&start_time, NULL);
+
+  map<string, set<int>>::const_iterator pendingIter;
+  for(pendingIter = pending_updates.begin(); pendingIter != pending_updates.end(); ++pendingIter) {
+    string stripe = pendingIter->first;
+    const set<int>& updated = pendingIter->second;
+    bool hot_tag = meta->isFileHot(meta->getStripe2File(stripe));
+    int l = hot_tag ? l_f : l_c;
+    int stripe_len = k + l + g;
+    string temp_blocks[stripe_len];
+    string temp_IPs[stripe_len];
+    set<pair<unsigned int, string>> tmpBlocks = meta->getStripe2Blocks(stripe);
+    set<pair<unsigned int, string>>::const_iterator tmpBlocksIter;
+    for(tmpBlocksIter = tmpBlocks.begin(); tmpBlocksIter != tmpBlocks.end(); ++tmpBlocksIter) {
+      temp_blocks[(*tmpBlocksIter).first] = (*tmpBlocksIter).second;
+      temp_IPs[(*tmpBlocksIter).first] = meta->getBlock2IP((*tmpBlocksIter).second);
+    }
+    // the updated data blocks are replaced by their deltas, e.g., "FI0000-0000d03"
+    set<int> groups;
+    set<int>::const_iterator updatedIter;
+    for(updatedIter = updated.begin(); updatedIter != updated.end(); ++updatedIter) {
+      temp_blocks[*updatedIter][11] = 'd';
+      groups.insert(kernel->localGroup(*updatedIter, hot_tag));
+    }
+
+    // the affected local parity blocks, and all the global parity blocks,
+    // but those patched by a previous flush
+    vector<int> parities;
+    set<int>::const_iterator groupsIter;
+    for(groupsIter = groups.begin(); groupsIter != groups.end(); ++groupsIter) {
+      parities.push_back(k + *groupsIter);
+    }
+    for(int j = 0; j < g; ++j) {
+      parities.push_back(k + l + j);
+    }
+    set<int>& patched = patched_parities[stripe];
+
+    for(size_t p = 0; p < parities.size(); ++p) {
+      int parity_id = parities[p];
+      if(patched.find(parity_id) != patched.end()) {
+        continue;
+      }
+      Equation equation;
+      equation.push_back(make_pair(parity_id, (unsigned char)1));
+      for(updatedIter = updated.begin(); updatedIter != updated.end(); ++updatedIter) {
+        if(parity_id < k + l) {
+          if(kernel->localGroup(*updatedIter, hot_tag) == parity_id - k) {
+            equation.push_back(make_pair(*updatedIter, (unsigned char)1));
+          }
+        } else {
+          equation.push_back(make_pair(*updatedIter, ec->getGlobalCoef(parity_id - k - l, *updatedIter)));
+        }
+      }
+      char* gw_cmd = new char[400];
+      gw_cmd[0] = '\0';
+      map<string, string> cmds = generateMultiDecodeCmd(temp_blocks, temp_IPs, parity_id, equation, gw_ip, gw_cmd);
+      map<string, string>::const_iterator cmdsIter;
+      for(cmdsIter = cmds.begin(); cmdsIter != cmds.end(); ++cmdsIter) {
+        sendCmd(cmdsIter->second, cmdsIter->first);
+        cout<<"~~~~~~ send cmd to "<<cmdsIter->first<<" :"<<cmdsIter->second<<endl;
+      }
+      if(gw_cmd[0] != '\0') {
+        cout<<"gw "<<gw_ip<<", update cmd: "<<gw_cmd<<endl;
+        sendCmd(string(gw_cmd), gw_ip);
+      }
+      delete[] gw_cmd;
+      recvAck(ack);
+      if(strncmp(ack, "fi_deco", 7) == 0 && string(ack + 7) == temp_blocks[parity_id]) {
+        patched.insert(parity_id);
+        blk_versions[temp_blocks[parity_id]]++;
+        written_blk_num++;
+      } else {
+        cout<<"~~~~~~ parity block "<<temp_blocks[parity_id]<<" not patched"<<endl;
+      }
+    }
+
+    // the deltas are kept, and the stripe pending, until all its parity blocks are patched
+    if(patched.size() < parities.size()) {
+      failed_stripes.insert(stripe);
+      continue;
+    }
+    patched_parities.erase(stripe);
+    // drop the deltas
+    for(updatedIter = updated.begin(); updatedIter != updated.end(); ++updatedIter) {
+      sendCmd("dd" + temp_blocks[*updatedIter], temp_IPs[*updatedIter]);
+    }
+    data_blk_num += updated.size();
+  }
+  gettimeofday(&end_time, NULL);
+  fprintf(stderr, "~~~~~~ flush %d overwrites of %d stripes, %d parity blocks written, %d stripes left pending, time: %.2lf s\n", data_blk_num, (int)pending_updates.size(), written_blk_num, (int)failed_stripes.size(), end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000);
+
+  map<string, set<int>> left_updates;
+  pending_update_num = 0;
+  set<string>::const_iterator failedIter;
+  for(failedIter = failed_stripes.begin(); failedIter != failed_stripes.end(); ++failedIter) {
+    left_updates[*failedIter] = pending_updates[*failedIter];
+    pending_update_num += left_updates[*failedIter].size();
+  }
+  pending_updates = left_updates;
+  delete[] ack;
+}
+
+  // the deltas of a stripe are kept by the nodes of its data blocks, a stripe
+  // whose delta was lost with its node stays pending, and is not rebuilt
+set<string> Coordinator::flushBeforeRebuild(const set<string>& stripes) {
+  set<string> unflushed;
+  set<string>::const_iterator stripesIter;
+  for(stripesIter = stripes.begin(); stripesIter != stripes.end(); ++stripesIter) {
+    if(pending_updates.find(*stripesIter) != pending_updates.end()) {
+      flushUpdates();
+      break;
+    }
+  }
+  for(stripesIter = stripes.begin(); stripesIter != stripes.end(); ++stripesIter) {
+    if(pending_updates.find(*stripesIter) != pending_updates.end()) {
+      cout<<"WARNING: stripe "<<*stripesIter<<" has overwrites not flushed, not rebuilt"<<endl;
+      unflushed.insert(*stripesIter);
+    }
+  }
+  return unflushed;
+}
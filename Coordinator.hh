@@ -10,12 +10,40 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <sys/mman.h>
 #include "Metadata.hh"
 #include "Socket.hh"
+#include "ErasureCode.hh"
+#include "LRCKernel.hh"
+#include "CodeLayout.hh"
+#include "EncodeEngine.hh"
+#include "RepairPlanner.hh"
+#include "PlanCache.hh"
+#include "RepairQueue.hh"
+#include "PartialSumCache.hh"
 
-#define OPT_S 1
-#define OPT_R 2
-#define FLAT 3
+  // number of pending overwrites before the parity blocks are patched
+#define UPDATE_WINDOW 4
+  // number of times a parity block written in the background is resent
+#define UPLOAD_RETRY_NUM 3
+
+  // upload modes: the local parity blocks are computed by the CN or by the
+  // DNs, or the data blocks are replicated, and encoded later
+#define UPLOAD_CN_PARITY 0
+#define UPLOAD_DN_PARITY 1
+#define UPLOAD_REPLICATED 2
+
+  // ms the repair daemon waits before retrying the stripes it could not repair
+#define REPAIR_RETRY_INTERVAL 5000
+
+  // block latencies seen by a read before a late block is hedged
+#define HEDGE_MIN_SAMPLES 8
+  // interval of the checks for late blocks, in ms
+#define HEDGE_CHECK_INTERVAL 10
 
 using namespace std;
 
@@ -25,6 +53,12 @@ class Coordinator{
     Config *conf;
     Socket *cn2dnSoc;
     Socket *dn2dnSoc;
+    ErasureCode *ec;
+    LRCKernel *kernel;
+    CodeLayout *layout;
+    EncodeEngine *engine;
+    RepairPlanner *planner;
+    PlanCache *plans;
     int k;
     int l_f;
     int g;
@@ -32,16 +66,174 @@ class Coordinator{
     int chunk_size;
     int packet_size;
     int place_method;
+      // stripe -> ids of the data blocks overwritten since the last flush
+    map<string, set<int>> pending_updates;
+    int pending_update_num;
+      // stripe -> ids of the parity blocks already patched with its pending
+      // overwrites, by a flush that failed to patch the others
+    map<string, set<int>> patched_parities;
+
+      // early-ack upload: a stripe completes once its data blocks and
+	  // ack_parity_num parity blocks are written, the other parity blocks are
+	  // written in the background from a copy (pending_writes)
+    struct PendingWrite {
+      string stripe;
+      string blk_name;
+      int blk_id;
+      string ip;
+      char* buf;
+      int retry;
+    };
+    int ack_parity_num;
+      // replicas of a data block in a replicated upload
+    int replica_num;
+      // stripes fetched at once by readFile
+    int read_window;
+      // percentile of the block latencies after which readFile hedges a block
+    int hedge_percentile;
+      // stripes planned at once by recoverNode
+    int recovery_batch;
+      // whether a repair runs along a chain of its helpers
+    bool chain_repair;
+      // nodes that reconstruct the slices of a block repaired by decodeMultiFailures
+    int repair_slices;
+      // stripes with blocks found missing, e.g., by a degraded read, to be
+      // repaired durably, the closest to data loss first
+    RepairQueue *repairs;
+      // the repair daemon drains repairs in rounds of repair_concurrency
+      // stripes, paced by repair_node_mbps and repair_gw_mbps. A round and a
+      // foreground command (enterForeground ~ leaveForeground) exclude each
+      // other by io_lock, as both wait for their acks on cn2dnSoc; a round is
+      // not started while a foreground command waits (fg_waiting)
+    int repair_concurrency;
+    int repair_node_mbps;
+    int repair_gw_mbps;
+    mutex io_lock;
+    condition_variable daemon_cv;
+    atomic<int> fg_waiting;
+    bool daemon_stop;
+    thread repair_daemon;
+      // stripes the last rounds could not repair, skipped until a round has
+      // nothing else to do
+    set<string> repair_deferred;
+      // blocks rebuilt and read as helpers by each node over the repairs of
+      // decodeMultiFailures, the load of choosing a repair target
+    map<string, int> repair_load;
+      // reserved blocks lost with their nodes, rebuilt by the next downcode
+      // that needs them
+    set<string> lost_reserved;
+    vector<PendingWrite> pending_writes;
+      // partial sums of degraded reads cached by their aggregators: the ids
+      // cached by each aggregator (mirroring its partial_sums), the id of each
+      // partial sum, named by its helper nodes, blocks, coefficients and block
+      // versions, and back. A block version is bumped whenever the block changes
+    int partial_cache_blocks;
+    map<string, PartialSumCache*> partial_mirrors;
+    map<string, long> partial_ids;
+    map<long, string> partial_descs;
+    long next_partial_id;
+    long partial_hit_num;
+    long partial_miss_num;
+    map<string, int> blk_versions;
+      // a partial sum read from the cache of its aggregator (ip), and the
+      // commands that compute it instead if the aggregator lost it
+    struct PartialFallback {
+      string ip;
+      map<string, string> cmds;
+    };
+      // recovery of a failed node or rack: a block rebuilt by an equation at a
+      // new node, names[blk_id] and IPs[blk_id] are the block and its new node
+    struct RecoveryTask {
+      string stripe;
+      int blk_id;
+      Equation equation;
+      vector<string> names;
+      vector<string> IPs;
+    };
+    vector<thread> bg_send_thrds;
+      // stripes acked early whose parity blocks are not all written yet
+    set<string> early_acked_stripes;
+      // the blocks sent to a DN are serialized, as the DN serves one at a time
+    map<string, mutex*> dn_send_locks;
+      // the acks of the written blocks are collected by ack_collector,
+	  // blk_ack_state: 0, not acked yet; 1, written; -1, failed
+    mutex ack_lock;
+    condition_variable ack_cv;
+    map<string, int> blk_ack_state;
+    int expected_ack_num;
+    int recv_ack_num;
+    bool ack_collector_stop;
+    thread ack_collector;
+      // the file being uploaded, mapped, whose data blocks are sent by sendfile
+    int ingest_fd;
+    char* ingest_map;
+    size_t ingest_len;
 
       // send command 
     void sendCmd(string cmd, string dest_IP);
       // receive ack
     int recvAck(char* ack);
 
-      // send a block when uploading, wait and receive ack
-    int CNSendData(int blk_id, string blk_name, char* buf, string blk_ip, char* ack);
+      // collect the acks of the written blocks in the background, while an upload runs
+    void startAckCollector(void);
+    void stopAckCollector(void);
+      // expect the ack of a block before it is sent
+    void expectAck(string blk_name);
+      // send a block to a DN, the blocks sent to the same DN are serialized;
+      // a data block within ingest_map is sent straight from the file
+    void sendBlock(string blk_name, char* buf, string blk_ip);
+      // create ./output of size bytes, mapped, so that the blocks are received
+      // at their final offsets; NULL on failure
+    char* mapOutput(size_t size);
+      // free the parity blocks written in the background, resend the failed ones,
+	  // and mark the stripes whose parity blocks are all written as redundant;
+	  // with wait_all, wait until all are written or given up.
+	  // return the number of blocks given up
+    int reapPendingWrites(bool wait_all);
+
+      // send the blocks of a stripe to their DNs concurrently when uploading,
+      // the parity blocks once the encode job is done, and wait until the data
+      // blocks and wait_parity_num parity blocks are written, the others are
+      // left to the background. Return the number of written blocks
+    int CNSendStripe(string stripe_name, string blk_names[], char** buf, map<int, string>& blk_id2IP, int encode_job, int wait_parity_num);
+      // let the DNs compute parity blocks: parity_ids[p] from the blocks of
+      // equations[p], which are named and located by blk_names[p] and blk_IPs[p],
+      // return the number of parity blocks written, and their names in written_blks
+      // unless NULL; a repair is computed the same way, to blk_IPs[p][parity_ids[p]]
+    int encodeParitiesOnDN(vector<int>& parity_ids, vector<Equation>& equations, vector<vector<string>>& blk_names, vector<vector<string>>& blk_IPs, string gw_ip, set<string>* written_blks);
+      // let the DNs compute the fast local parity blocks of an uploaded stripe,
+      // return the number of local parity blocks written
+    int encodeLocalParitiesOnDN(string blk_names[], map<int, string>& blk_id2IP, string gw_ip);
+      // replicated upload: the replica-th (1 ~ replica_num - 1) extra replica of a
+      // data block is named with 'r', 's' in place of the last '-' of the block, and
+      // stored by the node of its fast local parity block (1st) or of a global
+      // parity block (2nd), so that these parity blocks are encoded from local replicas
+    string replicaName(string blk_name, int replica);
+    string replicaIP(int data_id, int replica, map<int, string>& blk_id2IP);
+      // read the data blocks and the parity blocks of a stripe to the CN, and
+      // check that each parity block is its equation over the data blocks
+    bool verifyParities(vector<string>& names, vector<string>& IPs, vector<int>& parity_ids, vector<Equation>& equations);
+      // run recovery tasks, recovery_batch stripes at once in waves of disjoint
+      // nodes, and move each block to its new node once written; return the
+      // number of rebuilt blocks, the rebuilt blocks are added to written_blks
+      // and leave the repair queue
+    int runRecoveryTasks(vector<RecoveryTask>& tasks, set<string>& written_blks);
+      // repair the first repair_concurrency stripes of repairs, each missing
+      // block at chooseRepairTarget; return the number of repaired blocks, and
+      // the least time the round takes at the repair bandwidths in min_time
+    int repairRound(double& min_time);
+    void runRepairDaemon(void);
+      // the failed blocks of each stripe with blocks on the failed nodes,
+      // which are marked under-redundant and queued for repair
+    map<string, vector<int>> collectLostBlocks(set<string>& failed_ips);
+      // the blocks and nodes of a stripe
+    void getStripeLayout(string stripe, vector<string>& names, vector<string>& IPs);
+      // send the data blocks of a stripe and their replicas, return the number of written blocks
+    int CNSendReplicas(string blk_names[], char** buf, map<int, string>& blk_id2IP);
       // calculate local parity block when uploading
     void calculateLocalParityBlock(int local_blk_id, char** buf);
+      // calculate the g global parity blocks when uploading
+    void calculateGlobalParityBlocks(char** buf);
 
       // functions required for decode
       // decide the local parity block id related to a missing data block
@@ -53,6 +245,61 @@ class Coordinator{
 
       // generate commands for decode, upcode and downcode
     string generateDecodeCmd(string stripe_blks[], string blk_IPs[], int blk_id, int missing_ID, bool hot, string gw_ip, char* gw_cmd);
+      // repair several failed blocks (data or parity) of a stripe with the global parity blocks
+    bool decodeMultiFailures(string stripe_blks[], string blk_IPs[], int blk_nodes[], vector<int> missing_IDs, bool hot, string gw_ip, bool simulated);
+      // the node that rebuilds missing_ID by equation: the one, among its
+      // current node and the nodes holding no block of the stripe, that breaks
+      // the fewest rack constraints of place_method, then sends the fewest
+      // blocks across racks, then has the least repair_load; the current node
+      // wins the ties
+    string chooseRepairTarget(string blk_IPs[], int stripe_len, int missing_ID, const Equation& equation, bool hot, string gw_ip);
+      // blocks of a stripe out of the racks that place_method puts them in:
+      // Opt-S and Opt-R keep each fast local group (with its local parity
+      // block), and the global parity blocks, within a rack; Flat spreads the
+      // blocks evenly over the racks
+    int placementViolations(string blk_IPs[], int stripe_len, bool hot);
+      // blocks sent across racks to rebuild a block at target by equation,
+      // one per helper rack other than the rack of target
+    int crossRackBlocks(string blk_IPs[], const Equation& equation, string target);
+      // the equations of the reserved fast local parity block reserved_id
+      // (k ~ k+l_f-1) of a cold stripe, indexed in the cold stripe: the data
+      // blocks of its fast group, or its compact local parity block and the
+      // data blocks of the other fast groups of its compact group
+    vector<Equation> reservedEquations(int reserved_id);
+      // rebuild a lost reserved block of a cold stripe, at its node unless
+      // lost with it (lost_reserved), by the equation of the fewest blocks
+      // across racks; reserved_IPs[reserved_id] is updated to its new node
+    bool repairReservedBlock(string stripe_blks[], string blk_IPs[], string reserved_blks[], string reserved_IPs[], int reserved_id, string gw_ip);
+      // the cross-rack blocks of repairing each type of block, on a placement
+      // of each placement method, appended to fpr unless NULL
+    void reportRepairCostByType(FILE* fpr);
+    map<string, string> generateMultiDecodeCmd(string stripe_blks[], string blk_IPs[], int missing_ID, const Equation& equation, string gw_ip, char* gw_cmd);
+      // the same repair as a pipelined chain of the helpers ("ch"), with the
+      // gateway as a hop, so that every link carries a single block
+    map<string, string> generateChainRepairCmds(string stripe_blks[], string blk_IPs[], int missing_ID, const Equation& equation, string gw_ip);
+      // the same repair split into packet-aligned slices, each reconstructed by
+      // a node of the target rack that holds no block of the stripe, and
+      // streamed to the target; empty if the repair cannot be sliced
+    map<string, string> generateSlicedRepairCmds(string stripe_blks[], string blk_IPs[], int stripe_len, int missing_ID, const Equation& equation, string gw_ip);
+
+      // plan templates (see PlanCache): the placement signature of the blocks
+      // located at the nodes blk_nodes (ids of Metadata), the signature of the
+      // loads of the helpers of a repair, and the templates of an upcode, a
+      // downcode, and a repair of missing_ID, compiled from the generators
+      // above and cached under key; a repair template has no command if the
+      // planner finds no plan
+    string placementSignature(const int blk_nodes[], int len);
+    string loadSignature(const int blk_nodes[], const Equation& equation);
+    PlanTemplate* compileUpcodePlan(string key, string gw_ip);
+    PlanTemplate* compileDowncodePlan(string key, string gw_ip);
+    PlanTemplate* compileRepairPlan(string key, string blk_IPs[], const int blk_nodes[], int stripe_len, int missing_ID, const Equation& equation, string gw_ip);
+      // rebuild a missing block for a read by the partial sums of each helper
+      // rack, sent to the CN; unless fallbacks is NULL, the partial sums are
+      // cached by their aggregators, or read from their caches, in which case
+      // their fallbacks are added to fallbacks keyed by their ids
+    map<string, string> generateDegradedReadCmds(string stripe_blks[], string blk_IPs[], int missing_ID, const Equation& equation, int& partial_num, map<long, PartialFallback>* fallbacks);
+      // the parity blocks of a stripe change, e.g., by an upcode
+    void bumpParityVersions(string stripe);
     string generateUpcodeCmd(string stripe_blks[], string blk_IPs[], int fast_local_parity_id, string gw_ip, char* gw_cmd);
     string generateDowncodeCmd(string stripe_blks[], string blk_IPs[], string reserved_blks[], string reserved_IPs[], int blk_id, int reserved_id, string gw_ip, char* gw_cmd, char* gw_cmd_f);
     string generateDowncodeCmd4DataAndFastLP(string stripe_blks[], string blk_IPs[], string reserved_blks[], string reserved_IPs[], int blk_id, string gw_ip, char* gw_cmd);
@@ -66,14 +313,44 @@ class Coordinator{
     void testPerformance(string file);
 
       // [[[kernel routines]]]: 
-	  //  1. uploadFile,
-	  //  2. downloadFile,
+	  //  1. uploadFile, with the local parity blocks computed by the CN or by the DNs,
+	  //     or replicated and encoded later by encodeReplicatedFile,
+	  //  2. downloadFile, which repairs a (simulated) missing block, and readFile,
 	  //  3. upcodeFile, i.e., upcoding a file from fast code to compact code,
-	  //  4. downcodeFile, i.e., downcoding a file from compact code to fast code.
-    void uploadFile(string file);
+	  //  4. downcodeFile, i.e., downcoding a file from compact code to fast code,
+	  //  5. overwriteBlock, i.e., overwriting a data block in place.
+    void uploadFile(string file, int mode);
+      // encode a replicated file into the fast code on the DNs, and delete the replicas
+    double encodeReplicatedFile(string file);
     double downloadFile(string file, int missing_block_id);
+      // streaming read of a file, with degraded reads of the missing data blocks,
+      // return the read time
+    double readFile(string file);
+      // read length bytes from offset of a file, fetching only the packets that
+      // the range covers, return the read time
+    double readRange(string file, size_t offset, size_t length);
+      // repair the blocks queued by the degraded reads, return the number of repaired blocks
+    int repairQueuedBlocks(void);
+      // print the stripes queued for repair by the failures they can still take, and the drain rate
+    void reportRepairQueue(void);
+      // a foreground command runs between them, while the repair daemon waits
+    void enterForeground(void);
+    void leaveForeground(void);
+      // rebuild all the blocks of a failed DN on the other nodes of its rack,
+      // return the recovery time
+    double recoverNode(string dn_ip);
+      // rebuild all the blocks of a failed rack in the other racks, with the
+      // least cross-rack traffic, return the recovery time
+    double recoverRack(string rack);
     double upcodeFile(string file);
     double downcodeFile(string file);
+    void overwriteBlock(string file, int blk_idx, string new_data_file);
+      // patch the parity blocks with the pending overwrites
+    void flushUpdates(void);
+      // the parity blocks of a stripe must be patched with its pending
+      // overwrites before the stripe is rebuilt from them: flush if any of
+      // stripes has some, and return those left pending
+    set<string> flushBeforeRebuild(const set<string>& stripes);
 
       // decide the stripe's blocks' locations
       // main function for cluster-aware placement
@@ -88,6 +365,19 @@ class Coordinator{
     void testUpcodeCmd_k_12(void);
       // test downcode command, when k = 12
     void testDowncodeCmd_k_12(void);
+      // test the throughput of local (XOR) and global (GF) parity encoding
+    void testEncodeThroughput(void);
+      // test the throughput of the specialized XOR fan-in against the generic one
+    void testKernelThroughput(void);
+      // check the repairs of all the erasure patterns, those with the global
+      // parity blocks included, against the lost blocks
+    void testGlobalRepair(void);
+      // report the cross-rack transfers of repair, upcode and downcode for each placement
+    void reportCrossRackCost(void);
+      // benchmark planning the upcode, downcode and a repair of stripe_num
+      // stripes placed by decide_location, per stripe against from the plan
+      // templates, and append to ./results
+    void testPlanCache(int stripe_num);
 };
 
 #endif
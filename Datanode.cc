@@ -16,9 +16,16 @@ Datanode::Datanode(Config* config, Socket* cn2dnSocket, Socket* dn2dnSocket){
   chunk_size = 1024*1024*conf->chunk_size;
   packet_size = 1024*1024*conf->packet_size;
   data_blk_name = new char[data_path.length() + 1 + blk_name_len];
+  kernel = getLRCKernel(conf);
+  cout<<"LRC kernel: "<<kernel->name()<<endl;
+  layout = new CodeLayout(k, l_f, l_c);
+  partial_sums = new PartialSumCache(conf->partial_cache_blocks);
 }
 
 Datanode::~Datanode(){
+  delete kernel;
+  delete layout;
+  delete partial_sums;
 }
 
   // receive commands from the CN
@@ -35,6 +42,23 @@ void Datanode::analyzeAndRespond(char* cmd, int cmd_length){
   if(cmd[0] == 'd' && cmd[1] == 'l' && cmd_length == (2 + blk_name_len)){
     // download the file
     analysisDownloadCmd(cmd, cmd_length);
+  } else if(cmd[0] == 'c' && cmd[1] == 'k' && cmd_length == (2 + blk_name_len)){
+    // check a parity block
+    analysisCheckCmd(cmd, cmd_length);
+  } else if(cmd[0] == 'm' && cmd[1] == 'd') {
+    // decode block with global parity blocks
+    analysisMultiDecodeCmd(cmd, cmd_length, 0, chunk_size);
+  } else if(cmd[0] == 'm' && cmd[1] == 'r') {
+    // decode a packet range of a block, i.e., "mr" + offset + length + an md command
+    size_t blk_offset = strtoul(string(cmd + 2, RANGE_FIELD_LEN).c_str(), NULL, 10);
+    size_t len = strtoul(string(cmd + 2 + RANGE_FIELD_LEN, RANGE_FIELD_LEN).c_str(), NULL, 10);
+    analysisMultiDecodeCmd(cmd + 2 + 2 * RANGE_FIELD_LEN, cmd_length - 2 - 2 * RANGE_FIELD_LEN, blk_offset, len);
+  } else if(cmd[0] == 'p' && cmd[1] == 'r' && cmd_length == (2 + PARTIAL_ID_LEN + blk_name_len)) {
+    // send a cached partial sum of a degraded read
+    analysisPartialSumCmd(cmd, cmd_length);
+  } else if(cmd[0] == 'c' && cmd[1] == 'h') {
+    // a hop of a chain repair
+    analysisChainCmd(cmd, cmd_length);
   } else if(cmd[0] == 'd' && cmd[1] == 'e') {
     // decode block
     analysisDecodeCmd(cmd, cmd_length);
@@ -50,6 +74,21 @@ void Datanode::analyzeAndRespond(char* cmd, int cmd_length){
   } else if(cmd[0] == 'e' && cmd[1] == 'n') {
     // encode and upload the file
     analysisUploadCmd(cmd, cmd_length);
+  } else if(cmd[0] == 'o' && cmd[1] == 'w') {
+    // overwrite a data block
+    analysisOverwriteCmd(cmd, cmd_length);
+  } else if(cmd[0] == 'd' && cmd[1] == 'd' && cmd_length == (2 + blk_name_len)) {
+    // drop the delta of a data block
+    analysisDropDeltaCmd(cmd, cmd_length);
+  } else if(cmd[0] == 'r' && cmd[1] == 'd' && cmd_length == (2 + blk_name_len)) {
+    // read a block, i.e., send it to the CN with its tag
+    analysisReadCmd(cmd, cmd_length);
+  } else if(cmd[0] == 'r' && cmd[1] == 'r' && cmd_length == (2 + blk_name_len + 2 * RANGE_FIELD_LEN)) {
+    // read a packet range of a block
+    analysisRangeReadCmd(cmd, cmd_length);
+  } else if(cmd[0] == 'r' && cmd[1] == 'm' && cmd_length == (2 + blk_name_len)) {
+    // remove the replica of a data block
+    analysisRemoveCmd(cmd, cmd_length);
   } else if(cmd[0] == 'g' && cmd[1] == 'a') {
     // process gateway commands
     analysisGWCmd(cmd, cmd_length);
@@ -79,9 +118,14 @@ void Datanode::analysisUploadCmd(char* cmd, int cmd_length){
   int packet_num = chunk_size / packet_size;
   int* mark_recv = new int[packet_num];
   cn2dnSoc->paraRecvData(CN_UP_DATA_PORT, buf, chunk_size, packet_size, 1, mark_recv, DATA_CHUNK, NULL);
-  fwrite(buf, 1, chunk_size, fp);
-  sendAck("write blk success");
-  cout<<"*** write blk success"<<endl;
+    // the ack names the block, as the CN may collect the acks of several stripes
+  if(fp != NULL && fwrite(buf, 1, chunk_size, fp) == (size_t)chunk_size) {
+    sendAck("write blk success" + string(blk_nm));
+    cout<<"*** write blk success"<<endl;
+  } else {
+    sendAck("write blk fail" + string(blk_nm));
+    cout<<"*** write blk fail"<<endl;
+  }
 
   delete blk_nm;
   delete blk_loc;
@@ -125,6 +169,178 @@ void Datanode::analysisDownloadCmd(char* cmd, int cmd_length){
   }
 }
 
+  // check whether a block exists, unlike "dl", the block is not
+  // remembered for a later "re"
+void Datanode::analysisCheckCmd(char* cmd, int cmd_length){
+  char* blk_loc = new char[data_path.length() + 1 + blk_name_len];
+  strcpy(blk_loc, data_path.c_str());
+  strncat(blk_loc, cmd + 2, blk_name_len);
+  blk_loc[data_path.length() + blk_name_len] = '\0';
+
+  FILE* fp = fopen(blk_loc, "r");
+  if(fp != NULL) {
+    sendAck("blk_ex");
+    fclose(fp);
+  } else {
+    sendAck("blk_mi");
+    cout<<"*** missing block "<<blk_loc<<endl;
+  }
+  delete[] blk_loc;
+}
+
+  // analyze overwrite command, "ow" + block, the new content of the block
+  // comes from the CN; old XOR new is accumulated in the delta of the block,
+  // e.g., "FI0000-0000d03" for "FI0000-0000-03", until the CN flushes it.
+  // The new block and delta are written aside first, and renamed over the old
+  // ones once both are written, so a failed overwrite ("fa_owri") leaves both
+  // untouched
+void Datanode::analysisOverwriteCmd(char* cmd, int cmd_length){
+  string blk_loc = data_path + string(cmd + 2, blk_name_len);
+  string delta_loc = blk_loc;
+  delta_loc[data_path.length() + 11] = 'd';
+  string blk_tmp = blk_loc + ".tmp";
+  string delta_tmp = delta_loc + ".tmp";
+
+  char* new_buf = new char[chunk_size];
+  int packet_num = chunk_size / packet_size;
+  int* mark_recv = new int[packet_num];
+  cn2dnSoc->paraRecvData(CN_UP_DATA_PORT, new_buf, chunk_size, packet_size, 1, mark_recv, DATA_CHUNK, NULL);
+
+  char* delta_buf = new char[chunk_size];
+  char* read_buf = new char[chunk_size];
+  bool written = false;
+  FILE* fp = fopen(blk_loc.c_str(), "r");
+  if(fp == NULL) {
+    cout<<"*** cannot read block file: "<<blk_loc<<endl;
+  } else {
+    size_t old_len = fread(delta_buf, 1, chunk_size, fp);
+    fclose(fp);
+    if(old_len != (size_t)chunk_size) {
+      cout<<"*** short block file: "<<blk_loc<<", "<<old_len<<" bytes"<<endl;
+    } else {
+      ErasureCode::xorRegion(new_buf, delta_buf, chunk_size);
+      // the block was overwritten before in this window
+      fp = fopen(delta_loc.c_str(), "r");
+      if(fp != NULL) {
+        fread(read_buf, 1, chunk_size, fp);
+        fclose(fp);
+        ErasureCode::xorRegion(read_buf, delta_buf, chunk_size);
+      }
+      written = writeFile(delta_tmp, delta_buf) && writeFile(blk_tmp, new_buf);
+      if(written) {
+        written = rename(blk_tmp.c_str(), blk_loc.c_str()) == 0 && rename(delta_tmp.c_str(), delta_loc.c_str()) == 0;
+      }
+      remove(blk_tmp.c_str());
+      remove(delta_tmp.c_str());
+    }
+  }
+  if(written) {
+    sendAck("fi_owri");
+    cout<<"*** send ack fi_owri"<<endl;
+  } else {
+    cout<<"*** cannot overwrite block file: "<<blk_loc<<endl;
+    sendAck("fa_owri");
+  }
+
+  delete[] new_buf;
+  delete[] delta_buf;
+  delete[] read_buf;
+  delete[] mark_recv;
+}
+
+bool Datanode::writeFile(string path, char* buf) {
+  FILE* fp = fopen(path.c_str(), "w");
+  if(fp == NULL) {
+    return false;
+  }
+  size_t ret = fwrite(buf, 1, chunk_size, fp);
+  bool flushed = (fflush(fp) == 0 && fsync(fileno(fp)) == 0);
+  fclose(fp);
+  return ret == (size_t)chunk_size && flushed;
+}
+
+  // drop the delta of a data block after the parity blocks are patched
+void Datanode::analysisDropDeltaCmd(char* cmd, int cmd_length){
+  char* delta_loc = new char[data_path.length() + 1 + blk_name_len];
+  strcpy(delta_loc, data_path.c_str());
+  strncat(delta_loc, cmd + 2, blk_name_len);
+  delta_loc[data_path.length() + blk_name_len] = '\0';
+  if(remove(delta_loc) == 0) {
+    cout<<"delete "<<delta_loc<<endl;
+  }
+  delete[] delta_loc;
+}
+
+  // send a block to the CN tagged with its name, no existence check beforehand:
+  // a missing block is answered with the "mi" tag and no data
+void Datanode::analysisReadCmd(char* cmd, int cmd_length){
+  char* tag = new char[DATA_TAG_LEN + 1];
+  strncpy(tag, cmd + 2, blk_name_len);
+  char* blk_loc = new char[data_path.length() + 1 + blk_name_len];
+  strcpy(blk_loc, data_path.c_str());
+  strncat(blk_loc, cmd + 2, blk_name_len);
+  blk_loc[data_path.length() + blk_name_len] = '\0';
+
+  char* buf = new char[chunk_size];
+  FILE* fp = fopen(blk_loc, "r");
+  if(fp != NULL && fread(buf, 1, chunk_size, fp) == (size_t)chunk_size) {
+    strcpy(tag + blk_name_len, "ok");
+    cn2dnSoc->sendTaggedData(tag, buf, chunk_size, packet_size, (char*)cn_ip.c_str(), CN_READ_DATA_PORT);
+  } else {
+    cout<<"*** block missing: "<<blk_loc<<endl;
+    strcpy(tag + blk_name_len, "mi");
+    cn2dnSoc->sendTaggedData(tag, NULL, 0, packet_size, (char*)cn_ip.c_str(), CN_READ_DATA_PORT);
+  }
+  if(fp != NULL) {
+    fclose(fp);
+  }
+  delete[] tag;
+  delete[] blk_loc;
+  delete[] buf;
+}
+
+  // send the packets [offset, offset + length) of a block to the CN, tagged
+  // with the block name, or the "mi" tag if the block is missing
+void Datanode::analysisRangeReadCmd(char* cmd, int cmd_length){
+  char* tag = new char[DATA_TAG_LEN + 1];
+  strncpy(tag, cmd + 2, blk_name_len);
+  size_t blk_offset = strtoul(string(cmd + 2 + blk_name_len, RANGE_FIELD_LEN).c_str(), NULL, 10);
+  size_t len = strtoul(string(cmd + 2 + blk_name_len + RANGE_FIELD_LEN, RANGE_FIELD_LEN).c_str(), NULL, 10);
+  char* blk_loc = new char[data_path.length() + 1 + blk_name_len];
+  strcpy(blk_loc, data_path.c_str());
+  strncat(blk_loc, cmd + 2, blk_name_len);
+  blk_loc[data_path.length() + blk_name_len] = '\0';
+
+  char* buf = new char[len];
+  int fd = open(blk_loc, O_RDONLY);
+  if(fd >= 0 && pread(fd, buf, len, blk_offset) == (ssize_t)len) {
+    strcpy(tag + blk_name_len, "ok");
+    cn2dnSoc->sendTaggedData(tag, buf, len, packet_size, (char*)cn_ip.c_str(), CN_READ_DATA_PORT);
+  } else {
+    cout<<"*** block missing: "<<blk_loc<<endl;
+    strcpy(tag + blk_name_len, "mi");
+    cn2dnSoc->sendTaggedData(tag, NULL, 0, packet_size, (char*)cn_ip.c_str(), CN_READ_DATA_PORT);
+  }
+  if(fd >= 0) {
+    close(fd);
+  }
+  delete[] tag;
+  delete[] blk_loc;
+  delete[] buf;
+}
+
+  // remove the replica of a data block after its stripe is encoded
+void Datanode::analysisRemoveCmd(char* cmd, int cmd_length){
+  char* replica_loc = new char[data_path.length() + 1 + blk_name_len];
+  strcpy(replica_loc, data_path.c_str());
+  strncat(replica_loc, cmd + 2, blk_name_len);
+  replica_loc[data_path.length() + blk_name_len] = '\0';
+  if(remove(replica_loc) == 0) {
+    cout<<"delete "<<replica_loc<<endl;
+  }
+  delete[] replica_loc;
+}
+
   // after fixing block missing, ready to download again
 void Datanode::analysisReadyDownloadCmd(char* cmd, int cmd_length) {
   // send a data block
@@ -182,13 +398,15 @@ void Datanode::analysisDecodeCmd(char* newCmd, int newCmdLen){
   } else if(newCmd[2] == 'w' && newCmd[3] == 'a') {
     // [relayer]
     // waited_blk_num: number of waited blocks
-    int waited_blk_num = newCmd[4] - '0';
+    int waited_blk_num = Socket::parseCount(newCmd + 4);
+    // "blk", then the waited ips
+    int ips_offset = 4 + COUNT_FIELD_LEN + 3;
     char** waited_ips = new char*[waited_blk_num];
     int wait_gw_id = -1;
     for(int j = 0; j < waited_blk_num; ++j) {
       waited_ips[j] = new char[ip_len + 1];
       for(int o = 0; o < ip_len; ++o) {
-        waited_ips[j][o] = newCmd[j*ip_len + 8 + o];
+        waited_ips[j][o] = newCmd[j*ip_len + ips_offset + o];
       }
       waited_ips[j][ip_len] = '\0';
       if(wait_gw_id == -1 && strcmp(waited_ips[j], (char*)(gw_ip.c_str())) == 0) {
@@ -204,7 +422,7 @@ void Datanode::analysisDecodeCmd(char* newCmd, int newCmdLen){
     char* buf = NULL;
     posix_memalign((void**)&buf, getpagesize(), chunk_size);
     memset(buf, 0, sizeof(char)*chunk_size);
-    if(newCmd[waited_blk_num*ip_len + 8] == 's') {
+    if(newCmd[waited_blk_num*ip_len + ips_offset] == 's') {
       struct timeval time1, time2;
       gettimeofday(&time1, NULL);
       int fd = open(data_blk_name, O_RDONLY | O_DIRECT);
@@ -215,7 +433,6 @@ void Datanode::analysisDecodeCmd(char* newCmd, int newCmdLen){
       cout<<"file read time: "<<time2.tv_sec-time1.tv_sec+(time2.tv_usec-time1.tv_usec)*1.0/1000000<<endl;
     }
 
-    int* int_buf;
 
     // [wait blocks from the same rack/ cluster, other racks/ clusters]
     struct timeval start_time, end_time1, end_time2, end_time3;
@@ -226,7 +443,7 @@ void Datanode::analysisDecodeCmd(char* newCmd, int newCmdLen){
       mark_recv[j] = -1;
     }
     char* waited_buf = new char[chunk_size*waited_blk_num];
-    int* int_waited_buf;
+    const char** packet_srcs = new const char*[waited_blk_num];
     // 1st, wait blocks from the same rack/ cluster
     dn2dnSoc->paraRecvData(DN_SEND_DATA_PORT, waited_buf, chunk_size, packet_size, waited_blk_num - wait_gw_num, mark_recv, DATA_CHUNK, NULL);
     if(wait_gw_num != 0) {
@@ -250,13 +467,10 @@ void Datanode::analysisDecodeCmd(char* newCmd, int newCmdLen){
           }
         }
         if(can_cal_this_packet) {
-          int_buf = (int*)(buf + j * packet_size);
           for(int o = 0; o < waited_blk_num; ++o) {
-            int_waited_buf = (int*)(waited_buf + o * chunk_size + j * packet_size);
-            for(int num = 0; num < (long long)(packet_size * sizeof(char) / sizeof(int)); ++num) {
-              int_buf[num] = int_buf[num] ^ int_waited_buf[num];
-            }
+            packet_srcs[o] = waited_buf + o * chunk_size + j * packet_size;
           }
+          kernel->xorFanIn(packet_srcs, waited_blk_num, buf + j * packet_size, packet_size);
 
           cal_packet_num++;
           for(int o = 0; o < waited_blk_num; ++o) {
@@ -269,10 +483,10 @@ void Datanode::analysisDecodeCmd(char* newCmd, int newCmdLen){
     cout<<"calculate time: "<<end_time2.tv_sec-end_time1.tv_sec+(end_time2.tv_usec-end_time1.tv_usec)*1.0/1000000<<endl;
 
     // [re-send the XOR sum or store the XOR sum]
-    if(newCmd[waited_blk_num*ip_len + 8] == 's') {
+    if(newCmd[waited_blk_num*ip_len + ips_offset] == 's') {
       char* redirect_ip = new char[ip_len + 1];
       for(int j = 0; j < ip_len; ++j) {
-        redirect_ip[j] = newCmd[waited_blk_num*ip_len + blk_name_len + 10 + j];
+        redirect_ip[j] = newCmd[waited_blk_num*ip_len + ips_offset + 2 + blk_name_len + j];
       }
       redirect_ip[ip_len] = '\0';
       cout<<"XXXXXX redirected ip: "<<redirect_ip<<endl;
@@ -281,7 +495,7 @@ void Datanode::analysisDecodeCmd(char* newCmd, int newCmdLen){
       gettimeofday(&end_time3, NULL);
       cout<<"redirect time: "<<end_time3.tv_sec-end_time2.tv_sec+(end_time3.tv_usec-end_time2.tv_usec)*1.0/1000000<<endl;
       delete redirect_ip;
-    } else if (newCmd[waited_blk_num*ip_len + 8] == 'r') {
+    } else if (newCmd[waited_blk_num*ip_len + ips_offset] == 'r') {
       // store the XOR sum
       int fd = open(data_blk_name,  O_CREAT | O_WRONLY | O_SYNC, 0755);
       ssize_t ret = write(fd, buf, chunk_size);
@@ -301,9 +515,356 @@ void Datanode::analysisDecodeCmd(char* newCmd, int newCmdLen){
     free(buf);
     delete mark_recv;
     delete waited_buf;
+    delete[] packet_srcs;
 
   }
 
+}
+
+  // analyze decode command with global parity blocks, i.e.,
+  // "mdwa" + n + "blk" + n ips + "in" + m + m (coef + block) + ("se" + ip | "reco" + block)
+  // the node sums up its own blocks multiplied by their coefficients and the
+  // partial sums of the waited nodes, then re-sends or stores the sum.
+  // a sliced repair ends with "sc" + s + s (ip + length), which scatters the
+  // consecutive slices of the sum to s nodes, "sl" + ip, which streams a slice
+  // to the node of the block, or "sm" + n + block, which stores the own slice
+  // together with the n slices streamed by the other nodes. The aggregator of
+  // a degraded read ends with "rt" + block, which returns the sum to the CN,
+  // preceded by "ca" + id + evicted id to keep the sum in partial_sums
+void Datanode::analysisMultiDecodeCmd(char* newCmd, int newCmdLen, size_t blk_offset, size_t len) {
+  // "wa"
+  // waited_blk_num: number of waited blocks
+  int waited_blk_num = Socket::parseCount(newCmd + 4);
+  // "blk"
+  // "ip1ip2..."
+  int ips_offset = 4 + COUNT_FIELD_LEN + 3;
+  int wait_gw_num = 0;
+  char* waited_ip = new char[ip_len + 1];
+  for(int j = 0; j < waited_blk_num; ++j) {
+    strncpy(waited_ip, newCmd + j*ip_len + ips_offset, ip_len);
+    waited_ip[ip_len] = '\0';
+    if(strcmp(waited_ip, (char*)(gw_ip.c_str())) == 0) {
+      wait_gw_num++;
+    }
+  }
+  delete[] waited_ip;
+  int offset = waited_blk_num*ip_len + ips_offset;
+
+  // "in"
+  // read own blocks
+  int own_blk_num = Socket::parseCount(newCmd + offset + 2);
+  offset += 2 + COUNT_FIELD_LEN;
+  char* buf = NULL;
+  posix_memalign((void**)&buf, getpagesize(), len);
+  memset(buf, 0, sizeof(char)*len);
+  // O_DIRECT reads whole pages, around the range
+  size_t page_size = getpagesize();
+  size_t read_offset = blk_offset / page_size * page_size;
+  size_t read_len = (blk_offset + len - read_offset + page_size - 1) / page_size * page_size;
+  char* read_buf = NULL;
+  posix_memalign((void**)&read_buf, page_size, read_len);
+  char* blk_loc = new char[data_path.length() + 1 + blk_name_len];
+  struct timeval start_time, end_time1, end_time2, end_time3;
+  gettimeofday(&start_time, NULL);
+  // a block that cannot be read spoils the sum: it is neither cached nor
+  // stored, and the node that would store it acks "fa_deco" instead
+  bool read_failed = false;
+  for(int j = 0; j < own_blk_num; ++j) {
+    unsigned char coef = (unsigned char)((newCmd[offset] - '0')*100 + (newCmd[offset + 1] - '0')*10 + (newCmd[offset + 2] - '0'));
+    strcpy(blk_loc, data_path.c_str());
+    strncat(blk_loc, newCmd + offset + 3, blk_name_len);
+    blk_loc[data_path.length() + blk_name_len] = '\0';
+    int fd = open(blk_loc, O_RDONLY | O_DIRECT);
+    ssize_t ret = -1;
+    if(fd >= 0) {
+      ret = pread(fd, read_buf, read_len, read_offset);
+      close(fd);
+    }
+    cout<<"read size: "<<ret<<", coef: "<<(int)coef<<endl;
+    if(ret < 0 || (size_t)ret < blk_offset - read_offset + len) {
+      cout<<"cannot read "<<blk_loc<<endl;
+      read_failed = true;
+    } else {
+      ErasureCode::gfMulRegion(coef, read_buf + (blk_offset - read_offset), buf, len, true);
+    }
+    offset += 3 + blk_name_len;
+  }
+  free(read_buf);
+  gettimeofday(&end_time1, NULL);
+  cout<<"read and multiply time: "<<end_time1.tv_sec-start_time.tv_sec+(end_time1.tv_usec-start_time.tv_usec)*1.0/1000000<<endl;
+
+  // [wait partial sums from the same rack/ cluster, other racks/ clusters]
+  if(waited_blk_num != 0) {
+    int packet_num = len / packet_size;
+    int* mark_recv = new int[packet_num*waited_blk_num];
+    for(int j = 0; j < packet_num*waited_blk_num; ++j) {
+      mark_recv[j] = -1;
+    }
+    char* waited_buf = new char[len*waited_blk_num];
+    // 1st, wait blocks from the same rack/ cluster
+    if(waited_blk_num - wait_gw_num != 0) {
+      dn2dnSoc->paraRecvData(DN_SEND_DATA_PORT, waited_buf, len, packet_size, waited_blk_num - wait_gw_num, mark_recv, DATA_CHUNK, NULL);
+    }
+    // 2rd, wait blocks from the gateway (other racks/ clusters) one by one
+    for(int i = waited_blk_num - wait_gw_num; i < waited_blk_num; ++i) {
+      dn2dnSoc->paraRecvData(DN_SEND_DATA_PORT, waited_buf + i*len, len, packet_size, 1, mark_recv + i*packet_num, DATA_CHUNK, NULL);
+    }
+    for(int i = 0; i < waited_blk_num; ++i) {
+      ErasureCode::xorRegion(waited_buf + i*len, buf, len);
+    }
+    delete[] mark_recv;
+    delete[] waited_buf;
+  }
+  gettimeofday(&end_time2, NULL);
+  cout<<"recv and calculate time: "<<end_time2.tv_sec-end_time1.tv_sec+(end_time2.tv_usec-end_time1.tv_usec)*1.0/1000000<<endl;
+
+  // [cache the sum of a degraded read, i.e., "ca" + id + evicted id]
+  if(newCmd[offset] == 'c' && newCmd[offset + 1] == 'a') {
+    long id = strtol(string(newCmd + offset + 2, PARTIAL_ID_LEN).c_str(), NULL, 10);
+    long evicted = strtol(string(newCmd + offset + 2 + PARTIAL_ID_LEN, PARTIAL_ID_LEN).c_str(), NULL, 10);
+    if(evicted != 0) {
+      partial_sums->erase(evicted);
+    }
+    if(!read_failed) {
+      partial_sums->insert(id, buf, len);
+    }
+    offset += 2 + 2 * PARTIAL_ID_LEN;
+  }
+
+  // [re-send the sum or store the sum]
+  if(newCmd[offset] == 's' && newCmd[offset + 1] == 'c') {
+    int slice_num = Socket::parseCount(newCmd + offset + 2);
+    char* slice_ip = new char[ip_len + 1];
+    size_t slice_offset = 0;
+    offset += 2 + COUNT_FIELD_LEN;
+    for(int j = 0; j < slice_num; ++j) {
+      strncpy(slice_ip, newCmd + offset, ip_len);
+      slice_ip[ip_len] = '\0';
+      size_t slice_len = strtoul(string(newCmd + offset + ip_len, RANGE_FIELD_LEN).c_str(), NULL, 10);
+      dn2dnSoc->sendData(buf + slice_offset, slice_len, packet_size, slice_ip, DN_SEND_DATA_PORT);
+      slice_offset += slice_len;
+      offset += ip_len + RANGE_FIELD_LEN;
+    }
+    delete[] slice_ip;
+  } else if(newCmd[offset] == 's' && newCmd[offset + 1] == 'l') {
+    char* target_ip = new char[ip_len + 1];
+    strncpy(target_ip, newCmd + offset + 2, ip_len);
+    target_ip[ip_len] = '\0';
+    char fields[2 * RANGE_FIELD_LEN + 1];
+    sprintf(fields, "%010zu%010zu", blk_offset, len);
+    int connfd = dn2dnSoc->connectStream(target_ip, DN_CHAIN_DATA_PORT);
+    dn2dnSoc->writeStream(connfd, fields, 2 * RANGE_FIELD_LEN);
+    dn2dnSoc->writeStream(connfd, buf, len);
+    close(connfd);
+    delete[] target_ip;
+  } else if(newCmd[offset] == 's' && newCmd[offset + 1] == 'm') {
+    // the own slice, then the others in the order they are streamed
+    int slice_num = Socket::parseCount(newCmd + offset + 2);
+    char* blk_buf = new char[chunk_size];
+    memcpy(blk_buf + blk_offset, buf, len);
+    bool complete = true;
+    int listener = dn2dnSoc->initListener(DN_CHAIN_DATA_PORT);
+    char fields[2 * RANGE_FIELD_LEN + 1];
+    for(int j = 0; j < slice_num; ++j) {
+      int connfd = dn2dnSoc->acceptStream(listener);
+      if(!dn2dnSoc->readStream(connfd, fields, 2 * RANGE_FIELD_LEN)) {
+        complete = false;
+        close(connfd);
+        continue;
+      }
+      size_t slice_offset = strtoul(string(fields, RANGE_FIELD_LEN).c_str(), NULL, 10);
+      size_t slice_len = strtoul(string(fields + RANGE_FIELD_LEN, RANGE_FIELD_LEN).c_str(), NULL, 10);
+      if(slice_offset + slice_len > (size_t)chunk_size || !dn2dnSoc->readStream(connfd, blk_buf + slice_offset, slice_len)) {
+        complete = false;
+      }
+      close(connfd);
+    }
+    dn2dnSoc->closeListener(listener);
+    if(read_failed) {
+      sendAck("fa_deco" + string(newCmd + offset + 2 + COUNT_FIELD_LEN, blk_name_len));
+      cout<<"*** send ack fa_deco"<<endl;
+    } else if(complete) {
+      strcpy(blk_loc, data_path.c_str());
+      strncat(blk_loc, newCmd + offset + 2 + COUNT_FIELD_LEN, blk_name_len);
+      blk_loc[data_path.length() + blk_name_len] = '\0';
+      int fd = open(blk_loc, O_CREAT | O_WRONLY | O_TRUNC | O_SYNC, 0755);
+      ssize_t ret = write(fd, blk_buf, chunk_size);
+      close(fd);
+      cout<<"write size: "<<ret<<endl;
+      sendAck("fi_deco" + string(newCmd + offset + 2 + COUNT_FIELD_LEN, blk_name_len));
+      cout<<"*** send ack fi_deco"<<endl;
+    }
+    delete[] blk_buf;
+  } else if(newCmd[offset] == 's') {
+    char* redirect_ip = new char[ip_len + 1];
+    strncpy(redirect_ip, newCmd + offset + 2, ip_len);
+    redirect_ip[ip_len] = '\0';
+    dn2dnSoc->sendData(buf, len, packet_size, redirect_ip, DN_SEND_DATA_PORT);
+    delete[] redirect_ip;
+  } else if(newCmd[offset] == 'r' && newCmd[offset + 1] == 't') {
+    // a degraded read, return the partial sum to the CN, tagged with the missing block
+    char* tag = new char[DATA_TAG_LEN + 1];
+    strncpy(tag, newCmd + offset + 2, blk_name_len);
+    strcpy(tag + blk_name_len, "ps");
+    cn2dnSoc->sendTaggedData(tag, buf, len, packet_size, (char*)cn_ip.c_str(), CN_READ_DATA_PORT);
+    delete[] tag;
+  } else if(newCmd[offset] == 'r' && read_failed) {
+    sendAck("fa_deco" + string(newCmd + offset + 4, blk_name_len));
+    cout<<"*** send ack fa_deco"<<endl;
+  } else if(newCmd[offset] == 'r') {
+    strcpy(blk_loc, data_path.c_str());
+    strncat(blk_loc, newCmd + offset + 4, blk_name_len);
+    blk_loc[data_path.length() + blk_name_len] = '\0';
+    int fd = open(blk_loc, O_CREAT | O_WRONLY | O_TRUNC | O_SYNC, 0755);
+    ssize_t ret = write(fd, buf, len);
+    close(fd);
+    cout<<"write size: "<<ret<<endl;
+    // respond "fi_deco" to the coordinator, followed by the block name
+    sendAck("fi_deco" + string(newCmd + offset + 4, blk_name_len));
+    cout<<"*** send ack fi_deco"<<endl;
+  }
+  gettimeofday(&end_time3, NULL);
+  cout<<"send/ write time: "<<end_time3.tv_sec-end_time2.tv_sec+(end_time3.tv_usec-end_time2.tv_usec)*1.0/1000000<<endl;
+
+  delete[] blk_loc;
+  free(buf);
+}
+
+  // analyze cached partial sum command, i.e., "pr" + id + missing block. The
+  // sum is sent to the CN as a computed one ("ps"); if it is not cached any
+  // more, e.g., after a restart, the id is sent back instead ("pm"), and the
+  // CN falls back to computing it
+void Datanode::analysisPartialSumCmd(char* cmd, int cmd_length) {
+  long id = strtol(string(cmd + 2, PARTIAL_ID_LEN).c_str(), NULL, 10);
+  char* tag = new char[DATA_TAG_LEN + 1];
+  strncpy(tag, cmd + 2 + PARTIAL_ID_LEN, blk_name_len);
+  char* buf = new char[chunk_size];
+  if(partial_sums->copy(id, buf, chunk_size)) {
+    strcpy(tag + blk_name_len, "ps");
+    cn2dnSoc->sendTaggedData(tag, buf, chunk_size, packet_size, (char*)cn_ip.c_str(), CN_READ_DATA_PORT);
+  } else {
+    cout<<"partial sum "<<id<<" not cached"<<endl;
+    strcpy(tag + blk_name_len, "pm");
+    cn2dnSoc->sendTaggedData(tag, cmd + 2, PARTIAL_ID_LEN, packet_size, (char*)cn_ip.c_str(), CN_READ_DATA_PORT);
+  }
+  delete[] buf;
+  delete[] tag;
+}
+
+  // analyze chain repair command, i.e.,
+  // "chwa" + n + "in" + m + m (coef + block) + ("se" + ip | "reco" + block)
+  // the block is repaired packet by packet: the node adds its own packets,
+  // multiplied by their coefficients, to the streams of the n upstream hops,
+  // and passes the sum on to the next hop before the next packet arrives,
+  // so the hops of the chain work in parallel; the last hop stores the block
+void Datanode::analysisChainCmd(char* newCmd, int newCmdLen) {
+  int upstream_num = Socket::parseCount(newCmd + 4);
+  int own_blk_num = Socket::parseCount(newCmd + 4 + COUNT_FIELD_LEN + 2);
+  int offset = 4 + 2 * COUNT_FIELD_LEN + 2;
+  unsigned char* coefs = new unsigned char[own_blk_num + 1];
+  int* fds = new int[own_blk_num + 1];
+  char* blk_loc = new char[data_path.length() + 1 + blk_name_len];
+  for(int j = 0; j < own_blk_num; ++j) {
+    coefs[j] = (unsigned char)((newCmd[offset] - '0')*100 + (newCmd[offset + 1] - '0')*10 + (newCmd[offset + 2] - '0'));
+    strcpy(blk_loc, data_path.c_str());
+    strncat(blk_loc, newCmd + offset + 3, blk_name_len);
+    blk_loc[data_path.length() + blk_name_len] = '\0';
+    fds[j] = open(blk_loc, O_RDONLY);
+    offset += 3 + blk_name_len;
+  }
+
+  struct timeval start_time, end_time;
+  gettimeofday(&start_time, NULL);
+  // accept the upstream hops first, the downstream hop may be waiting for us
+  int* upstreams = new int[upstream_num + 1];
+  int listener = -1;
+  if(upstream_num != 0) {
+    listener = dn2dnSoc->initListener(DN_CHAIN_DATA_PORT);
+    for(int i = 0; i < upstream_num; ++i) {
+      upstreams[i] = dn2dnSoc->acceptStream(listener);
+    }
+    dn2dnSoc->closeListener(listener);
+  }
+  int downstream = -1;
+  char* out_buf = NULL;
+  if(newCmd[offset] == 's') {
+    char* next_ip = new char[ip_len + 1];
+    strncpy(next_ip, newCmd + offset + 2, ip_len);
+    next_ip[ip_len] = '\0';
+    cout<<"chain next hop: "<<next_ip<<endl;
+    downstream = dn2dnSoc->connectStream(next_ip, DN_CHAIN_DATA_PORT);
+    delete[] next_ip;
+  } else {
+    out_buf = new char[chunk_size];
+  }
+
+  // [pass the packets along]
+  char* acc = new char[packet_size];
+  char* in_buf = new char[packet_size];
+  bool broken = false;
+  for(size_t pos = 0; pos < (size_t)chunk_size && !broken; pos += packet_size) {
+    char* sum = (out_buf == NULL) ? acc : out_buf + pos;
+    memset(sum, 0, packet_size);
+    for(int i = 0; i < upstream_num; ++i) {
+      if(!dn2dnSoc->readStream(upstreams[i], in_buf, packet_size)) {
+        cout<<"chain upstream closed at "<<pos<<endl;
+        broken = true;
+        break;
+      }
+      ErasureCode::xorRegion(in_buf, sum, packet_size);
+    }
+    for(int j = 0; j < own_blk_num && !broken; ++j) {
+      if(fds[j] < 0 || pread(fds[j], in_buf, packet_size, pos) != (ssize_t)packet_size) {
+        cout<<"chain cannot read own block "<<j<<" at "<<pos<<endl;
+        broken = true;
+        break;
+      }
+      ErasureCode::gfMulRegion(coefs[j], in_buf, sum, packet_size, true);
+    }
+    if(downstream != -1 && !broken) {
+      broken = !dn2dnSoc->writeStream(downstream, sum, packet_size);
+    }
+  }
+  for(int i = 0; i < upstream_num; ++i) {
+    close(upstreams[i]);
+  }
+  if(downstream != -1) {
+    close(downstream);
+  }
+  for(int j = 0; j < own_blk_num; ++j) {
+    if(fds[j] >= 0) {
+      close(fds[j]);
+    }
+  }
+  gettimeofday(&end_time, NULL);
+  cout<<"chain time: "<<end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000<<endl;
+
+  // [store the block at the last hop]
+  if(out_buf != NULL) {
+    if(!broken) {
+      strcpy(blk_loc, data_path.c_str());
+      strncat(blk_loc, newCmd + offset + 4, blk_name_len);
+      blk_loc[data_path.length() + blk_name_len] = '\0';
+      int fd = open(blk_loc, O_CREAT | O_WRONLY | O_TRUNC | O_SYNC, 0755);
+      ssize_t ret = write(fd, out_buf, chunk_size);
+      close(fd);
+      cout<<"write size: "<<ret<<endl;
+      // respond "fi_deco" to the coordinator, followed by the block name
+      sendAck("fi_deco" + string(newCmd + offset + 4, blk_name_len));
+      cout<<"*** send ack fi_deco"<<endl;
+    } else {
+      sendAck("fa_deco" + string(newCmd + offset + 4, blk_name_len));
+      cout<<"*** send ack fa_deco"<<endl;
+    }
+    delete[] out_buf;
+  }
+
+  delete[] acc;
+  delete[] in_buf;
+  delete[] upstreams;
+  delete[] fds;
+  delete[] coefs;
+  delete[] blk_loc;
 }
 
   // analyze upcode command
@@ -333,11 +894,10 @@ void Datanode::analysisUpcodeCmd(char* newCmd, int newCmdLen) {
     gettimeofday(&end_time1, NULL);
     cout<<"read size: "<<ret<<endl;
     cout<<"file read time: "<<end_time1.tv_sec-start_time.tv_sec+(end_time1.tv_usec-start_time.tv_usec)*1.0/1000000<<endl;
-    int* int_buf;
 
     // "wa"
     // waited_blk_num: number of waited blocks
-    int waited_blk_num = newCmd[blk_name_len + 8] - '0';
+    int waited_blk_num = Socket::parseCount(newCmd + blk_name_len + 8);
     // "blk"
     // "ip1ip2..."
     char** waited_ips = new char*[waited_blk_num];
@@ -345,7 +905,7 @@ void Datanode::analysisUpcodeCmd(char* newCmd, int newCmdLen) {
     for(int j = 0; j < waited_blk_num; ++j) {
       waited_ips[j] = new char[ip_len + 1];
       for(int o = 0; o < ip_len; ++o) {
-        waited_ips[j][o] = newCmd[j*ip_len + blk_name_len + 12 + o];
+        waited_ips[j][o] = newCmd[j*ip_len + blk_name_len + 8 + COUNT_FIELD_LEN + 3 + o];
       }
       waited_ips[j][ip_len] = '\0';
       if(wait_gw_id == -1 && strcmp(waited_ips[j], (char*)(gw_ip.c_str())) == 0) {
@@ -365,7 +925,7 @@ void Datanode::analysisUpcodeCmd(char* newCmd, int newCmdLen) {
       mark_recv[j] = -1;
     }
     char* waited_buf = new char[chunk_size*waited_blk_num];
-    int* int_waited_buf;
+    const char** packet_srcs = new const char*[waited_blk_num];
     // 1st, wait blocks from the same rack/ cluster
     dn2dnSoc->paraRecvData(DN_SEND_DATA_PORT, waited_buf, chunk_size, packet_size, waited_blk_num - wait_gw_num, mark_recv, DATA_CHUNK, NULL);
     if(wait_gw_num != 0) {
@@ -389,13 +949,10 @@ void Datanode::analysisUpcodeCmd(char* newCmd, int newCmdLen) {
           }
         }
         if(can_cal_this_packet) {
-          int_buf = (int*)(buf + j * packet_size);
           for(int o = 0; o < waited_blk_num; ++o) {
-            int_waited_buf = (int*)(waited_buf + o * chunk_size + j * packet_size);
-            for(int num = 0; num < (long long)(packet_size * sizeof(char) / sizeof(int)); ++num) {
-              int_buf[num] = int_buf[num] ^ int_waited_buf[num];
-            }
+            packet_srcs[o] = waited_buf + o * chunk_size + j * packet_size;
           }
+          kernel->xorFanIn(packet_srcs, waited_blk_num, buf + j * packet_size, packet_size);
 
           cal_packet_num++;
           for(int o = 0; o < waited_blk_num; ++o) {
@@ -431,6 +988,7 @@ void Datanode::analysisUpcodeCmd(char* newCmd, int newCmdLen) {
     free(buf);
     delete mark_recv;
     delete waited_buf;
+    delete[] packet_srcs;
 
   }
 
@@ -454,14 +1012,15 @@ void Datanode::analysisDowncodeCmd(char* newCmd, int newCmdLen){
 void Datanode::analysisDowncodeDataCmd(char* newCmd, int newCmdLen) {
     // "wa"
 	// waited_blk_num: number of waited blocks
-    int waited_blk_num = newCmd[4] - '0';
+    int waited_blk_num = Socket::parseCount(newCmd + 4);
     // "blk"
 	// "ip1ip2..."
+    int ips_offset = 4 + COUNT_FIELD_LEN + 3;
     char** waited_ips = new char*[waited_blk_num];
     for(int j = 0; j < waited_blk_num; ++j) {
       waited_ips[j] = new char[ip_len + 1];
       for(int o = 0; o < ip_len; ++o) {
-        waited_ips[j][o] = newCmd[j*ip_len + 8 + o];
+        waited_ips[j][o] = newCmd[j*ip_len + ips_offset + o];
       }
       waited_ips[j][ip_len] = '\0';
     }
@@ -469,7 +1028,7 @@ void Datanode::analysisDowncodeDataCmd(char* newCmd, int newCmdLen) {
     // "se"
     char* blk_nm = new char[blk_name_len];
     for(int j = 0; j < blk_name_len; ++j) {
-       blk_nm[j] = newCmd[j + waited_blk_num*ip_len + 10];
+       blk_nm[j] = newCmd[j + waited_blk_num*ip_len + ips_offset + 2];
     }
     char* blk_loc = new char[data_path.length() + 1 + blk_name_len];
     strcpy(blk_loc, data_path.c_str());
@@ -483,7 +1042,6 @@ void Datanode::analysisDowncodeDataCmd(char* newCmd, int newCmdLen) {
     ssize_t ret = read(fd, buf, chunk_size);
     close(fd);
     cout<<"read size: "<<ret<<endl;
-    int* int_buf;
 
     // [wait blocks from the same rack/cluster]
     int packet_num = chunk_size / packet_size;
@@ -492,7 +1050,7 @@ void Datanode::analysisDowncodeDataCmd(char* newCmd, int newCmdLen) {
       mark_recv[j] = -1;
     }
     char* waited_buf = new char[chunk_size*waited_blk_num];
-    int* int_waited_buf;
+    const char** packet_srcs = new const char*[waited_blk_num];
     dn2dnSoc->paraRecvData(DN_SEND_DATA_PORT, waited_buf, chunk_size, packet_size, waited_blk_num, mark_recv, DATA_CHUNK, NULL);
 
     // [calculate an XOR sum based on the waited blocks]
@@ -507,13 +1065,10 @@ void Datanode::analysisDowncodeDataCmd(char* newCmd, int newCmdLen) {
           }
         }
         if(can_cal_this_packet) {
-          int_buf = (int*)(buf + j * packet_size);
           for(int o = 0; o < waited_blk_num; ++o) {
-            int_waited_buf = (int*)(waited_buf + o * chunk_size + j * packet_size);
-            for(int num = 0; num < (long long)(packet_size * sizeof(char) / sizeof(int)); ++num) {
-              int_buf[num] = int_buf[num] ^ int_waited_buf[num];
-            }
+            packet_srcs[o] = waited_buf + o * chunk_size + j * packet_size;
           }
+          kernel->xorFanIn(packet_srcs, waited_blk_num, buf + j * packet_size, packet_size);
 
           cal_packet_num++;
           for(int o = 0; o < waited_blk_num; ++o) {
@@ -526,7 +1081,7 @@ void Datanode::analysisDowncodeDataCmd(char* newCmd, int newCmdLen) {
     // [re-send the XOR sum]
     char* redirect_ip = new char[ip_len + 1];
     for(int j = 0; j < ip_len; ++j) {
-      redirect_ip[j] = newCmd[waited_blk_num*ip_len + blk_name_len + 10 + j];
+      redirect_ip[j] = newCmd[waited_blk_num*ip_len + ips_offset + 2 + blk_name_len + j];
     }
     redirect_ip[ip_len] = '\0';
     cout<<"YYYYYY redirected ip: "<<redirect_ip<<endl;
@@ -539,6 +1094,7 @@ void Datanode::analysisDowncodeDataCmd(char* newCmd, int newCmdLen) {
     free(buf);
     delete mark_recv;
     delete waited_buf;
+    delete[] packet_srcs;
     
     delete blk_nm;
     delete blk_loc;
@@ -550,15 +1106,16 @@ void Datanode::analysisDowncodeLPCmd(char* newCmd, int newCmdLen) {
     // "lp"
     // "wa"
     // waited_blk_num: number of waited blocks
-    int waited_blk_num = newCmd[6] - '0';
+    int waited_blk_num = Socket::parseCount(newCmd + 6);
     // "blk"
     // "ip1ip2..."
+    int ips_offset = 6 + COUNT_FIELD_LEN + 3;
     char** waited_ips = new char*[waited_blk_num];
     int wait_gw_id = -1;
     for(int j = 0; j < waited_blk_num; ++j) {
       waited_ips[j] = new char[ip_len + 1];
       for(int o = 0; o < ip_len; ++o) {
-        waited_ips[j][o] = newCmd[j*ip_len + 10 + o];
+        waited_ips[j][o] = newCmd[j*ip_len + ips_offset + o];
       }
       waited_ips[j][ip_len] = '\0';
       if(wait_gw_id == -1 && strcmp(waited_ips[j], (char*)(gw_ip.c_str())) == 0) {
@@ -573,7 +1130,7 @@ void Datanode::analysisDowncodeLPCmd(char* newCmd, int newCmdLen) {
 
     char* blk_nm = new char[blk_name_len];
     for(int j = 0; j < blk_name_len; ++j) {
-      blk_nm[j] = newCmd[j + waited_blk_num*ip_len + 16];
+      blk_nm[j] = newCmd[j + waited_blk_num*ip_len + ips_offset + 6];
     }
     char* blk_loc = new char[data_path.length() + 1 + blk_name_len];
     strcpy(blk_loc, data_path.c_str());
@@ -582,18 +1139,16 @@ void Datanode::analysisDowncodeLPCmd(char* newCmd, int newCmdLen) {
     // buf for store
     char* buf = (char*)malloc(sizeof(char)*chunk_size);
     memset(buf, 0, sizeof(char)*chunk_size);
-    int* int_buf;
     // buf for re-send
     char* buf_se = NULL;
     posix_memalign((void**)&buf_se, getpagesize(), chunk_size);
     memset(buf_se, 0, sizeof(char)*chunk_size);
-    if(newCmd[waited_blk_num*ip_len + 10] == 's' && newCmd[waited_blk_num*ip_len + 11] == 't' && newCmd[waited_blk_num*ip_len + 12] == 'r' && newCmd[waited_blk_num*ip_len + 13] == 'e') {
+    if(newCmd[waited_blk_num*ip_len + ips_offset] == 's' && newCmd[waited_blk_num*ip_len + ips_offset + 1] == 't' && newCmd[waited_blk_num*ip_len + ips_offset + 2] == 'r' && newCmd[waited_blk_num*ip_len + ips_offset + 3] == 'e') {
       int fd = open(blk_loc, O_RDONLY | O_DIRECT);
       ssize_t ret = read(fd, buf_se, chunk_size);
       close(fd);
       cout<<"read size: "<<ret<<endl;
     }
-    int* int_buf_se;
 
     // [wait blocks]
     int packet_num = chunk_size / packet_size;
@@ -602,7 +1157,7 @@ void Datanode::analysisDowncodeLPCmd(char* newCmd, int newCmdLen) {
       mark_recv[j] = -1;
     }
     char* waited_buf = new char[chunk_size*waited_blk_num];
-    int* int_waited_buf;
+    const char** packet_srcs = new const char*[waited_blk_num];
     // 1st, wait blocks from the same rack/ cluster
     dn2dnSoc->paraRecvData(DN_SEND_DATA_PORT, waited_buf, chunk_size, packet_size, waited_blk_num - wait_gw_num, mark_recv, DATA_CHUNK, NULL);
     if(wait_gw_num != 0) {
@@ -624,15 +1179,11 @@ void Datanode::analysisDowncodeLPCmd(char* newCmd, int newCmdLen) {
           }
         }
         if(can_cal_this_packet) {
-          int_buf = (int*)(buf + j * packet_size);
-          int_buf_se = (int*)(buf_se + j * packet_size);
           for(int o = 0; o < waited_blk_num; ++o) {
-            int_waited_buf = (int*)(waited_buf + o * chunk_size + j * packet_size);
-            for(int num = 0; num < (long long)(packet_size * sizeof(char) / sizeof(int)); ++num) {
-              int_buf[num] = int_buf[num] ^ int_waited_buf[num];
-              int_buf_se[num] = int_buf_se[num] ^ int_waited_buf[num];
-            }
+            packet_srcs[o] = waited_buf + o * chunk_size + j * packet_size;
           }
+          kernel->xorFanIn(packet_srcs, waited_blk_num, buf + j * packet_size, packet_size);
+          kernel->xorFanIn(packet_srcs, waited_blk_num, buf_se + j * packet_size, packet_size);
 
           cal_packet_num++;
           for(int o = 0; o < waited_blk_num; ++o) {
@@ -642,12 +1193,12 @@ void Datanode::analysisDowncodeLPCmd(char* newCmd, int newCmdLen) {
       } // end of for j < packet_num
     } // end of while
 
-    if(newCmd[waited_blk_num*ip_len + 10] == 's' && newCmd[waited_blk_num*ip_len + 11] == 't') {
+    if(newCmd[waited_blk_num*ip_len + ips_offset] == 's' && newCmd[waited_blk_num*ip_len + ips_offset + 1] == 't') {
       // "st" "re" "se"
       // "st" "de" "se"
       char* redirect_ip = new char[ip_len + 1];
       for(int j = 0; j < ip_len; ++j) {
-        redirect_ip[j] = newCmd[waited_blk_num*ip_len + blk_name_len + 16 + j];
+        redirect_ip[j] = newCmd[waited_blk_num*ip_len + ips_offset + 6 + blk_name_len + j];
       }
       redirect_ip[ip_len] = '\0';
       cout<<"ZZZZZZ redirected ip: "<<redirect_ip<<endl;
@@ -673,23 +1224,22 @@ void Datanode::analysisDowncodeLPCmd(char* newCmd, int newCmdLen) {
       fclose(fp2);
     }
 
-    if(newCmd[waited_blk_num*ip_len + 10] == 'c' && newCmd[waited_blk_num*ip_len + 11] == 'a') {
+    if(newCmd[waited_blk_num*ip_len + ips_offset] == 'c' && newCmd[waited_blk_num*ip_len + ips_offset + 1] == 'a') {
       // "ca"
       // "st"
       // "fi"
 
-      // alleviate too many acks
-      int delta = l_f / l_c;
+      // alleviate too many acks, only the last fast local parity block
+      // of each downcoded compact local group acks
       int ten = blk_nm[blk_name_len - 2] - '0';
       int single = blk_nm[blk_name_len - 1] - '0';
       int parity_id = ten * 10 + single;
-      for(int i = 0; i < l_c; ++i) {
-        if(parity_id == k + i * delta + delta - 1) {
-          cout<<"parity_id: "<<parity_id<<endl;
-          sendAck("fi_doco");
-          cout<<"--- send ack fi_doco"<<endl;
-          break;
-        }
+      int fast_local_group_id = parity_id - k;
+      if(0 <= fast_local_group_id && fast_local_group_id < l_f && layout->isLastFast(fast_local_group_id)
+         && layout->compactDelta(layout->compactGroupOfFast(fast_local_group_id)) > 1) {
+        cout<<"parity_id: "<<parity_id<<endl;
+        sendAck("fi_doco");
+        cout<<"--- send ack fi_doco"<<endl;
       }
     }
 
@@ -704,42 +1254,65 @@ void Datanode::analysisDowncodeLPCmd(char* newCmd, int newCmdLen) {
     free(buf_se);
     delete mark_recv;
     delete waited_buf;
+    delete[] packet_srcs;
 }
 
   // analyze command sent to the gateway
 void Datanode::analysisGWCmd(char* newCmd, int newCmdLen) {
-  int round = newCmd[2] - '0'; // for example, in Fig.4 in paper, when upcoding, round = l_c = 2
-  int offset = 3;
-  int waited_blk_num_per_round = newCmd[5] - '0'; // for example, in Fig.4 in paper, when upcoding, L0 waits for L1 and L2, then waited_blk_num_per_round = 2
-  int waited_blk_num = round * waited_blk_num_per_round; // for example, in Fig.4 in paper, when upcoding, waited_blk_num = 4
-  int cmd_length_per_round = 3 + ip_len * waited_blk_num_per_round + 2 + ip_len;
+  int round = Socket::parseCount(newCmd + 2); // for example, in Fig.4 in paper, when upcoding, round = l_c = 2
+  cout<<"round: "<<round<<endl;
+  int offset = relayGWRounds(newCmd, 2 + COUNT_FIELD_LEN, round);
+
+  if(newCmd[offset] != '\0') {
+    // for further re-send
+    int further_round = Socket::parseCount(newCmd + offset);
+    cout<<"further_round: "<<further_round<<endl;
+    relayGWRounds(newCmd, offset + COUNT_FIELD_LEN, further_round);
+  } // end of if newCmd[offset] != '\0'
+}
+
+  // relay the blocks of round rounds, each "wa" + n + n ips + "se" + ip, starting
+  // at offset of the gateway command; n may differ from round to round, e.g., when
+  // the local groups are of uneven sizes. return the offset after the last round
+int Datanode::relayGWRounds(char* newCmd, int offset, int round) {
+  // for example, in Fig.4 in paper, when upcoding, L0 waits for L1 and L2, then a round waits for 2 blocks
+  int* round_start = new int[round + 1];
+  round_start[0] = 0;
+  int start_offset = offset;
+  for(int i = 0; i < round; ++i) {
+    int waited_blk_num_this_round = Socket::parseCount(newCmd + start_offset + 2);
+    round_start[i + 1] = round_start[i] + waited_blk_num_this_round;
+    start_offset += 2 + COUNT_FIELD_LEN + ip_len * waited_blk_num_this_round + 2 + ip_len;
+  }
+  int waited_blk_num = round_start[round];
   char** waited_ips = new char*[waited_blk_num]; // source ips
   char** resend_ips = new char*[round]; // destination ips, all these constitute a relayer/ re-send manner !
-  cout<<"round: "<<round<<endl;
-  cout<<"waited_blk_num_per_round: "<<waited_blk_num_per_round<<endl;
-  cout<<"cmd_length_per_round: "<<cmd_length_per_round<<endl;
+  int* round_of = new int[waited_blk_num];
 
+  start_offset = offset;
   for(int i = 0; i < round; ++i) {
     resend_ips[i] = new char[ip_len + 1];
-    int start_offset = offset + cmd_length_per_round * i;
-    start_offset += 3;
-    for(int j = 0; j < waited_blk_num_per_round; ++j) {
-      waited_ips[i * waited_blk_num_per_round + j] = new char[ip_len + 1];
+    start_offset += 2 + COUNT_FIELD_LEN;
+    for(int j = round_start[i]; j < round_start[i + 1]; ++j) {
+      waited_ips[j] = new char[ip_len + 1];
       for(int o = 0; o < ip_len; ++o) {
-        waited_ips[i * waited_blk_num_per_round + j][o] = newCmd[start_offset + j*ip_len + o];
+        waited_ips[j][o] = newCmd[start_offset + o];
       }
-      waited_ips[i * waited_blk_num_per_round + j][ip_len] = '\0';
+      waited_ips[j][ip_len] = '\0';
+      round_of[j] = i;
+      start_offset += ip_len;
     }
-    start_offset += waited_blk_num_per_round*ip_len + 2;
+    start_offset += 2;
     for(int o = 0; o < ip_len; ++o) {
       resend_ips[i][o] = newCmd[start_offset + o];
     }
     resend_ips[i][ip_len] = '\0';
+    start_offset += ip_len;
   } // end of for
   for(int i = 0; i < round; ++i) {
     cout<<"wait: ";
-    for(int j = 0; j < waited_blk_num_per_round; ++j) {
-      cout<<"   "<<waited_ips[i * waited_blk_num_per_round + j]<<endl;
+    for(int j = round_start[i]; j < round_start[i + 1]; ++j) {
+      cout<<"   "<<waited_ips[j]<<endl;
     }
     cout<<"resend: ";
     cout<<"   "<<resend_ips[i]<<endl;
@@ -769,90 +1342,11 @@ void Datanode::analysisGWCmd(char* newCmd, int newCmdLen) {
         break;
       }
     }
-    int resend_i = i / waited_blk_num_per_round;
-    dn2dnSoc->sendData(waited_buf + index * chunk_size, chunk_size, packet_size, resend_ips[resend_i], DN_SEND_DATA_PORT);
+    dn2dnSoc->sendData(waited_buf + index * chunk_size, chunk_size, packet_size, resend_ips[round_of[i]], DN_SEND_DATA_PORT);
   }
   gettimeofday(&end_time1, NULL);
   cout<<"send time: "<<end_time1.tv_sec-start_time.tv_sec+(end_time1.tv_usec-start_time.tv_usec)*1.0/1000000<<endl;
 
-  offset += cmd_length_per_round * round;
-  if(newCmd[offset] != '\0') {
-    // for further re-send
-    int further_round = newCmd[offset] - '0';
-    offset += 1;
-    int num_per_round = newCmd[offset + 2] - '0';
-    int length_per_round = 3 + ip_len * num_per_round + 2 + ip_len;
-    
-    cout<<"further_round: "<<further_round<<endl;
-    cout<<"num_per_round: "<<num_per_round<<endl;
-    cout<<"length_per_round: "<<length_per_round<<endl;
-
-    int waited_num = further_round * num_per_round;
-    char** w_ips = new char*[waited_num];
-    char** r_ips = new char*[further_round];
-
-    for(int i = 0; i < further_round; ++i) {
-      r_ips[i] = new char[ip_len + 1];
-      int start_offset = offset + length_per_round * i;
-      start_offset += 3;
-      cout<<"further wait: ";
-      for(int j = 0; j < num_per_round; ++j) {
-        w_ips[i * num_per_round + j] = new char[ip_len + 1];
-        for(int o = 0; o < ip_len; ++o) {
-          w_ips[i * num_per_round + j][o] = newCmd[start_offset + j*ip_len + o];
-        }
-        w_ips[i * num_per_round + j][ip_len] = '\0';
-        cout<<"   "<<w_ips[i * num_per_round + j]<<endl;
-      }
-      start_offset += num_per_round*ip_len + 2;
-      for(int o = 0; o < ip_len; ++o) {
-        r_ips[i][o] = newCmd[start_offset + o];
-      }
-      r_ips[i][ip_len] = '\0';
-      cout<<"resend: ";
-      cout<<"   "<<r_ips[i]<<endl;
-    }
-
-    // wait data
-    int packet_num = chunk_size / packet_size;
-    int* mark_recv = new int[packet_num*waited_num];
-    for(int j = 0; j < packet_num*waited_num; ++j) {
-      mark_recv[j] = -1;
-    }
-    char** source_IPs_recv_data = new char*[waited_num];
-    for(int i = 0; i < waited_num; ++i) {
-      source_IPs_recv_data[i] = new char[20];
-    }
-    char* waited_buf = new char[chunk_size*waited_num];
-    dn2dnSoc->paraRecvData(DN_SEND_DATA_PORT, waited_buf, chunk_size, packet_size, waited_num, mark_recv, DATA_CHUNK, source_IPs_recv_data);
-
-    // re-send data 
-    for(int index = 0; index < waited_num; ++index) {
-      int i = 0;
-      for(; i < waited_num; ++i) {
-        if(strcmp(source_IPs_recv_data[index], w_ips[i]) == 0) {
-          break;
-        }
-      }
-      int resend_i = i / num_per_round;
-      dn2dnSoc->sendData(waited_buf + index * chunk_size, chunk_size, packet_size, r_ips[resend_i], DN_SEND_DATA_PORT);
-    }
-
-    delete waited_buf;
-    delete mark_recv;
-    for(int j = 0; j < waited_num; ++j) {
-      delete w_ips[j];
-      delete source_IPs_recv_data[j];
-    }
-    delete w_ips;
-    delete source_IPs_recv_data;
-    for(int j = 0; j < further_round; ++j) {
-      delete r_ips[j];
-    }
-    delete r_ips;
-
-  } // end of if newCmd[offset] != '\0'
-
   for(int i = 0; i < waited_blk_num; ++i) {
     delete waited_ips[i];
     delete source_IPs_recv_data[i];
@@ -865,6 +1359,9 @@ void Datanode::analysisGWCmd(char* newCmd, int newCmdLen) {
     delete resend_ips[i];
   }
   delete resend_ips;
+  delete[] round_start;
+  delete[] round_of;
+  return start_offset;
 }
 
  // send ack to the coordinator
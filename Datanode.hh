@@ -5,6 +5,10 @@
 #include <stdlib.h>
 #include "Socket.hh"
 #include "Config.hh"
+#include "ErasureCode.hh"
+#include "LRCKernel.hh"
+#include "CodeLayout.hh"
+#include "PartialSumCache.hh"
 
 using namespace std;
 
@@ -25,16 +29,41 @@ class Datanode{
     int chunk_size;
     int packet_size;
     char* data_blk_name;
+    LRCKernel *kernel;
+    CodeLayout *layout;
+      // the partial sums this node computed as the aggregator of degraded reads
+    PartialSumCache *partial_sums;
 
       // analyze the upload, download, upcode, and downcode commands
       // analyze upload command
     void analysisUploadCmd(char* cmd, int cmd_length);
       // analyze download command, may encounter block missing
     void analysisDownloadCmd(char* cmd, int cmd_length);
+      // overwrite a data block, and keep its delta
+    void analysisOverwriteCmd(char* cmd, int cmd_length);
+      // write a whole block to path, false on failure
+    bool writeFile(string path, char* buf);
+      // drop the delta of a data block
+    void analysisDropDeltaCmd(char* cmd, int cmd_length);
+      // read a block for the CN
+    void analysisReadCmd(char* cmd, int cmd_length);
+      // read a packet range of a block for the CN
+    void analysisRangeReadCmd(char* cmd, int cmd_length);
+      // remove the replica of a data block
+    void analysisRemoveCmd(char* cmd, int cmd_length);
       // after fixing block missing, ready to download again
     void analysisReadyDownloadCmd(char* cmd, int cmd_length);
+      // check whether a (parity) block exists
+    void analysisCheckCmd(char* cmd, int cmd_length);
       // analyze decode command
     void analysisDecodeCmd(char* newCmd, int newCmdLen);
+      // analyze decode command with global parity blocks, on the len bytes
+      // of the blocks from blk_offset, i.e., the whole blocks or a packet range
+    void analysisMultiDecodeCmd(char* newCmd, int newCmdLen, size_t blk_offset, size_t len);
+      // send a cached partial sum of a degraded read to the CN
+    void analysisPartialSumCmd(char* cmd, int cmd_length);
+      // analyze chain repair command, a hop of a pipelined repair
+    void analysisChainCmd(char* newCmd, int newCmdLen);
       // analyze upcode command
     void analysisUpcodeCmd(char* newCmd, int newCmdLen);
       // analyze downcode command
@@ -45,6 +74,8 @@ class Datanode{
     void analysisDowncodeLPCmd(char *newCmd, int newCmdLen);
       // analyze command sent to the gateway
     void analysisGWCmd(char* newCmd, int newCmdLen);
+      // relay the rounds of a gateway command, return the offset after them
+    int relayGWRounds(char* newCmd, int offset, int round);
 
       // analyze directly send sub-command
     void analysisDirectlySendCmd(char* newCmd, int newCmdLen);
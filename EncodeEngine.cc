@@ -0,0 +1,172 @@
+#include "EncodeEngine.hh"
+
+EncodeEngine::EncodeEngine(int k, int l_f, int g, LRCKernel* kernel, ErasureCode* ec, int worker_num) {
+  this->k = k;
+  this->l_f = l_f;
+  this->g = g;
+  this->kernel = kernel;
+  this->ec = ec;
+  if(worker_num <= 0) {
+    worker_num = thread::hardware_concurrency();
+  }
+  if(worker_num <= 0) {
+    worker_num = 1;
+  }
+  this->worker_num = worker_num;
+  next_queue = 0;
+  pending_task_num = 0;
+  stop = false;
+  next_job_id = 0;
+  queues = new deque<EncodeTask>[worker_num];
+  queue_locks = new mutex[worker_num];
+  workers = new thread[worker_num];
+  for(int i = 0; i < worker_num; ++i) {
+    workers[i] = thread([=]{this->workerLoop(i);});
+  }
+}
+
+EncodeEngine::~EncodeEngine() {
+  {
+    unique_lock<mutex> lk(idle_lock);
+    stop = true;
+  }
+  idle_cv.notify_all();
+  for(int i = 0; i < worker_num; ++i) {
+    workers[i].join();
+  }
+  delete [] workers;
+  delete [] queues;
+  delete [] queue_locks;
+}
+
+int EncodeEngine::workerNum() {
+  return worker_num;
+}
+
+int EncodeEngine::submit(char** buf, size_t len) {
+  int task_num = (len + ENGINE_TASK_SIZE - 1) / ENGINE_TASK_SIZE;
+  int job_id;
+  {
+    unique_lock<mutex> lk(job_lock);
+    job_id = next_job_id++;
+    job_remaining[job_id] = task_num;
+    struct timeval start_time;
+    gettimeofday(&start_time, NULL);
+    job_start[job_id] = start_time;
+  }
+  if(task_num == 0) {
+    finishTask(job_id);
+    return job_id;
+  }
+
+  // spread the tasks over the deques, the workers steal to balance them
+  for(int i = 0; i < task_num; ++i) {
+    EncodeTask task;
+    task.job_id = job_id;
+    task.buf = buf;
+    task.offset = (size_t)i * ENGINE_TASK_SIZE;
+    task.len = (len - task.offset < ENGINE_TASK_SIZE) ? (len - task.offset) : ENGINE_TASK_SIZE;
+    int q = next_queue;
+    next_queue = (next_queue + 1) % worker_num;
+    unique_lock<mutex> lk(queue_locks[q]);
+    queues[q].push_back(task);
+  }
+  {
+    unique_lock<mutex> lk(idle_lock);
+    pending_task_num += task_num;
+  }
+  idle_cv.notify_all();
+  return job_id;
+}
+
+double EncodeEngine::wait(int job_id) {
+  unique_lock<mutex> lk(job_lock);
+  job_cv.wait(lk, [&]{return job_remaining[job_id] == 0;});
+  return job_time[job_id];
+}
+
+void EncodeEngine::release(int job_id) {
+  unique_lock<mutex> lk(job_lock);
+  job_remaining.erase(job_id);
+  job_start.erase(job_id);
+  job_time.erase(job_id);
+}
+
+bool EncodeEngine::popTask(int worker_id, EncodeTask& task) {
+  {
+    unique_lock<mutex> lk(queue_locks[worker_id]);
+    if(!queues[worker_id].empty()) {
+      task = queues[worker_id].back();
+      queues[worker_id].pop_back();
+      return true;
+    }
+  }
+  for(int i = 1; i < worker_num; ++i) {
+    int victim = (worker_id + i) % worker_num;
+    unique_lock<mutex> lk(queue_locks[victim]);
+    if(!queues[victim].empty()) {
+      task = queues[victim].front();
+      queues[victim].pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void EncodeEngine::workerLoop(int worker_id) {
+  while(true) {
+    EncodeTask task;
+    if(popTask(worker_id, task)) {
+      {
+        unique_lock<mutex> lk(idle_lock);
+        pending_task_num--;
+      }
+      encodeRange(task.buf, task.offset, task.len);
+      finishTask(task.job_id);
+      continue;
+    }
+    unique_lock<mutex> lk(idle_lock);
+    idle_cv.wait(lk, [&]{return stop || pending_task_num > 0;});
+    if(stop && pending_task_num == 0) {
+      return;
+    }
+  }
+}
+
+void EncodeEngine::finishTask(int job_id) {
+  unique_lock<mutex> lk(job_lock);
+  if(job_remaining[job_id] > 0) {
+    job_remaining[job_id]--;
+  }
+  if(job_remaining[job_id] == 0) {
+    struct timeval end_time;
+    gettimeofday(&end_time, NULL);
+    struct timeval start_time = job_start[job_id];
+    job_time[job_id] = end_time.tv_sec-start_time.tv_sec+(end_time.tv_usec-start_time.tv_usec)*1.0/1000000;
+    job_cv.notify_all();
+  }
+}
+
+  // for each slice, the local parity blocks are zeroed and XORed from their
+  // groups, then the global parity blocks are multiplied from the same data slices
+void EncodeEngine::encodeRange(char** buf, size_t offset, size_t len) {
+  const char* srcs[k];
+  char* data[k];
+  char* parity[g];
+  for(size_t sub = offset; sub < offset + len; sub += GF_ENCODE_SLICE) {
+    size_t slice = (offset + len - sub < GF_ENCODE_SLICE) ? (offset + len - sub) : GF_ENCODE_SLICE;
+    for(int i = 0; i < k; ++i) {
+      srcs[i] = buf[i] + sub;
+      data[i] = buf[i] + sub;
+    }
+    for(int lp = 0; lp < l_f; ++lp) {
+      char* dst = buf[k + lp] + sub;
+      memset(dst, 0, slice);
+      kernel->xorFanIn(srcs + kernel->groupStart(lp, true), kernel->groupSize(lp, true), dst, slice);
+    }
+    for(int j = 0; j < g; ++j) {
+      parity[j] = buf[k + l_f + j] + sub;
+    }
+    ec->encodeGlobalParities(data, parity, slice);
+  }
+}
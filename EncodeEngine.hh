@@ -0,0 +1,94 @@
+/*
+ * Multi-core encoding of the parity blocks of stripes on the coordinator.
+ *
+ * A stripe submitted to the engine is cut into tasks of ENGINE_TASK_SIZE
+ * bytes (the same byte range of every block), which are spread over the
+ * deques of the worker threads. A worker takes tasks from the back of its
+ * own deque, and steals from the front of the others' when it runs out, so
+ * that several stripes, and the slices of one stripe, are encoded on all
+ * the cores. A task computes all the l_f local and g global parity blocks
+ * of its byte range in one pass, GF_ENCODE_SLICE bytes at a time, while the
+ * k data slices stay in the cache.
+ */
+
+#ifndef _ENCODEENGINE_H_H_H_
+#define _ENCODEENGINE_H_H_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include "ErasureCode.hh"
+#include "LRCKernel.hh"
+
+  // the bytes of each block encoded by a task
+#define ENGINE_TASK_SIZE (1024 * 1024)
+
+using namespace std;
+
+class EncodeEngine{
+  private:
+    struct EncodeTask {
+      int job_id;
+      char** buf;
+      size_t offset;
+      size_t len;
+    };
+
+    int k;
+    int l_f;
+    int g;
+    LRCKernel *kernel;
+    ErasureCode *ec;
+
+    int worker_num;
+    thread* workers;
+    deque<EncodeTask>* queues;
+    mutex* queue_locks;
+    int next_queue;
+
+      // workers sleep on idle_cv when there is no task left
+    mutex idle_lock;
+    condition_variable idle_cv;
+    int pending_task_num;
+    bool stop;
+
+      // job id -> number of unfinished tasks, and the encode time of the job
+    mutex job_lock;
+    condition_variable job_cv;
+    int next_job_id;
+    map<int, int> job_remaining;
+    map<int, struct timeval> job_start;
+    map<int, double> job_time;
+
+    void workerLoop(int worker_id);
+      // take a task from the own deque, or steal one from another worker
+    bool popTask(int worker_id, EncodeTask& task);
+      // encode all the parity blocks of [offset, offset + len) of a stripe
+    void encodeRange(char** buf, size_t offset, size_t len);
+    void finishTask(int job_id);
+
+  public:
+      // worker_num <= 0 uses all the cores
+    EncodeEngine(int k, int l_f, int g, LRCKernel* kernel, ErasureCode* ec, int worker_num);
+    ~EncodeEngine();
+
+      // encode the l_f + g parity blocks of a stripe, buf[0 ~ k-1] are the data
+      // blocks and buf[k ~ k+l_f+g-1] the parity blocks, each of len bytes;
+      // return immediately with the id of the job
+    int submit(char** buf, size_t len);
+      // wait until the parity blocks of a job are encoded, and return its encode
+      // time in seconds, i.e., from submit to the end of its last task;
+      // several threads may wait for the same job
+    double wait(int job_id);
+      // forget a finished job
+    void release(int job_id);
+    int workerNum(void);
+};
+
+#endif
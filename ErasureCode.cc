@@ -0,0 +1,438 @@
+#include "ErasureCode.hh"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define GF_X86 1
+#endif
+
+unsigned char ErasureCode::gf_exp[512];
+unsigned char ErasureCode::gf_log[256];
+unsigned char ErasureCode::gf_mul_table[256][256];
+unsigned char ErasureCode::gf_split_lo[256][16];
+unsigned char ErasureCode::gf_split_hi[256][16];
+once_flag ErasureCode::tables_once;
+bool ErasureCode::use_simd = false;
+
+  // build the log/exp tables, the full multiplication table (for the scalar
+  // path), and the 16-entry split tables (for the pshufb path)
+void ErasureCode::buildTables() {
+  int x = 1;
+  for(int i = 0; i < 255; ++i) {
+    gf_exp[i] = (unsigned char)x;
+    gf_log[x] = (unsigned char)i;
+    x <<= 1;
+    if(x & 0x100) {
+      x ^= GF_POLY;
+    }
+  }
+  for(int i = 255; i < 512; ++i) {
+    gf_exp[i] = gf_exp[i - 255];
+  }
+  gf_log[0] = 0;
+  for(int a = 0; a < 256; ++a) {
+    for(int b = 0; b < 256; ++b) {
+      if(a == 0 || b == 0) {
+        gf_mul_table[a][b] = 0;
+      } else {
+        gf_mul_table[a][b] = gf_exp[gf_log[a] + gf_log[b]];
+      }
+    }
+  }
+  for(int c = 0; c < 256; ++c) {
+    for(int n = 0; n < 16; ++n) {
+      gf_split_lo[c][n] = gf_mul_table[c][n];
+      gf_split_hi[c][n] = gf_mul_table[c][n << 4];
+    }
+  }
+#ifdef GF_X86
+  use_simd = __builtin_cpu_supports("ssse3");
+#endif
+}
+
+void ErasureCode::initTables() {
+  call_once(tables_once, buildTables);
+}
+
+ErasureCode::ErasureCode(int k, int g) {
+  initTables();
+  this->k = k;
+  this->g = g;
+  cache_hits = 0;
+  cache_misses = 0;
+  global_coefs = new unsigned char[(g > 0 ? g : 1) * k];
+  for(int j = 0; j < g; ++j) {
+    for(int i = 0; i < k; ++i) {
+      // Cauchy matrix, x_j = j, y_i = g + i, all distinct as long as k + g <= 256
+      global_coefs[j * k + i] = gfInv((unsigned char)(j ^ (g + i)));
+    }
+  }
+}
+
+ErasureCode::~ErasureCode() {
+  delete [] global_coefs;
+  decode_cache.clear();
+}
+
+unsigned char ErasureCode::gfMul(unsigned char a, unsigned char b) {
+  initTables();
+  return gf_mul_table[a][b];
+}
+
+unsigned char ErasureCode::gfDiv(unsigned char a, unsigned char b) {
+  if(a == 0 || b == 0) {
+    return 0;
+  }
+  initTables();
+  return gf_exp[gf_log[a] + 255 - gf_log[b]];
+}
+
+unsigned char ErasureCode::gfInv(unsigned char a) {
+  return gfDiv(1, a);
+}
+
+bool ErasureCode::simdEnabled() {
+  initTables();
+  return use_simd;
+}
+
+#ifdef GF_X86
+  // multiply 16 bytes at a time, each byte is split into two nibbles which
+  // index the two 16-entry tables of the coefficient via pshufb;
+  // return the number of bytes processed
+__attribute__((target("ssse3")))
+static size_t gfMulRegionSSSE3(const unsigned char* lo, const unsigned char* hi, const char* src, char* dst, size_t len, bool xor_tag) {
+  __m128i tbl_lo = _mm_loadu_si128((const __m128i*)lo);
+  __m128i tbl_hi = _mm_loadu_si128((const __m128i*)hi);
+  __m128i mask = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  for(; i + 16 <= len; i += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i nib_lo = _mm_and_si128(in, mask);
+    __m128i nib_hi = _mm_and_si128(_mm_srli_epi64(in, 4), mask);
+    __m128i out = _mm_xor_si128(_mm_shuffle_epi8(tbl_lo, nib_lo), _mm_shuffle_epi8(tbl_hi, nib_hi));
+    if(xor_tag) {
+      out = _mm_xor_si128(out, _mm_loadu_si128((const __m128i*)(dst + i)));
+    }
+    _mm_storeu_si128((__m128i*)(dst + i), out);
+  }
+  return i;
+}
+#endif
+
+void ErasureCode::gfMulRegion(unsigned char c, const char* src, char* dst, size_t len, bool xor_tag) {
+  if(c == 0) {
+    if(!xor_tag) {
+      memset(dst, 0, len);
+    }
+    return;
+  }
+  if(c == 1) {
+    if(xor_tag) {
+      xorRegion(src, dst, len);
+    } else if(src != dst) {
+      memcpy(dst, src, len);
+    }
+    return;
+  }
+  initTables();
+  size_t done = 0;
+#ifdef GF_X86
+  if(use_simd) {
+    done = gfMulRegionSSSE3(gf_split_lo[c], gf_split_hi[c], src, dst, len, xor_tag);
+  }
+#endif
+  const unsigned char* row = gf_mul_table[c];
+  const unsigned char* usrc = (const unsigned char*)src;
+  unsigned char* udst = (unsigned char*)dst;
+  for(size_t i = done; i < len; ++i) {
+    if(xor_tag) {
+      udst[i] ^= row[usrc[i]];
+    } else {
+      udst[i] = row[usrc[i]];
+    }
+  }
+}
+
+void ErasureCode::xorRegion(const char* src, char* dst, size_t len) {
+  size_t words = len / sizeof(unsigned long long);
+  const unsigned long long* wsrc = (const unsigned long long*)src;
+  unsigned long long* wdst = (unsigned long long*)dst;
+  for(size_t i = 0; i < words; ++i) {
+    wdst[i] ^= wsrc[i];
+  }
+  for(size_t i = words * sizeof(unsigned long long); i < len; ++i) {
+    dst[i] ^= src[i];
+  }
+}
+
+unsigned char ErasureCode::getGlobalCoef(int global_id, int data_id) {
+  return global_coefs[global_id * k + data_id];
+}
+
+  // for each slice of the data region, all the g parity slices are
+  // produced before moving on, so the data is read from memory only once
+void ErasureCode::encodeGlobalParities(char** data, char** parity, size_t len) {
+  for(size_t offset = 0; offset < len; offset += GF_ENCODE_SLICE) {
+    size_t slice = (len - offset < GF_ENCODE_SLICE) ? (len - offset) : GF_ENCODE_SLICE;
+    for(int j = 0; j < g; ++j) {
+      for(int i = 0; i < k; ++i) {
+        gfMulRegion(getGlobalCoef(j, i), data[i] + offset, parity[j] + offset, slice, i != 0);
+      }
+    }
+  }
+}
+
+  // Gauss-Jordan elimination over GF(2^8)
+bool ErasureCode::invertMatrix(unsigned char* matrix, int n) {
+  unsigned char* inv = new unsigned char[n * n];
+  memset(inv, 0, n * n);
+  for(int i = 0; i < n; ++i) {
+    inv[i * n + i] = 1;
+  }
+  for(int col = 0; col < n; ++col) {
+    int pivot = -1;
+    for(int row = col; row < n; ++row) {
+      if(matrix[row * n + col] != 0) {
+        pivot = row;
+        break;
+      }
+    }
+    if(pivot == -1) {
+      delete [] inv;
+      return false;
+    }
+    if(pivot != col) {
+      for(int j = 0; j < n; ++j) {
+        unsigned char tmp = matrix[col * n + j];
+        matrix[col * n + j] = matrix[pivot * n + j];
+        matrix[pivot * n + j] = tmp;
+        tmp = inv[col * n + j];
+        inv[col * n + j] = inv[pivot * n + j];
+        inv[pivot * n + j] = tmp;
+      }
+    }
+    unsigned char scale = gfInv(matrix[col * n + col]);
+    for(int j = 0; j < n; ++j) {
+      matrix[col * n + j] = gfMul(scale, matrix[col * n + j]);
+      inv[col * n + j] = gfMul(scale, inv[col * n + j]);
+    }
+    for(int row = 0; row < n; ++row) {
+      unsigned char factor = matrix[row * n + col];
+      if(row == col || factor == 0) {
+        continue;
+      }
+      for(int j = 0; j < n; ++j) {
+        matrix[row * n + j] ^= gfMul(factor, matrix[col * n + j]);
+        inv[row * n + j] ^= gfMul(factor, inv[col * n + j]);
+      }
+    }
+  }
+  memcpy(matrix, inv, n * n);
+  delete [] inv;
+  return true;
+}
+
+void ErasureCode::getGeneratorRow(int blk_id, int l, const int* group_of, unsigned char* row) {
+  memset(row, 0, k);
+  if(blk_id < k) {
+    // data block
+    row[blk_id] = 1;
+  } else if(blk_id < k + l) {
+    // local parity block, XOR sum of its local group
+    for(int i = 0; i < k; ++i) {
+      if(group_of[i] == blk_id - k) {
+        row[i] = 1;
+      }
+    }
+  } else {
+    // global parity block
+    for(int i = 0; i < k; ++i) {
+      row[i] = getGlobalCoef(blk_id - k - l, i);
+    }
+  }
+}
+
+bool ErasureCode::solveErasures(int l, const int* group_of, vector<int> erased, vector<Equation>& equations) {
+  int n = k + l + g;
+  equations.clear();
+
+  // [1st], look up the cache
+  string pattern = to_string(l) + ":";
+  for(size_t i = 0; i < erased.size(); ++i) {
+    pattern += to_string(erased[i]) + ",";
+  }
+  {
+    unique_lock<mutex> lk(cache_lock);
+    map<string, vector<Equation>>::const_iterator cacheIter = decode_cache.find(pattern);
+    if(cacheIter != decode_cache.end()) {
+      cache_hits++;
+      equations = cacheIter->second;
+      return true;
+    }
+    cache_misses++;
+  }
+
+  bool* is_erased = new bool[n];
+  for(int i = 0; i < n; ++i) {
+    is_erased[i] = false;
+  }
+  for(size_t i = 0; i < erased.size(); ++i) {
+    is_erased[erased[i]] = true;
+  }
+  vector<int> erased_data;
+  for(int i = 0; i < k; ++i) {
+    if(is_erased[i]) {
+      erased_data.push_back(i);
+    }
+  }
+  int e = erased_data.size();
+
+  // coefs[i * n + j]: coefficient of surviving block j in the equation of data block i
+  unsigned char* coefs = new unsigned char[k * n];
+  memset(coefs, 0, k * n);
+  for(int i = 0; i < k; ++i) {
+    if(!is_erased[i]) {
+      coefs[i * n + i] = 1;
+    }
+  }
+
+  // [2nd], solve the erased data blocks
+  if(e > 0) {
+    // local parity rows first, one for each local group with erased data blocks
+    vector<int> local_rows;
+    set<int> groups;
+    for(int t = 0; t < e; ++t) {
+      int grp = group_of[erased_data[t]];
+      if(groups.find(grp) == groups.end()) {
+        groups.insert(grp);
+        if(!is_erased[k + grp]) {
+          local_rows.push_back(k + grp);
+        }
+      }
+    }
+    if((int)local_rows.size() > e) {
+      local_rows.resize(e);
+    }
+    vector<int> global_rows;
+    for(int j = k + l; j < n; ++j) {
+      if(!is_erased[j]) {
+        global_rows.push_back(j);
+      }
+    }
+    int need = e - local_rows.size();
+    if(need > (int)global_rows.size()) {
+      delete [] is_erased;
+      delete [] coefs;
+      return false;
+    }
+
+    // then try the combinations of global parity rows, in lexicographic order
+    unsigned char* row = new unsigned char[k];
+    unsigned char* sub = new unsigned char[e * e];
+    vector<int> pick(need);
+    for(int i = 0; i < need; ++i) {
+      pick[i] = i;
+    }
+    vector<int> rows;
+    bool solved = false;
+    while(true) {
+      rows = local_rows;
+      for(int i = 0; i < need; ++i) {
+        rows.push_back(global_rows[pick[i]]);
+      }
+      for(int r = 0; r < e; ++r) {
+        getGeneratorRow(rows[r], l, group_of, row);
+        for(int t = 0; t < e; ++t) {
+          sub[r * e + t] = row[erased_data[t]];
+        }
+      }
+      if(invertMatrix(sub, e)) {
+        solved = true;
+        break;
+      }
+      // next combination
+      int i = need - 1;
+      while(i >= 0 && pick[i] == (int)global_rows.size() - need + i) {
+        --i;
+      }
+      if(i < 0) {
+        break;
+      }
+      pick[i]++;
+      for(int j = i + 1; j < need; ++j) {
+        pick[j] = pick[j - 1] + 1;
+      }
+    }
+
+    if(!solved) {
+      delete [] row;
+      delete [] sub;
+      delete [] is_erased;
+      delete [] coefs;
+      return false;
+    }
+
+    // x_E = Inv * (p + P_{~E} * x_{~E})
+    for(int t = 0; t < e; ++t) {
+      unsigned char* eq = coefs + erased_data[t] * n;
+      for(int r = 0; r < e; ++r) {
+        unsigned char c = sub[t * e + r];
+        if(c == 0) {
+          continue;
+        }
+        eq[rows[r]] ^= c;
+        getGeneratorRow(rows[r], l, group_of, row);
+        for(int j = 0; j < k; ++j) {
+          if(!is_erased[j] && row[j] != 0) {
+            eq[j] ^= gfMul(c, row[j]);
+          }
+        }
+      }
+    }
+    delete [] row;
+    delete [] sub;
+  }
+
+  // [3rd], write the equations, erased parity blocks are re-encoded from the data blocks
+  unsigned char* eq = new unsigned char[n];
+  unsigned char* row = new unsigned char[k];
+  for(size_t idx = 0; idx < erased.size(); ++idx) {
+    int blk_id = erased[idx];
+    if(blk_id < k) {
+      memcpy(eq, coefs + blk_id * n, n);
+    } else {
+      memset(eq, 0, n);
+      getGeneratorRow(blk_id, l, group_of, row);
+      for(int i = 0; i < k; ++i) {
+        if(row[i] == 0) {
+          continue;
+        }
+        for(int j = 0; j < n; ++j) {
+          if(coefs[i * n + j] != 0) {
+            eq[j] ^= gfMul(row[i], coefs[i * n + j]);
+          }
+        }
+      }
+    }
+    Equation equation;
+    for(int j = 0; j < n; ++j) {
+      if(eq[j] != 0) {
+        equation.push_back(make_pair(j, eq[j]));
+      }
+    }
+    equations.push_back(equation);
+  }
+  delete [] eq;
+  delete [] row;
+  delete [] is_erased;
+  delete [] coefs;
+
+  unique_lock<mutex> lk(cache_lock);
+  decode_cache.insert(make_pair(pattern, equations));
+  return true;
+}
+
+void ErasureCode::printCacheStats() {
+  unique_lock<mutex> lk(cache_lock);
+  cout<<"decode cache: "<<decode_cache.size()<<" patterns, "<<cache_hits<<" hits, "<<cache_misses<<" misses"<<endl;
+}
@@ -0,0 +1,100 @@
+/*
+ * GF(2^8) arithmetic and the Reed-Solomon part of the LRC, i.e., the g
+ * global parity blocks. Local parity blocks are plain XOR sums and are
+ * computed elsewhere (Coordinator / Datanode).
+ *
+ * The global parity j is computed as G_j = sum_i C[j][i] * D_i, where C is
+ * a g x k Cauchy matrix, C[j][i] = 1 / (x_j + y_i), x_j = j, y_i = g + i.
+ */
+
+#ifndef _ERASURECODE_H_H_H_
+#define _ERASURECODE_H_H_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <utility>
+#include <mutex>
+
+using namespace std;
+
+  // primitive polynomial x^8 + x^4 + x^3 + x^2 + 1
+#define GF_POLY 0x11d
+  // the data region is encoded in slices of this size, so that the
+  // k data slices and g parity slices stay in the cache
+#define GF_ENCODE_SLICE (32 * 1024)
+
+  // a repair equation, i.e., a lost block = sum of coef * surviving block,
+  // each term is (index of the surviving block in the stripe, coef)
+typedef vector<pair<int, unsigned char>> Equation;
+
+class ErasureCode{
+  private:
+    int k;
+    int g;
+      // g x k coefficients of the global parity blocks
+    unsigned char* global_coefs;
+
+    static unsigned char gf_exp[512];
+    static unsigned char gf_log[256];
+    static unsigned char gf_mul_table[256][256];
+      // split tables for pshufb, low nibble and high nibble of each coefficient
+    static unsigned char gf_split_lo[256][16];
+    static unsigned char gf_split_hi[256][16];
+    static once_flag tables_once;
+    static bool use_simd;
+      // the tables are built once per process, by the first ErasureCode or
+      // region multiply, e.g., on a DN that has no ErasureCode
+    static void buildTables(void);
+    static void initTables(void);
+
+      // decode cache, erasure pattern -> equations of the erased blocks,
+      // shared by the threads of the reads under cache_lock
+    map<string, vector<Equation>> decode_cache;
+    int cache_hits;
+    int cache_misses;
+    mutex cache_lock;
+
+      // invert an n x n matrix in place, return false if it is singular
+    static bool invertMatrix(unsigned char* matrix, int n);
+      // the generator row (over the k data blocks) of a block in the stripe
+    void getGeneratorRow(int blk_id, int l, const int* group_of, unsigned char* row);
+
+  public:
+    ErasureCode(int k, int g);
+    ~ErasureCode();
+
+      // GF(2^8) arithmetic
+    static unsigned char gfMul(unsigned char a, unsigned char b);
+    static unsigned char gfDiv(unsigned char a, unsigned char b);
+    static unsigned char gfInv(unsigned char a);
+      // dst = c * src (xor_tag == false), or dst ^= c * src (xor_tag == true)
+    static void gfMulRegion(unsigned char c, const char* src, char* dst, size_t len, bool xor_tag);
+      // dst ^= src
+    static void xorRegion(const char* src, char* dst, size_t len);
+      // whether the pshufb region multiply is in use
+    static bool simdEnabled(void);
+
+      // coefficient of data block data_id in global parity block global_id
+    unsigned char getGlobalCoef(int global_id, int data_id);
+      // encode the g global parity blocks from the k data blocks,
+      // each of len bytes
+    void encodeGlobalParities(char** data, char** parity, size_t len);
+
+      // solve the erased blocks of a stripe with l local groups, where group_of[i] is
+      // the local group of data block i; blocks are indexed as in the stripe, i.e.,
+      // data blocks, then local parity blocks, then global parity blocks.
+      // equations[i] expresses erased[i] over the surviving blocks. A data block
+      // that is the only loss of its local group is solved by its local equation,
+      // the others by combining local and global parity blocks.
+      // return false if the erasure pattern is not recoverable.
+    bool solveErasures(int l, const int* group_of, vector<int> erased, vector<Equation>& equations);
+    void printCacheStats(void);
+};
+
+#endif
@@ -18,25 +18,84 @@ int main(int argc, char** argv) {
 
   cout<<"- - - input cmd to call upload, download, upcode, downcode - - -"<<endl;
   cout<<"  1. cmd: ul (file)"<<endl;
-  cout<<"  2. cmd: dl (file)"<<endl;
-  cout<<"  3. cmd: uc (file)"<<endl;
-  cout<<"  4. cmd: dc (file)"<<endl;
-  cout<<"  5. cmd: te (file)"<<endl;
-  cout<<"  6. cmd: exit"<<endl;
-  cout<<"  Note: ul: upload, dl: download, uc: upcode, dc: downcode, ";
-  cout<<"te: test upload, download, upcode and downcode"<<endl;
-  char* input = new char[20];
+  cout<<"  2. cmd: ud (file)"<<endl;
+  cout<<"  3. cmd: ur (file)"<<endl;
+  cout<<"  4. cmd: er (file)"<<endl;
+  cout<<"  5. cmd: dl (file)"<<endl;
+  cout<<"  6. cmd: rd (file)"<<endl;
+  cout<<"  7. cmd: rr (file) (offset) (length)"<<endl;
+  cout<<"  8. cmd: rp"<<endl;
+  cout<<"  9. cmd: nr (DN ip)"<<endl;
+  cout<<"  10. cmd: rc (rack)"<<endl;
+  cout<<"  11. cmd: uc (file)"<<endl;
+  cout<<"  12. cmd: dc (file)"<<endl;
+  cout<<"  13. cmd: te (file)"<<endl;
+  cout<<"  14. cmd: be"<<endl;
+  cout<<"  15. cmd: ow (file) (block index) (new data file)"<<endl;
+  cout<<"  16. cmd: fl"<<endl;
+  cout<<"  17. cmd: cr"<<endl;
+  cout<<"  18. cmd: pc (stripe num)"<<endl;
+  cout<<"  19. cmd: rq"<<endl;
+  cout<<"  20. cmd: exit"<<endl;
+  cout<<"  Note: ul: upload, ud: upload with the local parity blocks computed by the DNs, ";
+  cout<<"ur: upload replicas, er: encode the replicas into the fast code, ";
+  cout<<"dl: download (with a repair), rd: read, rr: read a byte range, rp: repair the blocks missed by the reads, rq: report the repair queue, nr: recover a failed DN, rc: recover a failed rack, uc: upcode, dc: downcode, ";
+  cout<<"te: test upload, download, upcode and downcode, ";
+  cout<<"be: benchmark parity encoding and the XOR kernels, gr: check the repairs with the global parity blocks, ";
+  cout<<"ow: overwrite a data block, fl: flush the pending overwrites to the parity blocks, ";
+  cout<<"cr: report the cross-rack cost of each placement, pc: benchmark the plan templates"<<endl;
+  int input_len = 256;
+  char* input = new char[input_len];
   cout<<"input cmd: ";
-  char* file = new char[20];
-  while(cin.getline(input, 20)) {
+  char* file = new char[input_len];
+  char* new_data_file = new char[input_len];
+  int blk_idx;
+  size_t range_offset, range_length;
+  while(cin.getline(input, input_len)) {
+      // the repair daemon waits while a command runs
+    coor->enterForeground();
     if(input[0] == 'u' && input[1] == 'l') {
       strcpy(file, input + 3);
-      coor->uploadFile(string(file));
+      coor->uploadFile(string(file), UPLOAD_CN_PARITY);
+    }
+    if(input[0] == 'u' && input[1] == 'd') {
+      strcpy(file, input + 3);
+      coor->uploadFile(string(file), UPLOAD_DN_PARITY);
+    }
+    if(input[0] == 'u' && input[1] == 'r') {
+      strcpy(file, input + 3);
+      coor->uploadFile(string(file), UPLOAD_REPLICATED);
+    }
+    if(input[0] == 'e' && input[1] == 'r') {
+      strcpy(file, input + 3);
+      coor->encodeReplicatedFile(string(file));
     }
     if(input[0] == 'd' && input[1] == 'l') {
       strcpy(file, input + 3);
       coor->downloadFile(string(file), 0); // missing id set to 0
     }
+    if(input[0] == 'r' && input[1] == 'd') {
+      strcpy(file, input + 3);
+      coor->readFile(string(file));
+    }
+    if(input[0] == 'r' && input[1] == 'r') {
+      if(sscanf(input + 3, "%s %zu %zu", file, &range_offset, &range_length) == 3) {
+        coor->readRange(string(file), range_offset, range_length);
+      } else {
+        cout<<"Usage: rr (file) (offset) (length)"<<endl;
+      }
+    }
+    if(input[0] == 'r' && input[1] == 'p') {
+      coor->repairQueuedBlocks();
+    }
+    if(input[0] == 'n' && input[1] == 'r') {
+      strcpy(file, input + 3);
+      coor->recoverNode(string(file));
+    }
+    if(input[0] == 'r' && input[1] == 'c') {
+      strcpy(file, input + 3);
+      coor->recoverRack(string(file));
+    }
     if(input[0] == 'u' && input[1] == 'c') {
       strcpy(file, input + 3);
       coor->upcodeFile(string(file));
@@ -49,18 +108,48 @@ int main(int argc, char** argv) {
       strcpy(file, input + 3);
       coor->testPerformance(string(file));
     }
+    if(input[0] == 'b' && input[1] == 'e') {
+      coor->testEncodeThroughput();
+      coor->testKernelThroughput();
+    }
+    if(input[0] == 'g' && input[1] == 'r') {
+      coor->testGlobalRepair();
+    }
+    if(input[0] == 'o' && input[1] == 'w') {
+      if(sscanf(input + 3, "%s %d %s", file, &blk_idx, new_data_file) == 3) {
+        coor->overwriteBlock(string(file), blk_idx, string(new_data_file));
+      } else {
+        cout<<"Usage: ow (file) (block index) (new data file)"<<endl;
+      }
+    }
+    if(input[0] == 'f' && input[1] == 'l') {
+      coor->flushUpdates();
+    }
+    if(input[0] == 'c' && input[1] == 'r') {
+      coor->reportCrossRackCost();
+    }
+    if(input[0] == 'p' && input[1] == 'c') {
+      int stripe_num = 1000000;
+      sscanf(input + 2, "%d", &stripe_num);
+      coor->testPlanCache(stripe_num);
+    }
+    if(input[0] == 'r' && input[1] == 'q') {
+      coor->reportRepairQueue();
+    }
+    coor->leaveForeground();
     if(strcmp(input, "exit") == 0) {
       break;
     }
     cout<<"input cmd: ";
   }
 
+  delete coor;
   delete config;
   delete meta;
   delete cnSoc;
   delete dnSoc;
-  delete coor;
-  delete input;
-  delete file;
+  delete[] input;
+  delete[] file;
+  delete[] new_data_file;
   return 1;
 }
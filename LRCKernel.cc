@@ -0,0 +1,46 @@
+#include "LRCKernel.hh"
+
+void xorFanInGeneric(const char* const* src, int n, char* dst, size_t len) {
+  size_t words = len / sizeof(unsigned long long);
+  unsigned long long* wdst = (unsigned long long*)dst;
+  for(int j = 0; j < n; ++j) {
+    const unsigned long long* wsrc = (const unsigned long long*)src[j];
+    for(size_t i = 0; i < words; ++i) {
+      wdst[i] ^= wsrc[i];
+    }
+    for(size_t i = words * sizeof(unsigned long long); i < len; ++i) {
+      dst[i] ^= src[j][i];
+    }
+  }
+}
+
+template<int K, int LF, int LC>
+static LRCKernel* createShapeKernel(void) {
+  return new ShapeKernel<K, LF, LC>();
+}
+
+  // registered shapes, add a line here for a new production shape
+static const struct {
+  int k;
+  int l_f;
+  int l_c;
+  LRCKernel* (*create)(void);
+} kernel_registry[] = {
+  {4, 2, 1, createShapeKernel<4, 2, 1>},
+  {12, 6, 2, createShapeKernel<12, 6, 2>},
+  {16, 4, 2, createShapeKernel<16, 4, 2>},
+};
+
+LRCKernel* getLRCKernel(int k, int l_f, int l_c) {
+  int num = sizeof(kernel_registry) / sizeof(kernel_registry[0]);
+  for(int i = 0; i < num; ++i) {
+    if(kernel_registry[i].k == k && kernel_registry[i].l_f == l_f && kernel_registry[i].l_c == l_c) {
+      return kernel_registry[i].create();
+    }
+  }
+  return new GenericKernel(k, l_f, l_c);
+}
+
+LRCKernel* getLRCKernel(Config* conf) {
+  return getLRCKernel(conf->k, conf->l_f, conf->l_c);
+}
@@ -0,0 +1,153 @@
+/*
+ * Kernels shared by encode, repair and transcode (upcode/ downcode), i.e.,
+ * the mapping from a data block to its local group, and the XOR fan-in of
+ * several blocks into one.
+ *
+ * The shapes (k, l_f, l_c) that we run in production are specialized at
+ * compile time (ShapeKernel): r_f, r_c and delta are constants, and the
+ * XOR fan-in of r_f, r_c or delta blocks is unrolled. Other shapes, including
+ * those with local groups of uneven sizes, fall back to GenericKernel, which
+ * looks the groups up in a CodeLayout. getLRCKernel() picks the kernel of a
+ * Config.
+ */
+
+#ifndef _LRCKERNEL_H_H_H_
+#define _LRCKERNEL_H_H_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Config.hh"
+#include "CodeLayout.hh"
+
+using namespace std;
+
+  // dst ^= src[0] ^ src[1] ^ ... ^ src[n - 1], one pass over dst per source
+void xorFanInGeneric(const char* const* src, int n, char* dst, size_t len);
+
+  // XOR of the i-th word of N sources, expanded at compile time
+template<int N>
+struct XorTerm {
+  static inline unsigned long long get(const unsigned long long* const* w, size_t i) {
+    return w[N - 1][i] ^ XorTerm<N - 1>::get(w, i);
+  }
+};
+
+template<>
+struct XorTerm<1> {
+  static inline unsigned long long get(const unsigned long long* const* w, size_t i) {
+    return w[0][i];
+  }
+};
+
+  // dst ^= src[0] ^ ... ^ src[N - 1], unrolled, dst is read and written only once
+template<int N>
+struct XorFanIn {
+  static void run(const char* const* src, char* dst, size_t len) {
+    const unsigned long long* w[N];
+    for(int j = 0; j < N; ++j) {
+      w[j] = (const unsigned long long*)src[j];
+    }
+    unsigned long long* wdst = (unsigned long long*)dst;
+    size_t words = len / sizeof(unsigned long long);
+    for(size_t i = 0; i < words; ++i) {
+      wdst[i] ^= XorTerm<N>::get(w, i);
+    }
+    for(size_t i = words * sizeof(unsigned long long); i < len; ++i) {
+      for(int j = 0; j < N; ++j) {
+        dst[i] ^= src[j][i];
+      }
+    }
+  }
+};
+
+class LRCKernel{
+  public:
+    virtual ~LRCKernel() {}
+
+      // name of the kernel, e.g., "(12,6,2)" or "generic"
+    virtual const char* name(void) = 0;
+      // local group of a data block, in the fast (hot) or compact code
+    virtual int localGroup(int data_id, bool hot) = 0;
+      // first data block of a local group
+    virtual int groupStart(int group_id, bool hot) = 0;
+      // number of data blocks in a local group, i.e., r_f or r_c if uniform
+    virtual int groupSize(int group_id, bool hot) = 0;
+      // dst ^= src[0] ^ ... ^ src[n - 1]
+    virtual void xorFanIn(const char* const* src, int n, char* dst, size_t len) = 0;
+};
+
+class GenericKernel : public LRCKernel{
+  private:
+    CodeLayout layout;
+
+  public:
+    GenericKernel(int k, int l_f, int l_c) : layout(k, l_f, l_c) {
+    }
+    const char* name(void) {
+      return "generic";
+    }
+    int localGroup(int data_id, bool hot) {
+      return layout.groupOf(data_id, hot);
+    }
+    int groupStart(int group_id, bool hot) {
+      return layout.groupStart(group_id, hot);
+    }
+    int groupSize(int group_id, bool hot) {
+      return layout.groupSize(group_id, hot);
+    }
+    void xorFanIn(const char* const* src, int n, char* dst, size_t len) {
+      xorFanInGeneric(src, n, dst, len);
+    }
+};
+
+template<int K, int LF, int LC>
+class ShapeKernel : public LRCKernel{
+  public:
+    static const int R_F = K / LF;
+    static const int R_C = K / LC;
+    static const int DELTA = LF / LC;
+    static_assert(K % LF == 0 && K % LC == 0 && LF % LC == 0, "local groups must be of equal size");
+
+    static constexpr int fastGroup(int data_id) {
+      return data_id / R_F;
+    }
+    static constexpr int compactGroup(int data_id) {
+      return data_id / R_C;
+    }
+
+    const char* name(void) {
+      static char shape[32];
+      snprintf(shape, sizeof(shape), "(%d,%d,%d)", K, LF, LC);
+      return shape;
+    }
+    int localGroup(int data_id, bool hot) {
+      return hot ? fastGroup(data_id) : compactGroup(data_id);
+    }
+    int groupStart(int group_id, bool hot) {
+      return hot ? group_id * R_F : group_id * R_C;
+    }
+    int groupSize(int group_id, bool hot) {
+      return hot ? R_F : R_C;
+    }
+      // the fan-ins of encoding/ repairing a fast (r_f) or compact (r_c) local
+      // parity block, and of merging delta fast local parity blocks
+    void xorFanIn(const char* const* src, int n, char* dst, size_t len) {
+      if(n == R_F) {
+        XorFanIn<R_F>::run(src, dst, len);
+      } else if(n == R_C) {
+        XorFanIn<R_C>::run(src, dst, len);
+      } else if(n == DELTA) {
+        XorFanIn<DELTA>::run(src, dst, len);
+      } else {
+        xorFanInGeneric(src, n, dst, len);
+      }
+    }
+};
+
+  // the kernel of a shape, specialized if the shape is registered,
+  // generic otherwise; the caller deletes it
+LRCKernel* getLRCKernel(int k, int l_f, int l_c);
+LRCKernel* getLRCKernel(Config* conf);
+
+#endif
@@ -16,6 +16,16 @@ void Metadata::initializeMetaData(){
 
   _rack2dn = _config->rack2dn;
   _dn2rack = _config->dn2rack;
+
+  int rack_id = 0;
+  set<string>::const_iterator _racksIter;
+  for(_racksIter = _racks.begin(); _racksIter != _racks.end(); ++_racksIter, ++rack_id) {
+    set<string> tmpNodes = _rack2dn[*_racksIter];
+    for(set<string>::const_iterator it = tmpNodes.begin(); it != tmpNodes.end(); ++it) {
+      _dn2id[*it] = _dnid2rackid.size();
+      _dnid2rackid.push_back(rack_id);
+    }
+  }
 }
 
 
@@ -95,7 +105,7 @@ void Metadata::print(){
     cout<<*_fileNamesIter<<endl;
   }
   cout<<"file sizes: "<<endl;
-  map<string, int>::const_iterator _file2sizeIter;
+  map<string, off_t>::const_iterator _file2sizeIter;
   for(_file2sizeIter = _file2size.begin(); _file2sizeIter != _file2size.end(); ++_file2sizeIter){
     cout<<_file2sizeIter->first<<", "<<_file2sizeIter->second<<endl;
   }
@@ -145,9 +155,9 @@ void Metadata::print(){
     cout<<_blk2stripeIter->first<<", "<<_blk2stripeIter->second<<endl;
   }
   cout<<"block to IP address: "<<endl;
-  map<string, string>::const_iterator _blk2IpAddrIter;
+  map<string, pair<string, int>>::const_iterator _blk2IpAddrIter;
   for(_blk2IpAddrIter = _blk2IpAddr.begin(); _blk2IpAddrIter != _blk2IpAddr.end(); ++_blk2IpAddrIter){
-    cout<<_blk2IpAddrIter->first<<", "<<_blk2IpAddrIter->second<<endl;
+    cout<<_blk2IpAddrIter->first<<", "<<_blk2IpAddrIter->second.first<<endl;
   }
   cout<<"~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~"<<endl;
 }
@@ -180,6 +190,21 @@ string Metadata::getGW() {
   return _gw_ip;
 }
 
+int Metadata::getDNID(string dn) {
+  map<string, int>::const_iterator _dn2idIter = _dn2id.find(dn);
+  if(_dn2idIter == _dn2id.end()) {
+    return -1;
+  }
+  return _dn2idIter->second;
+}
+
+int Metadata::getDNRackID(int dn_id) {
+  if(dn_id < 0 || dn_id >= (int)_dnid2rackid.size()) {
+    return -1;
+  }
+  return _dnid2rackid[dn_id];
+}
+
 
   // [Part 2]: file-related operations
 void Metadata::setFileNum(int file_num){
@@ -190,8 +215,8 @@ void Metadata::updateFileNames(string file){
   _fileNames.insert(file);
 }
 
-void Metadata::updateFileSizes(string file, int size){
-  _file2size.insert(pair<string, int>(file, size));
+void Metadata::updateFileSizes(string file, off_t size){
+  _file2size.insert(pair<string, off_t>(file, size));
 }
 
 void Metadata::updateFileStripes(string file, set<string> stripes){
@@ -208,12 +233,16 @@ void Metadata::updateFileHots(string file){
   _file2isHotOrNot.insert(pair<string, bool>(file, true));
 }
 
+void Metadata::updateFileReplicated(string file, bool replicated){
+  _file2isReplicatedOrNot[file] = replicated;
+}
+
 int Metadata::getFileNum(){
   return _file_num;
 }
 
-int Metadata::getFileSize(string file){
-  map<string, int>::const_iterator _file2sizeIter;
+off_t Metadata::getFileSize(string file){
+  map<string, off_t>::const_iterator _file2sizeIter;
   if((_file2sizeIter = _file2size.find(file)) != _file2size.end()){
     return _file2sizeIter->second;
   }
@@ -246,6 +275,14 @@ bool Metadata::isFileHot(string file){
   return false;
 }
 
+bool Metadata::isFileReplicated(string file){
+  map<string, bool>::const_iterator _file2isReplicatedOrNotIter;
+  if((_file2isReplicatedOrNotIter = _file2isReplicatedOrNot.find(file)) != _file2isReplicatedOrNot.end()){
+    return _file2isReplicatedOrNotIter->second;
+  }
+  return false;
+}
+
 
   // [Part 3]: stripe-related operations
 void Metadata::setStripeNum(int stripe_num){
@@ -265,7 +302,23 @@ void Metadata::updateBlkStripes(string block, string stripe){
 }
 
 void Metadata::updateBlkIPs(string block, string IP){
-  _blk2IpAddr.insert(pair<string, string>(block, IP));
+  unique_lock<mutex> lk(_blk2IpLock);
+  _blk2IpAddr.insert(make_pair(block, make_pair(IP, getDNID(IP))));
+}
+
+void Metadata::moveBlkIP(string block, string IP){
+  unique_lock<mutex> lk(_blk2IpLock);
+  _blk2IpAddr[block] = make_pair(IP, getDNID(IP));
+}
+
+bool Metadata::relocateBlkIP(string block, string from_IP, string to_IP){
+  unique_lock<mutex> lk(_blk2IpLock);
+  map<string, pair<string, int>>::iterator _blk2IpAddrIter = _blk2IpAddr.find(block);
+  if(_blk2IpAddrIter == _blk2IpAddr.end() || _blk2IpAddrIter->second.first != from_IP){
+    return false;
+  }
+  _blk2IpAddrIter->second = make_pair(to_IP, getDNID(to_IP));
+  return true;
 }
 
 int Metadata::getStripeNum(){
@@ -301,13 +354,33 @@ string Metadata::getBlock2Stripe(string block){
 }
 
 string Metadata::getBlock2IP(string block){
-  map<string, string>::const_iterator _blk2IpAddrIter;
+  int dn_id;
+  return getBlock2IP(block, dn_id);
+}
+
+string Metadata::getBlock2IP(string block, int& dn_id){
+  unique_lock<mutex> lk(_blk2IpLock);
+  map<string, pair<string, int>>::const_iterator _blk2IpAddrIter;
   if((_blk2IpAddrIter = _blk2IpAddr.find(block)) != _blk2IpAddr.end()){
-    return _blk2IpAddrIter->second;
+    dn_id = _blk2IpAddrIter->second.second;
+    return _blk2IpAddrIter->second.first;
   }
+  dn_id = -1;
   return "Exception";
 }
 
+set<string> Metadata::getDN2Blocks(string dn){
+  set<string> tmpStrs;
+  unique_lock<mutex> lk(_blk2IpLock);
+  map<string, pair<string, int>>::const_iterator _blk2IpAddrIter;
+  for(_blk2IpAddrIter = _blk2IpAddr.begin(); _blk2IpAddrIter != _blk2IpAddr.end(); ++_blk2IpAddrIter){
+    if(_blk2IpAddrIter->second.first == dn){
+      tmpStrs.insert(_blk2IpAddrIter->first);
+    }
+  }
+  return tmpStrs;
+}
+
 int Metadata::getBlockIndexInStripe(string block){
   string stripe = getBlock2Stripe(block);
   set<pair<unsigned int, string>> tmpBlks = getStripe2Blocks(stripe);
@@ -320,6 +393,22 @@ int Metadata::getBlockIndexInStripe(string block){
  return -1;
 }
 
+void Metadata::markStripeUnderRedundant(string stripe){
+  _underRedundantStripes.insert(stripe);
+}
+
+void Metadata::markStripeRedundant(string stripe){
+  _underRedundantStripes.erase(stripe);
+}
+
+bool Metadata::isStripeUnderRedundant(string stripe){
+  return _underRedundantStripes.find(stripe) != _underRedundantStripes.end();
+}
+
+set<string> Metadata::getUnderRedundantStripes(){
+  return _underRedundantStripes;
+}
+
 
   // [Part 4]: update metadata for upcoding and downcoding
 void Metadata::upcodeUpdateMetadata(string file){
@@ -340,11 +429,13 @@ void Metadata::upcodeUpdateMetadata(string file){
   unsigned int tmp_block_idx;
   string tmp_block;
 
-  int delta = l_f / l_c;
+  CodeLayout layout(k, l_f, l_c);
 
   for(stripesIter = stripes.begin(); stripesIter != stripes.end(); ++stripesIter){
     tmp_stripe = *stripesIter;
     tmpBlocks = getStripe2Blocks(tmp_stripe);
+    tmpNewBlocks.clear();
+    tmpReservedBlocks.clear();
     set<pair<unsigned int, string>>::const_iterator tmpBlocksIter;
     cout<<"^^^^^^ Metadata analyzies a new stripe ^^^^^^"<<endl;
     cout<<"before upcoding: "<<endl;
@@ -357,14 +448,18 @@ void Metadata::upcodeUpdateMetadata(string file){
         tmpNewBlocks.insert(pair<unsigned int, string>(tmp_block_idx, tmp_block));
       } else if ((unsigned int)k <= tmp_block_idx && tmp_block_idx < (unsigned int)(k + l_f)) {
         // local parity blocks
-        if((tmp_block_idx - k) % delta == 0) {
-          int compact_local_parity_idx = k + (tmp_block_idx - k) / delta;
+        // the first fast local parity block of each compact local group becomes
+        // the compact one, the others are reserved
+        int fast_local_group_id = tmp_block_idx - k;
+        if(layout.isHeadFast(fast_local_group_id)) {
+          int compact_local_parity_idx = k + layout.compactGroupOfFast(fast_local_group_id);
           tmpNewBlocks.insert(pair<unsigned int, string>(compact_local_parity_idx, tmp_block));
         } else {
           tmpReservedBlocks.insert(pair<unsigned int, string>(tmp_block_idx, tmp_block));
         }
       } else {
-        // global parity blocks
+        // global parity blocks, they are kept as they are, 
+        // and only shifted behind the l_c compact local parity blocks
         int compact_global_parity_idx = tmp_block_idx - (l_f - l_c);
         tmpNewBlocks.insert(pair<unsigned int, string>(compact_global_parity_idx, tmp_block));
       }
@@ -412,11 +507,12 @@ void Metadata::downcodeUpdateMetadata(string file) {
   unsigned int tmp_block_idx;
   string tmp_block;
 
-  int delta = l_f / l_c;
+  CodeLayout layout(k, l_f, l_c);
 
   for(stripesIter = stripes.begin(); stripesIter != stripes.end(); ++stripesIter){
     tmp_stripe = *stripesIter;
     tmpBlocks = getStripe2Blocks(tmp_stripe);
+    tmpNewBlocks.clear();
     set<pair<unsigned int, string>>::const_iterator tmpBlocksIter;
     cout<<"^^^^^^ Metadata analyzies a new stripe ^^^^^^"<<endl;
     cout<<"before downcoding: "<<endl;
@@ -429,10 +525,10 @@ void Metadata::downcodeUpdateMetadata(string file) {
         tmpNewBlocks.insert(pair<unsigned int, string>(tmp_block_idx, tmp_block));
       } else if ((unsigned int)k <= tmp_block_idx && tmp_block_idx < (unsigned int)(k + l_c)) {
         // local parity blocks
-        int fast_local_parity_idx = k + (tmp_block_idx - k) * delta;
+        int fast_local_parity_idx = k + layout.compactFirstFast(tmp_block_idx - k);
         tmpNewBlocks.insert(pair<unsigned int, string>(fast_local_parity_idx, tmp_block));
       } else {
-        // global parity blocks
+        // global parity blocks, shifted behind the l_f fast local parity blocks
         int fast_global_parity_idx = tmp_block_idx + (l_f - l_c);
         tmpNewBlocks.insert(pair<unsigned int, string>(fast_global_parity_idx, tmp_block));
       }
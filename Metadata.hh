@@ -1,13 +1,17 @@
 #ifndef _METADATA_H_H_H_
 #define _METADATA_H_H_H_
 
+#include <sys/types.h>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <map>
 #include <set>
+#include <vector>
+#include <mutex>
 
 #include "Config.hh"
+#include "CodeLayout.hh"
 
 using namespace std;
 
@@ -25,25 +29,41 @@ class Metadata{
     set<string> _racks;
     map<string, set<string>> _rack2dn;
     map<string, string> _dn2rack;
+      // the nodes are numbered rack by rack once, a node id gives its rack id
+    map<string, int> _dn2id;
+    vector<int> _dnid2rackid;
 
     string _gw_ip;
 
     int _file_num;
     set<string> _fileNames;
-    map<string, int> _file2size;
+    map<string, off_t> _file2size;
     map<string, set<string>> _file2stripe;
     map<string, string> _stripe2file;
     map<string, bool> _file2isHotOrNot;
+      // a replicated file is stored as replicas of its data blocks, and
+      // not yet encoded into the fast code
+    map<string, bool> _file2isReplicatedOrNot;
     
     int _stripe_num;
     set<string> _stripeNames;
+      // _stripe2blk maps a stripe to its blocks, indexed by 0 ~ k-1 (data blocks),
+      // k ~ k+l-1 (local parity blocks), k+l ~ k+l+g-1 (global parity blocks),
+      // where l = l_f for a hot file and l = l_c for a cold file.
     map<string, set<pair<unsigned int, string>>> _stripe2blk;
       // _reservedStripe2blk is used for upcoding and downcoding,
       // e.g., when upcoding L0, L1, L2 into L0', then L1, L2 are 
       // stored in _reservedStripe2blk.
     map<string, set<pair<unsigned int, string>>> _reservedStripe2blk;
     map<string, string> _blk2stripe;
-    map<string, string> _blk2IpAddr;
+      // block -> (ip, id) of its node
+    map<string, pair<string, int>> _blk2IpAddr;
+      // guards _blk2IpAddr, whose blocks are moved by the repairs
+    mutex _blk2IpLock;
+      // stripes with blocks missing or not written, e.g., parity blocks of an
+      // early acked upload, found missing by a read or lost with their node;
+      // cleared once their blocks are rebuilt
+    set<string> _underRedundantStripes;
 
     void initializeMetaData(void);
   public:
@@ -56,19 +76,24 @@ class Metadata{
     set<string> getRack2DN(string rack);
     string getDN2Rack(string dn);
     string getGW(void);
+      // -1 for an unknown node
+    int getDNID(string dn);
+    int getDNRackID(int dn_id);
 
       // [Part 2]: file operations
     void setFileNum(int file_num);
     void updateFileNames(string file);
-    void updateFileSizes(string file, int size);
+    void updateFileSizes(string file, off_t size);
     void updateFileStripes(string file, set<string> stripes);
     void updateStripeFiles(string stripe, string file);
     void updateFileHots(string file);
+    void updateFileReplicated(string file, bool replicated);
     int getFileNum(void);
-    int getFileSize(string file);
+    off_t getFileSize(string file);
     set<string> getFile2Stripes(string file);
     string getStripe2File(string stripe);
     bool isFileHot(string file);
+    bool isFileReplicated(string file);
 
       // [Part 3]: stripe operations
     void setStripeNum(int stripe_num);
@@ -76,12 +101,25 @@ class Metadata{
     void updateStripeBlks(string stripe, set<pair<unsigned int, string>> blocks);
     void updateBlkStripes(string block, string stripe);
     void updateBlkIPs(string block, string IP);
+      // a block rebuilt on another node
+    void moveBlkIP(string block, string IP);
+      // a block rebuilt on to_IP, moved only if still located at from_IP;
+      // return whether it was moved
+    bool relocateBlkIP(string block, string from_IP, string to_IP);
     int getStripeNum(void);
     set<pair<unsigned int, string>> getStripe2Blocks(string stripe);
     set<pair<unsigned int, string>> getStripe2ReservedBlocks(string stripe);
     string getBlock2Stripe(string block);
     string getBlock2IP(string block);
+      // the ip of the node of a block, and its id in dn_id
+    string getBlock2IP(string block, int& dn_id);
+      // the blocks stored by a DN
+    set<string> getDN2Blocks(string dn);
     int getBlockIndexInStripe(string block);
+    void markStripeUnderRedundant(string stripe);
+    void markStripeRedundant(string stripe);
+    bool isStripeUnderRedundant(string stripe);
+    set<string> getUnderRedundantStripes(void);
 
       // [Part 4]: update metadata during upcoding and downcoding
     void upcodeUpdateMetadata(string file);
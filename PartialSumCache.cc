@@ -0,0 +1,90 @@
+#include "PartialSumCache.hh"
+
+PartialSumCache::PartialSumCache(int capacity) {
+  this->capacity = capacity;
+}
+
+PartialSumCache::~PartialSumCache() {
+  clear();
+}
+
+bool PartialSumCache::touch(long id) {
+  unique_lock<mutex> lk(cache_lock);
+  map<long, pair<list<long>::iterator, pair<char*, size_t>>>::iterator it = entries.find(id);
+  if(it == entries.end()) {
+    return false;
+  }
+  lru.splice(lru.begin(), lru, it->second.first);
+  return true;
+}
+
+bool PartialSumCache::copy(long id, char* buf, size_t len) {
+  unique_lock<mutex> lk(cache_lock);
+  map<long, pair<list<long>::iterator, pair<char*, size_t>>>::iterator it = entries.find(id);
+  if(it == entries.end() || it->second.second.first == NULL || it->second.second.second != len) {
+    return false;
+  }
+  lru.splice(lru.begin(), lru, it->second.first);
+  memcpy(buf, it->second.second.first, len);
+  return true;
+}
+
+long PartialSumCache::insert(long id, const char* buf, size_t len) {
+  unique_lock<mutex> lk(cache_lock);
+  if(capacity <= 0) {
+    return 0;
+  }
+  map<long, pair<list<long>::iterator, pair<char*, size_t>>>::iterator it = entries.find(id);
+  if(it != entries.end()) {
+    lru.erase(it->second.first);
+    delete[] it->second.second.first;
+    entries.erase(it);
+  }
+  long evicted = 0;
+  if((int)entries.size() >= capacity) {
+    evicted = lru.back();
+    lru.pop_back();
+    delete[] entries[evicted].second.first;
+    entries.erase(evicted);
+  }
+  char* copy_buf = NULL;
+  if(buf != NULL) {
+    copy_buf = new char[len];
+    memcpy(copy_buf, buf, len);
+  }
+  lru.push_front(id);
+  entries[id] = make_pair(lru.begin(), make_pair(copy_buf, len));
+  return evicted;
+}
+
+void PartialSumCache::erase(long id) {
+  unique_lock<mutex> lk(cache_lock);
+  map<long, pair<list<long>::iterator, pair<char*, size_t>>>::iterator it = entries.find(id);
+  if(it == entries.end()) {
+    return;
+  }
+  lru.erase(it->second.first);
+  delete[] it->second.second.first;
+  entries.erase(it);
+}
+
+void PartialSumCache::clear() {
+  unique_lock<mutex> lk(cache_lock);
+  map<long, pair<list<long>::iterator, pair<char*, size_t>>>::iterator it;
+  for(it = entries.begin(); it != entries.end(); ++it) {
+    delete[] it->second.second.first;
+  }
+  entries.clear();
+  lru.clear();
+}
+
+int PartialSumCache::size() {
+  unique_lock<mutex> lk(cache_lock);
+  return entries.size();
+}
+
+string PartialSumCache::idField(long id) {
+  char field[PARTIAL_ID_LEN + 1];
+  sprintf(field, "%010ld", id);
+  return string(field);
+}
@@ -0,0 +1,53 @@
+/*
+ * A bounded LRU of the partial sums of degraded reads, keyed by the id that
+ * the CN gives to a partial sum, i.e., to the blocks of a rack (with their
+ * coefficients and versions) summed up by its aggregator. A DN keeps the sums
+ * it computed; the CN keeps a mirror of the ids of each aggregator, with no
+ * buffer, and tells it which id to evict when it caches a new one.
+ */
+
+#ifndef _PARTIALSUMCACHE_H_H_H_
+#define _PARTIALSUMCACHE_H_H_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <list>
+#include <map>
+#include <mutex>
+
+  // width of a partial sum id in the commands, 0 stands for none
+#define PARTIAL_ID_LEN 10
+
+using namespace std;
+
+class PartialSumCache{
+  private:
+    int capacity;
+      // ids, the most recently used first
+    list<long> lru;
+    map<long, pair<list<long>::iterator, pair<char*, size_t>>> entries;
+    mutex cache_lock;
+
+  public:
+      // at most capacity sums
+    PartialSumCache(int capacity);
+    ~PartialSumCache();
+
+      // whether id is cached, it becomes the most recently used
+    bool touch(long id);
+      // a copy of the len bytes of the sum of id into buf, false if not cached
+      // or of another length
+    bool copy(long id, char* buf, size_t len);
+      // cache id, with a copy of the len bytes of buf unless NULL, and return
+      // the id evicted for it, 0 if none
+    long insert(long id, const char* buf, size_t len);
+    void erase(long id);
+    void clear(void);
+    int size(void);
+
+    static string idField(long id);
+};
+
+#endif
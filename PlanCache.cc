@@ -0,0 +1,115 @@
+#include "PlanCache.hh"
+
+PlanCache::PlanCache() {
+  hit_num = 0;
+  miss_num = 0;
+}
+
+string PlanCache::blockSlot(int index) {
+  char slot[16];
+  sprintf(slot, "%cB%012d", PLAN_SLOT_TAG, index);
+  return string(slot);
+}
+
+string PlanCache::nodeSlot(int index) {
+  char slot[16];
+  sprintf(slot, "%cI%010d", PLAN_SLOT_TAG, index);
+  return string(slot);
+}
+
+string PlanCache::reservedBlockSlot(int index) {
+  char slot[16];
+  sprintf(slot, "%cR%012d", PLAN_SLOT_TAG, index);
+  return string(slot);
+}
+
+string PlanCache::reservedNodeSlot(int index) {
+  char slot[16];
+  sprintf(slot, "%cJ%010d", PLAN_SLOT_TAG, index);
+  return string(slot);
+}
+
+  // a block is written as two chars, the renumbered node and rack, the
+  // stripes are short enough for a linear search of the numbers seen
+string PlanCache::signature(const int* nodes, const int* racks, int len) {
+  string sig(2 * len, ' ');
+  vector<int> seen_nodes;
+  vector<int> seen_racks;
+  for(int i = 0; i < len; ++i) {
+    size_t n = 0;
+    while(n < seen_nodes.size() && seen_nodes[n] != nodes[i]) {
+      n++;
+    }
+    if(n == seen_nodes.size()) {
+      seen_nodes.push_back(nodes[i]);
+    }
+    size_t r = 0;
+    while(r < seen_racks.size() && seen_racks[r] != racks[i]) {
+      r++;
+    }
+    if(r == seen_racks.size()) {
+      seen_racks.push_back(racks[i]);
+    }
+    sig[2 * i] = (char)('0' + n);
+    sig[2 * i + 1] = (char)('0' + r);
+  }
+  return sig;
+}
+
+PlanTemplate* PlanCache::find(const string& key) {
+  map<string, PlanTemplate>::iterator it = templates.find(key);
+  if(it == templates.end()) {
+    miss_num++;
+    return NULL;
+  }
+  hit_num++;
+  return &(it->second);
+}
+
+PlanTemplate* PlanCache::insert(const string& key, const PlanTemplate& plan) {
+  templates[key] = plan;
+  return &templates[key];
+}
+
+string PlanCache::instantiate(const string& tmpl, string blks[], string IPs[], string reserved_blks[], string reserved_IPs[]) {
+  string ret;
+  ret.reserve(tmpl.size());
+  size_t pos = 0;
+  while(pos < tmpl.size()) {
+    size_t slot = tmpl.find(PLAN_SLOT_TAG, pos);
+    if(slot == string::npos) {
+      ret.append(tmpl, pos, string::npos);
+      break;
+    }
+    ret.append(tmpl, pos, slot - pos);
+    char tag = tmpl[slot + 1];
+    int width = (tag == 'B' || tag == 'R') ? 12 : 10;
+    int index = 0;
+    for(int d = 0; d < width; ++d) {
+      index = index * 10 + (tmpl[slot + 2 + d] - '0');
+    }
+    if(tag == 'B') {
+      ret += blks[index];
+    } else if(tag == 'I') {
+      ret += IPs[index];
+    } else if(tag == 'R') {
+      ret += reserved_blks[index];
+    } else {
+      ret += reserved_IPs[index];
+    }
+    pos = slot + 2 + width;
+  }
+  return ret;
+}
+
+long PlanCache::hitNum() {
+  return hit_num;
+}
+
+long PlanCache::missNum() {
+  return miss_num;
+}
+
+int PlanCache::size() {
+  return templates.size();
+}
@@ -0,0 +1,70 @@
+/*
+ * Templates of the repair, upcode and downcode commands, compiled once per
+ * (operation, placement signature, lost blocks) and instantiated per stripe.
+ *
+ * The stripes of a file share the shape decided by decide_location, and so
+ * do their commands, up to the names and the nodes of their blocks. A template
+ * is generated with slots in place of them, a slot being '#' + a tag + the
+ * index of a block in the stripe, padded to the length of what it stands for:
+ *   "#B" + 12 digits: a block name,    "#I" + 10 digits: the node of a block,
+ *   "#R" + 12 digits: a reserved name, "#J" + 10 digits: a reserved node.
+ * A stripe instantiates a template by a single scan, with no metadata lookup.
+ * The placement signature tells apart the stripes whose commands differ,
+ * e.g., after their blocks were moved by a recovery: it is the pattern of the
+ * nodes and of the racks of their blocks, numbered in order of appearance.
+ */
+
+#ifndef _PLANCACHE_H_H_H_
+#define _PLANCACHE_H_H_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#define PLAN_SLOT_TAG '#'
+
+using namespace std;
+
+struct PlanTemplate {
+    // (destination, command), in the order they are sent, the destination is
+    // a slot or the gateway
+  vector<pair<string, string>> cmds;
+    // the gateway command, "" if none
+  string gw_cmd;
+};
+
+class PlanCache{
+  private:
+    map<string, PlanTemplate> templates;
+    long hit_num;
+    long miss_num;
+
+  public:
+    PlanCache();
+
+      // slots of the index-th block, and of the index-th reserved block
+    static string blockSlot(int index);
+    static string nodeSlot(int index);
+    static string reservedBlockSlot(int index);
+    static string reservedNodeSlot(int index);
+
+      // placement signature of len blocks, located at nodes[i] of racks[i],
+      // both numbered by the caller; they are renumbered in order of appearance
+    static string signature(const int* nodes, const int* racks, int len);
+
+      // the template of a key, NULL if not compiled yet
+    PlanTemplate* find(const string& key);
+    PlanTemplate* insert(const string& key, const PlanTemplate& plan);
+
+      // fill in the slots of a template with the blocks of a stripe,
+      // reserved_blks and reserved_IPs may be NULL if not used
+    static string instantiate(const string& tmpl, string blks[], string IPs[], string reserved_blks[], string reserved_IPs[]);
+
+    long hitNum(void);
+    long missNum(void);
+    int size(void);
+};
+
+#endif
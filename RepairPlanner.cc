@@ -0,0 +1,202 @@
+#include "RepairPlanner.hh"
+
+RepairPlanner::RepairPlanner(Metadata* meta) {
+  this->meta = meta;
+  gw_in_blocks = 0;
+  gw_out_blocks = 0;
+}
+
+long RepairPlanner::gatewayInBlocks() {
+  return gw_in_blocks;
+}
+
+long RepairPlanner::gatewayOutBlocks() {
+  return gw_out_blocks;
+}
+
+  // breadth first, so that the nodes given first become the aggregators
+map<string, string> RepairPlanner::buildTree(string root, vector<string>& nodes, int root_fan_in) {
+  map<string, string> parent;
+  vector<string> order;
+  vector<int> capacity;
+  order.push_back(root);
+  capacity.push_back(root_fan_in);
+  size_t p = 0;
+  for(size_t i = 0; i < nodes.size(); ++i) {
+    while(capacity[p] == 0) {
+      p++;
+    }
+    parent[nodes[i]] = order[p];
+    capacity[p]--;
+    order.push_back(nodes[i]);
+    capacity.push_back(PLANNER_MAX_FAN_IN);
+  }
+  return parent;
+}
+
+string RepairPlanner::rackOf(string ip, map<string, string>* rack_of) {
+  if(rack_of != NULL) {
+    return (*rack_of)[ip];
+  }
+  return meta->getDN2Rack(ip);
+}
+
+int RepairPlanner::loadOf(string ip, map<string, int>* load_of) {
+  if(load_of != NULL) {
+    return (*load_of)[ip];
+  }
+  return recvLoad(meta->getDNID(ip));
+}
+
+int RepairPlanner::recvLoad(int dn_id) {
+  if(dn_id < 0 || dn_id >= (int)recv_load.size()) {
+    return 0;
+  }
+  return recv_load[dn_id];
+}
+
+  // a node receives the blocks it waits for, i.e., the count after "mdwa";
+  // the gateway relays a single rack, or sums up several and sends one on
+void RepairPlanner::account(const map<string, string>& cmds, string gw_ip, string gw_round) {
+  bool gw_used = false;
+  map<string, string>::const_iterator cmdsIter;
+  for(cmdsIter = cmds.begin(); cmdsIter != cmds.end(); ++cmdsIter) {
+    int waited = Socket::parseCount(cmdsIter->second.c_str() + 4);
+    if(cmdsIter->first == gw_ip) {
+      gw_in_blocks += waited;
+      gw_used = true;
+      continue;
+    }
+    int dn_id = meta->getDNID(cmdsIter->first);
+    if(dn_id < 0) {
+      continue;
+    }
+    if(dn_id >= (int)recv_load.size()) {
+      recv_load.resize(dn_id + 1, 0);
+    }
+    recv_load[dn_id] += waited;
+  }
+  if(!gw_used && gw_round != "") {
+    gw_in_blocks++;
+    gw_used = true;
+  }
+  if(gw_used) {
+    gw_out_blocks++;
+  }
+}
+
+map<string, string> RepairPlanner::plan(string stripe_blks[], string blk_IPs[], int missing_ID, const Equation& equation, string gw_ip, string& gw_round, map<string, string>* rack_of, map<string, int>* load_of) {
+  map<string, string> retCmds;
+  gw_round = "";
+  string missing_block_ip = blk_IPs[missing_ID];
+  string missing_block_rack = rackOf(missing_block_ip, rack_of);
+
+  // "in" part of each helper node, i.e., its coefficients and blocks
+  vector<string> helper_ips;
+  map<string, string> ip2in;
+  map<string, int> ip2num;
+  char coef[4];
+  for(size_t i = 0; i < equation.size(); ++i) {
+    string tmp_ip = blk_IPs[equation[i].first];
+    if(ip2in.find(tmp_ip) == ip2in.end()) {
+      helper_ips.push_back(tmp_ip);
+      ip2in[tmp_ip] = "";
+      ip2num[tmp_ip] = 0;
+    }
+    sprintf(coef, "%03d", equation[i].second);
+    ip2in[tmp_ip] += string(coef) + stripe_blks[equation[i].first];
+    ip2num[tmp_ip]++;
+  }
+
+  vector<string> in_rack_ips;
+  vector<string> other_racks;
+  map<string, vector<string>> rack2ips;
+  for(size_t i = 0; i < helper_ips.size(); ++i) {
+    if(helper_ips[i] == missing_block_ip) {
+      continue;
+    }
+    string tmp_rack = rackOf(helper_ips[i], rack_of);
+    if(tmp_rack == missing_block_rack) {
+      in_rack_ips.push_back(helper_ips[i]);
+    } else {
+      if(rack2ips.find(tmp_rack) == rack2ips.end()) {
+        other_racks.push_back(tmp_rack);
+      }
+      rack2ips[tmp_rack].push_back(helper_ips[i]);
+    }
+  }
+  if(other_racks.size() > PLANNER_MAX_FAN_IN) {
+    cout<<"planner: "<<other_racks.size()<<" helper racks exceed the fan-in of the gateway"<<endl;
+    return retCmds;
+  }
+
+  auto lessLoaded = [this, load_of](const string& a, const string& b) {
+    return loadOf(a, load_of) < loadOf(b, load_of);
+  };
+  map<string, vector<string>> children;
+  map<string, string> next_hop;
+
+  // an aggregation tree in each other rack, rooted at its least loaded helper
+  vector<string> rack_roots;
+  for(size_t r = 0; r < other_racks.size(); ++r) {
+    vector<string> ips = rack2ips[other_racks[r]];
+    stable_sort(ips.begin(), ips.end(), lessLoaded);
+    string root = ips[0];
+    ips.erase(ips.begin());
+    map<string, string> parent = buildTree(root, ips, PLANNER_MAX_FAN_IN);
+    for(size_t i = 0; i < ips.size(); ++i) {
+      next_hop[ips[i]] = parent[ips[i]];
+      children[parent[ips[i]]].push_back(ips[i]);
+    }
+    next_hop[root] = gw_ip;
+    rack_roots.push_back(root);
+  }
+
+  // the tree of the rack of the missing block, where the gateway is waited last
+  int gw_num = rack_roots.empty() ? 0 : 1;
+  stable_sort(in_rack_ips.begin(), in_rack_ips.end(), lessLoaded);
+  map<string, string> parent = buildTree(missing_block_ip, in_rack_ips, PLANNER_MAX_FAN_IN - gw_num);
+  for(size_t i = 0; i < in_rack_ips.size(); ++i) {
+    next_hop[in_rack_ips[i]] = parent[in_rack_ips[i]];
+    children[parent[in_rack_ips[i]]].push_back(in_rack_ips[i]);
+  }
+
+  // [emit the commands]
+  map<string, string>::const_iterator hopIter;
+  for(hopIter = next_hop.begin(); hopIter != next_hop.end(); ++hopIter) {
+    string ip = hopIter->first;
+    vector<string>& waited = children[ip];
+    string cmd = "mdwa" + Socket::countField(waited.size()) + "blk";
+    for(size_t i = 0; i < waited.size(); ++i) {
+      cmd += waited[i];
+    }
+    cmd += "in" + Socket::countField(ip2num[ip]) + ip2in[ip] + "se" + hopIter->second;
+    retCmds[ip] = cmd;
+  }
+  vector<string>& waited = children[missing_block_ip];
+  string missing_cmd = "mdwa" + Socket::countField(waited.size() + gw_num) + "blk";
+  for(size_t i = 0; i < waited.size(); ++i) {
+    missing_cmd += waited[i];
+  }
+  if(gw_num != 0) {
+    missing_cmd += gw_ip;
+  }
+  missing_cmd += "in" + Socket::countField(ip2num[missing_block_ip]) + ip2in[missing_block_ip];
+  missing_cmd += "reco" + stripe_blks[missing_ID];
+  retCmds[missing_block_ip] = missing_cmd;
+
+  // a single rack is relayed by the gateway, several are summed up there
+  if(rack_roots.size() == 1) {
+    gw_round = "wa" + Socket::countField(1) + rack_roots[0] + "se" + missing_block_ip;
+  } else if(rack_roots.size() > 1) {
+    string gw_cmd = "mdwa" + Socket::countField(rack_roots.size()) + "blk";
+    for(size_t r = 0; r < rack_roots.size(); ++r) {
+      gw_cmd += rack_roots[r];
+    }
+    retCmds[gw_ip] = gw_cmd + "in" + Socket::countField(0) + "se" + missing_block_ip;
+  }
+  if(load_of == NULL) {
+    account(retCmds, gw_ip, gw_round);
+  }
+  return retCmds;
+}
@@ -0,0 +1,80 @@
+/*
+ * Plans the repair of a block from the blocks of its equation, for any
+ * placement of the stripe, i.e., also when the blocks were moved by a
+ * recovery or the racks are uneven.
+ *
+ * The helper nodes are grouped by rack. In each rack other than the one of
+ * the missing block, the helpers are summed up along an aggregation tree
+ * whose root sends a single partial sum through the gateway; when several
+ * racks send, the gateway sums them up and sends a single block on, so that
+ * the gateway takes in one block per helper rack and sends out one. In the
+ * rack of the missing block, the helpers and the gateway are summed up along
+ * a tree rooted at the node of the missing block, which stores the block.
+ * A node waits for at most PLANNER_MAX_FAN_IN others, larger racks get a
+ * deeper tree. The aggregators are the nodes
+ * that have received the fewest blocks over the plans made so far.
+ *
+ * A plan template (see PlanCache) is planned for given loads of its slots and
+ * accounted for nothing; the commands instantiated from it are accounted to
+ * their nodes, so that the next plans balance the aggregators as well.
+ */
+
+#ifndef _REPAIRPLANNER_H_H_H_
+#define _REPAIRPLANNER_H_H_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "Metadata.hh"
+#include "ErasureCode.hh"
+#include "Socket.hh"
+
+  // the partial sums waited by a node of an aggregation tree
+#define PLANNER_MAX_FAN_IN 9
+
+using namespace std;
+
+class RepairPlanner{
+  private:
+    Metadata *meta;
+      // blocks received by each node as an aggregator, over the plans so far,
+      // by node id (see Metadata)
+    vector<int> recv_load;
+      // blocks in and out of the gateway, over the plans so far
+    long gw_in_blocks;
+    long gw_out_blocks;
+
+      // attach the nodes below root in the order given, each node waiting for
+      // at most PLANNER_MAX_FAN_IN others, root for root_fan_in; return the
+      // parent of each node but root
+    map<string, string> buildTree(string root, vector<string>& nodes, int root_fan_in);
+      // rack of a node, from rack_of unless NULL, from the metadata otherwise
+    string rackOf(string ip, map<string, string>* rack_of);
+      // load of a node, from load_of unless NULL, from recv_load otherwise
+    int loadOf(string ip, map<string, int>* load_of);
+
+  public:
+    RepairPlanner(Metadata* meta);
+
+      // the "md" commands of repairing missing_ID from equation, keyed by
+      // the node ip, the gateway included when it sums up several racks. a
+      // single helper rack is relayed by the gateway instead, its round
+      // ("wa" + 1 + ip + "se" + ip) is returned in gw_round, "" if none. empty
+      // if the gateway would wait for more than PLANNER_MAX_FAN_IN racks.
+      // rack_of and load_of give the racks and the loads of the nodes, e.g.,
+      // of the slots of a plan template (see PlanCache), the metadata and
+      // recv_load are used if NULL; given load_of, the plan is not accounted
+    map<string, string> plan(string stripe_blks[], string blk_IPs[], int missing_ID, const Equation& equation, string gw_ip, string& gw_round, map<string, string>* rack_of = NULL, map<string, int>* load_of = NULL);
+      // account the blocks received by the nodes and the gateway of a plan
+    void account(const map<string, string>& cmds, string gw_ip, string gw_round);
+      // blocks received by a node over the plans accounted so far
+    int recvLoad(int dn_id);
+
+    long gatewayInBlocks(void);
+    long gatewayOutBlocks(void);
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "RepairQueue.hh"
+
+static double nowSeconds() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec * 1.0 / 1000000;
+}
+
+RepairQueue::RepairQueue(string path, int tolerance) {
+  this->path = path;
+  this->tolerance = tolerance;
+  next_seq = 0;
+  repaired_num = 0;
+  load();
+}
+
+tuple<int, int, int, long, string> RepairQueue::orderKey(const RepairEntry& entry) {
+  int left = tolerance - (int)entry.missing_IDs.size();
+  return make_tuple(entry.urgent ? 0 : 1, left, entry.hot ? 0 : 1, entry.seq, entry.stripe);
+}
+
+void RepairQueue::save() {
+  string tmp_path = path + ".tmp";
+  FILE* fp = fopen(tmp_path.c_str(), "w");
+  if(fp == NULL) {
+    cout<<"repair queue: cannot write "<<tmp_path<<endl;
+    return;
+  }
+  map<string, RepairEntry>::const_iterator it;
+  for(it = entries.begin(); it != entries.end(); ++it) {
+    fprintf(fp, "%s %d %ld", it->first.c_str(), (it->second.hot ? 1 : 0) | (it->second.urgent ? 2 : 0), it->second.seq);
+    set<int>::const_iterator idIter;
+    for(idIter = it->second.missing_IDs.begin(); idIter != it->second.missing_IDs.end(); ++idIter) {
+      fprintf(fp, " %d", *idIter);
+    }
+    fprintf(fp, "\n");
+  }
+  fflush(fp);
+  fsync(fileno(fp));
+  fclose(fp);
+  if(rename(tmp_path.c_str(), path.c_str()) != 0) {
+    cout<<"repair queue: cannot rename "<<tmp_path<<endl;
+    return;
+  }
+    // the rename is durable once the directory is synced
+  size_t slash = path.rfind('/');
+  string dir = (slash == string::npos) ? "." : path.substr(0, slash + 1);
+  int dir_fd = open(dir.c_str(), O_RDONLY);
+  if(dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+}
+
+void RepairQueue::load() {
+  FILE* fp = fopen(path.c_str(), "r");
+  if(fp == NULL) {
+    return;
+  }
+  char line[1024];
+  while(fgets(line, sizeof(line), fp) != NULL) {
+    char stripe[256];
+    int flags;
+    long seq;
+    int consumed;
+    if(sscanf(line, "%255s %d %ld%n", stripe, &flags, &seq, &consumed) != 3) {
+      continue;
+    }
+    RepairEntry entry;
+    entry.stripe = string(stripe);
+    entry.hot = ((flags & 1) != 0);
+    entry.urgent = ((flags & 2) != 0);
+    entry.seq = seq;
+    char* p = line + consumed;
+    int blk_id;
+    int n;
+    while(sscanf(p, "%d%n", &blk_id, &n) == 1) {
+      entry.missing_IDs.insert(blk_id);
+      p += n;
+    }
+    if(entry.missing_IDs.empty()) {
+      continue;
+    }
+    entries[entry.stripe] = entry;
+    order.insert(orderKey(entry));
+    if(seq >= next_seq) {
+      next_seq = seq + 1;
+    }
+  }
+  fclose(fp);
+  if(!entries.empty()) {
+    cout<<"repair queue: "<<entries.size()<<" stripes loaded from "<<path<<endl;
+  }
+}
+
+void RepairQueue::push(string stripe, int blk_id, bool hot, bool urgent) {
+  unique_lock<mutex> lk(queue_lock);
+  map<string, RepairEntry>::iterator it = entries.find(stripe);
+  if(it == entries.end()) {
+    RepairEntry entry;
+    entry.stripe = stripe;
+    entry.hot = hot;
+    entry.urgent = urgent;
+    entry.seq = next_seq++;
+    entry.missing_IDs.insert(blk_id);
+    entries[stripe] = entry;
+    order.insert(orderKey(entry));
+  } else {
+    if(it->second.missing_IDs.count(blk_id) != 0 && it->second.hot == hot && (it->second.urgent || !urgent)) {
+      return;
+    }
+    order.erase(orderKey(it->second));
+    it->second.missing_IDs.insert(blk_id);
+    it->second.hot = hot;
+    it->second.urgent = it->second.urgent || urgent;
+    order.insert(orderKey(it->second));
+  }
+  save();
+}
+
+vector<RepairEntry> RepairQueue::top(int num) {
+  unique_lock<mutex> lk(queue_lock);
+  vector<RepairEntry> ret;
+  set<tuple<int, int, int, long, string>>::const_iterator it;
+  for(it = order.begin(); it != order.end() && (int)ret.size() < num; ++it) {
+    ret.push_back(entries[get<4>(*it)]);
+  }
+  return ret;
+}
+
+void RepairQueue::repaired(string stripe, vector<int> blk_IDs) {
+  unique_lock<mutex> lk(queue_lock);
+  map<string, RepairEntry>::iterator it = entries.find(stripe);
+  if(it == entries.end() || blk_IDs.empty()) {
+    return;
+  }
+  order.erase(orderKey(it->second));
+  int num = 0;
+  for(size_t i = 0; i < blk_IDs.size(); ++i) {
+    num += it->second.missing_IDs.erase(blk_IDs[i]);
+  }
+  if(it->second.missing_IDs.empty()) {
+    entries.erase(it);
+  } else {
+    order.insert(orderKey(it->second));
+  }
+  repaired_num += num;
+  double now = nowSeconds();
+  repair_times.push_back(make_pair(now, num));
+  while(!repair_times.empty() && repair_times.front().first < now - REPAIR_RATE_WINDOW) {
+    repair_times.pop_front();
+  }
+  save();
+}
+
+void RepairQueue::remove(string stripe) {
+  unique_lock<mutex> lk(queue_lock);
+  map<string, RepairEntry>::iterator it = entries.find(stripe);
+  if(it == entries.end()) {
+    return;
+  }
+  order.erase(orderKey(it->second));
+  entries.erase(it);
+  save();
+}
+
+bool RepairQueue::empty() {
+  unique_lock<mutex> lk(queue_lock);
+  return entries.empty();
+}
+
+int RepairQueue::stripeNum() {
+  unique_lock<mutex> lk(queue_lock);
+  return entries.size();
+}
+
+int RepairQueue::blockNum() {
+  unique_lock<mutex> lk(queue_lock);
+  int num = 0;
+  map<string, RepairEntry>::const_iterator it;
+  for(it = entries.begin(); it != entries.end(); ++it) {
+    num += it->second.missing_IDs.size();
+  }
+  return num;
+}
+
+map<int, int> RepairQueue::toleranceHistogram() {
+  unique_lock<mutex> lk(queue_lock);
+  map<int, int> hist;
+  map<string, RepairEntry>::const_iterator it;
+  for(it = entries.begin(); it != entries.end(); ++it) {
+    hist[tolerance - (int)it->second.missing_IDs.size()]++;
+  }
+  return hist;
+}
+
+long RepairQueue::repairedNum() {
+  unique_lock<mutex> lk(queue_lock);
+  return repaired_num;
+}
+
+double RepairQueue::drainRate() {
+  unique_lock<mutex> lk(queue_lock);
+  double now = nowSeconds();
+  int num = 0;
+  for(size_t i = 0; i < repair_times.size(); ++i) {
+    if(repair_times[i].first >= now - REPAIR_RATE_WINDOW) {
+      num += repair_times[i].second;
+    }
+  }
+  return (double)num / REPAIR_RATE_WINDOW;
+}
@@ -0,0 +1,88 @@
+/*
+ * The degraded stripes waiting for the repair daemon of the coordinator,
+ * urgent ones first (e.g., parity blocks given up on upload), then ordered by
+ * the failures they can still take, then hot before cold, then by arrival. A
+ * stripe is queued once, with the union of its missing blocks.
+ *
+ * The queue is journaled to a file, rewritten (to a temporary file synced and
+ * renamed over it, then the directory synced) on every change, and loaded
+ * back when the coordinator restarts,
+ * one line per stripe:
+ *   stripe flags seq id id ...
+ * where flags is 1 for hot, plus 2 for urgent.
+ * The failures left are recomputed from the missing blocks on loading.
+ */
+
+#ifndef _REPAIRQUEUE_H_H_H_
+#define _REPAIRQUEUE_H_H_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <deque>
+#include <tuple>
+#include <mutex>
+#include <iostream>
+
+  // seconds of repairs over which the drain rate is measured
+#define REPAIR_RATE_WINDOW 60
+
+using namespace std;
+
+struct RepairEntry {
+  string stripe;
+  bool hot;
+  bool urgent;
+    // order of arrival, kept across restarts
+  long seq;
+  set<int> missing_IDs;
+};
+
+class RepairQueue{
+  private:
+    string path;
+      // a stripe takes any tolerance failures, e.g., g + 1 for an LRC
+    int tolerance;
+    map<string, RepairEntry> entries;
+      // (not urgent, failures left, cold, seq, stripe), the first one is repaired first
+    set<tuple<int, int, int, long, string>> order;
+    long next_seq;
+    long repaired_num;
+      // the times of the last repairs, for the drain rate
+    deque<pair<double, int>> repair_times;
+    mutex queue_lock;
+
+    tuple<int, int, int, long, string> orderKey(const RepairEntry& entry);
+    void save(void);
+    void load(void);
+
+  public:
+    RepairQueue(string path, int tolerance);
+
+      // queue the missing block blk_id of a stripe, merged with those queued;
+      // a stripe pushed urgent stays urgent until it leaves the queue
+    void push(string stripe, int blk_id, bool hot, bool urgent);
+      // at most num stripes, the most urgent first
+    vector<RepairEntry> top(int num);
+      // the blocks of a stripe repaired, the stripe leaves the queue with its last one
+    void repaired(string stripe, vector<int> blk_IDs);
+      // a stripe leaves the queue unrepaired
+    void remove(string stripe);
+
+    bool empty(void);
+    int stripeNum(void);
+    int blockNum(void);
+      // stripes by the failures they can still take
+    map<int, int> toleranceHistogram(void);
+    long repairedNum(void);
+      // blocks repaired per second over the last REPAIR_RATE_WINDOW seconds
+    double drainRate(void);
+};
+
+#endif
@@ -6,6 +6,16 @@ Socket::Socket(){
 Socket::~Socket(){
 }
 
+string Socket::countField(int num) {
+  char field[COUNT_FIELD_LEN + 1];
+  snprintf(field, sizeof(field), "%0*d", COUNT_FIELD_LEN, num);
+  return string(field);
+}
+
+int Socket::parseCount(const char* field) {
+  return atoi(string(field, COUNT_FIELD_LEN).c_str());
+}
+
 char* Socket::denormalizeIP(const char* dest_ip) {
   int max_ip_len = 12;
   int idx = 0;
@@ -254,3 +264,174 @@ size_t Socket::recvCmd(int server_port_num, size_t buf_size, char* buf){
   cout << "finish recvCmd !" << endl;
   return recv_len;
 }
+
+void Socket::sendFileData(int fd, off_t offset, size_t chunk_size, size_t packet_size, const char* des_ip, int des_port_num){
+  int client_socket = initClient();
+
+  struct sockaddr_in remote_addr;
+  bzero(&remote_addr, sizeof(remote_addr));
+  remote_addr.sin_family = AF_INET;
+  remote_addr.sin_port = htons(des_port_num);
+  char* denormalized_ip = denormalizeIP(des_ip);
+  if(inet_aton(denormalized_ip, &remote_addr.sin_addr) == 0){
+    cout<<"dest ip: "<<denormalized_ip<<endl;
+    perror("inet_aton fail!");
+  }
+  delete[] denormalized_ip;
+
+  while(connect(client_socket, (struct sockaddr*)&remote_addr, sizeof(remote_addr)) < 0);
+
+  // sendfile moves offset forward
+  size_t sent_len = 0;
+  while(sent_len < chunk_size){
+    size_t len = (chunk_size - sent_len < packet_size) ? (chunk_size - sent_len) : packet_size;
+    ssize_t ret = sendfile(client_socket, fd, &offset, len);
+    if(ret <= 0) {
+      perror("sendfile fail!");
+      break;
+    }
+    sent_len += ret;
+  }
+
+  if((close(client_socket)) == -1){
+    cout << "close client_socket error!" << endl;
+    exit(1);
+  }
+}
+
+void Socket::sendTaggedData(const char* tag, const char* buf, size_t chunk_size, size_t packet_size, const char* des_ip, int des_port_num){
+  int client_socket = initClient();
+
+  struct sockaddr_in remote_addr;
+  bzero(&remote_addr, sizeof(remote_addr));
+  remote_addr.sin_family = AF_INET;
+  remote_addr.sin_port = htons(des_port_num);
+  char* denormalized_ip = denormalizeIP(des_ip);
+  if(inet_aton(denormalized_ip, &remote_addr.sin_addr) == 0){
+    cout<<"dest ip: "<<denormalized_ip<<endl;
+    perror("inet_aton fail!");
+  }
+  delete[] denormalized_ip;
+
+  while(connect(client_socket, (struct sockaddr*)&remote_addr, sizeof(remote_addr)) < 0);
+
+  size_t sent_len = 0;
+  while(sent_len < DATA_TAG_LEN){
+    ssize_t ret = write(client_socket, tag + sent_len, DATA_TAG_LEN - sent_len);
+    if(ret <= 0) {
+      perror("send tag fail!");
+      break;
+    }
+    sent_len += ret;
+  }
+  sent_len = 0;
+  while(buf != NULL && sent_len < chunk_size){
+    size_t len = (chunk_size - sent_len < packet_size) ? (chunk_size - sent_len) : packet_size;
+    ssize_t ret = write(client_socket, buf + sent_len, len);
+    if(ret <= 0) {
+      perror("send tagged data fail!");
+      break;
+    }
+    sent_len += ret;
+  }
+
+  if((close(client_socket)) == -1){
+    cout << "close client_socket error!" << endl;
+    exit(1);
+  }
+}
+
+int Socket::initListener(int port_num){
+  int server_socket = initServer(port_num);
+  if(listen(server_socket, 100) == -1){
+    perror("server listen fail!");
+  }
+  return server_socket;
+}
+
+void Socket::closeListener(int server_socket){
+  if(close(server_socket) == -1){
+    cout << "close server_socket error!" << endl;
+    exit(1);
+  }
+}
+
+int Socket::acceptTagged(int server_socket, char* tag){
+  struct sockaddr_in remote_addr;
+  socklen_t length = sizeof(remote_addr);
+  int connfd = accept(server_socket, (struct sockaddr*)&remote_addr, &length);
+  size_t recv_len = 0;
+  while(recv_len < DATA_TAG_LEN){
+    ssize_t ret = read(connfd, tag + recv_len, DATA_TAG_LEN - recv_len);
+    if(ret <= 0) {
+      break;
+    }
+    recv_len += ret;
+  }
+  tag[recv_len] = '\0';
+  return connfd;
+}
+
+void Socket::recvTaggedData(int connfd, char* buf, size_t chunk_size, size_t packet_size){
+  size_t recv_len = 0;
+  while(recv_len < chunk_size){
+    size_t len = (chunk_size - recv_len < packet_size) ? (chunk_size - recv_len) : packet_size;
+    ssize_t ret = read(connfd, buf + recv_len, len);
+    if(ret <= 0) {
+      break;
+    }
+    recv_len += ret;
+  }
+  close(connfd);
+}
+
+int Socket::connectStream(const char* des_ip, int des_port_num){
+  int client_socket = initClient();
+
+  struct sockaddr_in remote_addr;
+  bzero(&remote_addr, sizeof(remote_addr));
+  remote_addr.sin_family = AF_INET;
+  remote_addr.sin_port = htons(des_port_num);
+  char* denormalized_ip = denormalizeIP(des_ip);
+  if(inet_aton(denormalized_ip, &remote_addr.sin_addr) == 0){
+    cout<<"dest ip: "<<denormalized_ip<<endl;
+    perror("inet_aton fail!");
+  }
+  delete[] denormalized_ip;
+
+  while(connect(client_socket, (struct sockaddr*)&remote_addr, sizeof(remote_addr)) < 0);
+  return client_socket;
+}
+
+int Socket::acceptStream(int server_socket){
+  struct sockaddr_in remote_addr;
+  socklen_t length = sizeof(remote_addr);
+  int connfd = accept(server_socket, (struct sockaddr*)&remote_addr, &length);
+  cout << "- - - stream from " << inet_ntoa(remote_addr.sin_addr) << endl;
+  return connfd;
+}
+
+bool Socket::readStream(int connfd, char* buf, size_t len){
+  size_t recv_len = 0;
+  while(recv_len < len){
+    ssize_t ret = read(connfd, buf + recv_len, len - recv_len);
+    if(ret <= 0) {
+      return false;
+    }
+    recv_len += ret;
+  }
+  return true;
+}
+
+bool Socket::writeStream(int connfd, const char* buf, size_t len){
+  size_t sent_len = 0;
+  while(sent_len < len){
+    ssize_t ret = write(connfd, buf + sent_len, len - sent_len);
+    if(ret <= 0) {
+      perror("write stream fail!");
+      return false;
+    }
+    sent_len += ret;
+  }
+  return true;
+}
@@ -8,9 +8,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <sys/sendfile.h>
 #include <string>
 #include <iostream>
 #include <thread>
@@ -23,6 +26,23 @@
 #define CN_DO_DATA_PORT 6129
 #define DN_RECV_DATA_PORT 2417
 #define DN_SEND_DATA_PORT 2835
+#define CN_READ_DATA_PORT 6131
+#define DN_CHAIN_DATA_PORT 2839
+
+  // a tagged block is preceded by its 14-char name and a 2-char status,
+  // "ok" if the block follows, "mi" if it is missing, "ps" if a partial
+  // sum of the (missing) block follows
+#define DATA_TAG_LEN 16
+
+  // offsets and lengths in the range commands ("rr", "mr") are zero-padded
+  // decimals of 10 digits
+#define RANGE_FIELD_LEN 10
+
+  // the counts in the commands, i.e., of the blocks waited ("wa") and read
+  // ("in"), of the slices ("sc", "sm") and of the rounds of the gateway ("ga"),
+  // are zero-padded decimals of 2 digits, as a stripe may exceed 9 blocks
+#define COUNT_FIELD_LEN 2
+#define COUNT_FIELD_MAX 99
 
 using namespace std;
 
@@ -35,12 +55,37 @@ class Socket{
   public:
     Socket();
     ~Socket();
+      // a count of the commands as a field, and a field back to the count
+    static string countField(int num);
+    static int parseCount(const char* field);
       // send data
     void sendData(const char* buf, size_t chunk_size, size_t packet_size, const char* des_ip, int des_port_num);
+      // send chunk_size bytes of a file from offset, by sendfile, i.e., without
+      // copying them through the user space
+    void sendFileData(int fd, off_t offset, size_t chunk_size, size_t packet_size, const char* des_ip, int des_port_num);
       // receive data in parallel
     void paraRecvData(int server_port_num, char* total_recv_data, size_t chunk_size, size_t packet_size, int num_conn, int* mark_recv, int flag, char** source_IPs);
       // receive command
     size_t recvCmd(int server_port_num, size_t buf_size, char* buf);
+
+      // tagged transfers, the receiver keeps listening across transfers, and
+      // places a block by its tag rather than by the source ip.
+      // send a tag, followed by the data if buf != NULL
+    void sendTaggedData(const char* tag, const char* buf, size_t chunk_size, size_t packet_size, const char* des_ip, int des_port_num);
+    int initListener(int port_num);
+    void closeListener(int server_socket);
+      // accept a tagged transfer and read its tag, return the connection
+    int acceptTagged(int server_socket, char* tag);
+      // read the data of a tagged transfer, and close the connection
+    void recvTaggedData(int connfd, char* buf, size_t chunk_size, size_t packet_size);
+
+      // streams, kept open while the packets of a block pass through, e.g.,
+      // along a repair chain. connect to a listener, accept from it, and read
+      // or write exactly len bytes, return false if the peer is gone
+    int connectStream(const char* des_ip, int des_port_num);
+    int acceptStream(int server_socket);
+    bool readStream(int connfd, char* buf, size_t len);
+    bool writeStream(int connfd, const char* buf, size_t len);
 };
 
 #endif